@@ -0,0 +1,158 @@
+#include "batch.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <type_traits>
+
+namespace {
+
+static constexpr size_t CONCAT_PIECE_BYTES = 1 << 20;
+
+// state of the book and the reconstructor at the start of a chunk
+struct Checkpoint {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::string book;
+    int cached_tfc_rows = 0;
+    int row_index = 0;
+};
+
+struct ChunkResult {
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    bool ok = false;
+};
+
+template <typename Book, typename Sink>
+void replay_chunk(const Checkpoint& checkpoint, Sink& sink, ChunkResult& result) {
+    Reconstructor<Book, Sink> reconstructor(sink);
+    if (!reconstructor.book.load_snapshot(checkpoint.book.data(), checkpoint.book.size())) {
+        return;
+    }
+    reconstructor.resume(checkpoint.cached_tfc_rows, checkpoint.row_index);
+    MboReader reader(checkpoint.begin, checkpoint.end);
+    MboRecord record;
+    while (reader.next(record)) {
+        reconstructor.process(record);
+        result.records++;
+    }
+    result.ok = true;
+}
+
+// the map book goes through the reference formatter, like the serial run
+template <typename Book>
+void render_chunk(const Checkpoint& checkpoint, const std::string& path, ChunkResult& result) {
+    if constexpr (std::is_same<Book, OrderBook>::value) {
+        std::ofstream outFile(path);
+        if (!outFile.is_open()) {
+            return;
+        }
+        FormatterSink formatter(outFile);
+        CountingSink<FormatterSink> sink(formatter);
+        replay_chunk<Book>(checkpoint, sink, result);
+        result.rows = sink.rows;
+        outFile.close();
+        result.ok = result.ok && !outFile.fail();
+    } else {
+        OutputBuffer out;
+        if (!out.open(path.c_str())) {
+            return;
+        }
+        MbpCsvWriter writer(out);
+        CountingSink<MbpCsvWriter> sink(writer);
+        replay_chunk<Book>(checkpoint, sink, result);
+        result.rows = sink.rows;
+        result.ok = out.close() && result.ok;
+    }
+}
+
+std::string part_path(const std::string& output_path, int chunk) {
+    return output_path + ".part" + std::to_string(chunk);
+}
+
+} // namespace
+
+template <typename Book>
+bool run_batch(const MappedFile& input, const BatchOptions& options, BatchStats* stats) {
+    MboReader header(input);
+    header.skip_header();
+    const char* body = header.position();
+    const char* end = input.data() + input.size();
+
+    // split at line boundaries; chunks can come out empty on tiny inputs
+    int chunks = std::max(1, options.chunks);
+    std::vector<Checkpoint> checkpoints(static_cast<size_t>(chunks));
+    const char* cur = body;
+    for (int i = 0; i < chunks; ++i) {
+        const char* split = body + (end - body) * (i + 1) / chunks;
+        split = std::max(split, cur);
+        if (i + 1 < chunks && split < end) {
+            const char* eol = find_newline(split, end);
+            split = (eol < end) ? eol + 1 : end;
+        } else {
+            split = end;
+        }
+        checkpoints[i].begin = cur;
+        checkpoints[i].end = split;
+        cur = split;
+    }
+
+    // pre-pass: book updates only, a chunk is started once its checkpoint is taken
+    std::vector<ChunkResult> results(static_cast<size_t>(chunks));
+    std::vector<std::thread> workers;
+    NullSink null_sink;
+    Reconstructor<Book, NullSink> pre_pass(null_sink);
+    for (int i = 0; i < chunks; ++i) {
+        Checkpoint& checkpoint = checkpoints[i];
+        pre_pass.book.save_snapshot(checkpoint.book);
+        checkpoint.cached_tfc_rows = pre_pass.cached_tfc_rows();
+        checkpoint.row_index = pre_pass.row_index();
+        workers.emplace_back([&, i] {
+            render_chunk<Book>(checkpoints[i], part_path(options.output_path, i), results[i]);
+        });
+        if (i + 1 < chunks) {
+            MboReader reader(checkpoint.begin, checkpoint.end);
+            MboRecord record;
+            while (reader.next(record)) {
+                pre_pass.process(record);
+            }
+        }
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    OutputBuffer out;
+    bool ok = out.open(options.output_path.c_str());
+    if (ok) {
+        out.append(mbp_header_line());
+    }
+    BatchStats local;
+    BatchStats& st = (stats != nullptr) ? *stats : local;
+    st.chunks = chunks;
+    for (int i = 0; i < chunks; ++i) {
+        std::string path = part_path(options.output_path, i);
+        ok = ok && results[i].ok;
+        st.records += results[i].records;
+        st.rows += results[i].rows;
+        MappedFile part;
+        if (ok && !part.open(path.c_str())) {
+            std::cerr << "batch chunk " << i << ": cannot read " << path << std::endl;
+            ok = false;
+        }
+        if (ok) {
+            for (size_t pos = 0; pos < part.size(); pos += CONCAT_PIECE_BYTES) {
+                out.append(std::string_view(part.data() + pos, std::min(CONCAT_PIECE_BYTES, part.size() - pos)));
+            }
+        }
+        part.close();
+        std::remove(path.c_str());
+    }
+    return out.close() && ok;
+}
+
+template bool run_batch<OrderBook>(const MappedFile&, const BatchOptions&, BatchStats*);
+template bool run_batch<LadderBook>(const MappedFile&, const BatchOptions&, BatchStats*);
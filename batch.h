@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "mbo_reader.h"
+
+struct BatchOptions {
+    int chunks = 4;                     // also the number of worker threads
+    std::string output_path = "mbp_reconstruction.csv";
+};
+
+struct BatchStats {
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    int chunks = 0;
+};
+
+// Parallel reprocessing of one mbo csv file. The body is split at line
+// boundaries into chunks; a pre-pass applies every chunk to a book without
+// rendering anything and checkpoints the book (save_snapshot) plus the
+// T-F-C and row counters at each boundary. Each chunk is then rendered on its
+// own thread from its checkpoint into <output_path>.partN, started as soon as
+// its checkpoint exists, and the parts are concatenated. Row indices are
+// global, so the output matches the serial run byte for byte.
+// Book is OrderBook (rendered by MBPFormatter) or LadderBook.
+template <typename Book>
+bool run_batch(const MappedFile& input, const BatchOptions& options, BatchStats* stats = nullptr);
@@ -0,0 +1,718 @@
+#include "order_book.h"
+#include "reconstructor.h"
+#include "simd_kernels.h"
+#include "mbp_writer.h"
+#include "verify.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <random>
+#include <set>
+#include <unistd.h>
+
+// Microbenchmarks in the style of Google Benchmark: every benchmark is a
+// function taking a BenchState and looping on state.keep_running(); setup
+// before the loop is not timed. The runner picks an iteration count that
+// fills MIN_RUN_TIME, then repeats the run REPETITIONS times and reports
+// mean/median/stddev/min per iteration. --json=FILE writes the results for
+// tracking across commits, --filter=TEXT runs the benchmarks whose name
+// contains TEXT, --label=TEXT is copied into the json (e.g. the git commit).
+// In the same run the end-to-end paths over mbo.csv each write their output
+// once to a file that is diffed against --verify=PATH, where {book} becomes
+// the path's book type (default mbp_golden_{book}.csv, the checked-in output;
+// --verify=mbp.csv --verify-skip-deep diffs against the reference instead);
+// a divergence is printed with the book there, recorded in the json and fails
+// the run. --no-verify skips this.
+
+static constexpr double MIN_RUN_TIME = 0.1;     // seconds per repetition
+static constexpr int REPETITIONS = 5;
+
+class BenchState {
+private:
+    uint64_t iterations_;
+    uint64_t remaining_;
+    uint64_t items_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point stop_;
+
+public:
+    explicit BenchState(uint64_t iterations) : iterations_(iterations), remaining_(iterations) {}
+
+    bool keep_running() {
+        if (remaining_ == iterations_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (remaining_ == 0) {
+            stop_ = std::chrono::steady_clock::now();
+            return false;
+        }
+        remaining_--;
+        return true;
+    }
+    uint64_t iterations() const { return iterations_; }
+    // items (rows, records, ...) handled over the whole run, for items/s
+    void set_items_processed(uint64_t items) { items_ = items; }
+    uint64_t items() const { return items_; }
+    double seconds() const { return std::chrono::duration<double>(stop_ - start_).count(); }
+};
+
+// keeps the optimizer from dropping a computed value
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void(BenchState&)> run;
+};
+
+static std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+static void add_benchmark(const std::string& name, std::function<void(BenchState&)> run) {
+    registry().push_back(Benchmark{name, std::move(run)});
+}
+
+// a benchmark whose output is checked against the reference csv
+struct OutputCheck {
+    std::string name;
+    const char* book;       // book type for print_divergence_book
+    std::function<void(const char* output)> write;
+};
+
+static std::vector<OutputCheck>& output_checks() {
+    static std::vector<OutputCheck> checks;
+    return checks;
+}
+
+// ---------------------------------------------------------------------------
+// synthetic mbo flow
+
+static constexpr int64_t SYNTH_MID = 10 * PRICE_SCALE;
+static constexpr int64_t SYNTH_TICK = PRICE_SCALE / 100;
+
+struct SyntheticOrder {
+    uint64_t order_id;
+    int64_t price;
+    int32_t size;
+    char side;
+};
+
+static void append_mbo_line(std::string& out, int64_t ts, char action, const SyntheticOrder& order, uint32_t sequence) {
+    char buf[256];
+    char* p = buf;
+    p = timestamp_to_chars(p, ts);
+    *p++ = ',';
+    p = timestamp_to_chars(p, ts);
+    std::memcpy(p, ",160,2,1108,", 12);
+    p += 12;
+    *p++ = action;
+    *p++ = ',';
+    *p++ = order.side;
+    *p++ = ',';
+    p = price_to_chars_fixed(p, order.price);
+    *p++ = ',';
+    p = int_to_chars(p, order.size);
+    std::memcpy(p, ",0,", 3);
+    p += 3;
+    p = uint_to_chars(p, order.order_id);
+    std::memcpy(p, ",130,0,", 7);
+    p += 7;
+    p = uint_to_chars(p, sequence);
+    std::memcpy(p, ",ARL\n", 5);
+    p += 5;
+    out.append(buf, static_cast<size_t>(p - buf));
+}
+
+static const char* MBO_HEADER =
+    "ts_recv,ts_event,rtype,publisher_id,instrument_id,action,side,price,size,"
+    "channel_id,order_id,flags,ts_in_delta,sequence,symbol\n";
+
+// levels_per_side price levels on each side with orders_per_level orders each,
+// followed by `churn` add/cancel pairs spread over the whole book
+static std::string synthetic_deep_book(int levels_per_side, int orders_per_level, int churn) {
+    std::mt19937_64 rng(42);
+    std::string csv = MBO_HEADER;
+    int64_t ts = 1752735600000000000LL;
+    uint32_t sequence = 0;
+    uint64_t next_id = 1;
+    for (int level = 0; level < levels_per_side; ++level) {
+        for (int k = 0; k < orders_per_level; ++k) {
+            SyntheticOrder bid{next_id++, SYNTH_MID - (level + 1) * SYNTH_TICK, 100, 'B'};
+            SyntheticOrder ask{next_id++, SYNTH_MID + (level + 1) * SYNTH_TICK, 100, 'A'};
+            append_mbo_line(csv, ts++, 'A', bid, sequence++);
+            append_mbo_line(csv, ts++, 'A', ask, sequence++);
+        }
+    }
+    for (int i = 0; i < churn; ++i) {
+        int level = static_cast<int>(rng() % static_cast<uint64_t>(levels_per_side));
+        char side = (rng() & 1) ? 'B' : 'A';
+        int64_t offset = (level + 1) * SYNTH_TICK;
+        SyntheticOrder order{next_id++, side == 'B' ? SYNTH_MID - offset : SYNTH_MID + offset,
+                             static_cast<int32_t>(1 + rng() % 500), side};
+        append_mbo_line(csv, ts++, 'A', order, sequence++);
+        append_mbo_line(csv, ts++, 'C', order, sequence++);
+    }
+    return csv;
+}
+
+// n messages near the touch where cancel_ratio of them cancel a live order
+static std::string synthetic_high_cancel(int messages, double cancel_ratio) {
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::string csv = MBO_HEADER;
+    std::vector<SyntheticOrder> live;
+    int64_t ts = 1752735600000000000LL;
+    uint32_t sequence = 0;
+    uint64_t next_id = 1;
+    for (int i = 0; i < messages; ++i) {
+        if (!live.empty() && coin(rng) < cancel_ratio) {
+            size_t pick = static_cast<size_t>(rng() % live.size());
+            append_mbo_line(csv, ts++, 'C', live[pick], sequence++);
+            live[pick] = live.back();
+            live.pop_back();
+        } else {
+            char side = (rng() & 1) ? 'B' : 'A';
+            int64_t offset = static_cast<int64_t>(1 + rng() % 20) * SYNTH_TICK;
+            SyntheticOrder order{next_id++, side == 'B' ? SYNTH_MID - offset : SYNTH_MID + offset,
+                                 static_cast<int32_t>(1 + rng() % 500), side};
+            append_mbo_line(csv, ts++, 'A', order, sequence++);
+            live.push_back(order);
+        }
+    }
+    return csv;
+}
+
+static std::string read_whole_file(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// ---------------------------------------------------------------------------
+// book operations
+
+// depth levels per side, 100 lots each, one tick apart around SYNTH_MID
+template <typename Book>
+static void fill_book(Book& book, int depth) {
+    for (int level = 0; level < depth; ++level) {
+        int64_t offset = (level + 1) * SYNTH_TICK;
+        book.add(book_price(book, SYNTH_MID - offset), 100, 'B');
+        book.add(book_price(book, SYNTH_MID + offset), 100, 'A');
+    }
+}
+
+template <typename Book>
+static void bm_add_cancel(BenchState& state, Book book, int depth) {
+    fill_book(book, depth);
+    std::mt19937_64 rng(1);
+    std::vector<std::pair<int64_t, char>> targets(1024);
+    for (auto& target : targets) {
+        int64_t offset = static_cast<int64_t>(1 + rng() % static_cast<uint64_t>(depth)) * SYNTH_TICK;
+        char side = (rng() & 1) ? 'B' : 'A';
+        target = {side == 'B' ? SYNTH_MID - offset : SYNTH_MID + offset, side};
+    }
+    size_t i = 0;
+    while (state.keep_running()) {
+        const auto& target = targets[i++ & 1023];
+        book.add(book_price(book, target.first), 50, target.second);
+        book.cancel(book_price(book, target.first), 50, target.second);
+    }
+    state.set_items_processed(state.iterations() * 2);
+}
+
+template <typename Book>
+static void bm_calculate_depth(BenchState& state, Book book, int depth) {
+    fill_book(book, depth);
+    std::mt19937_64 rng(2);
+    std::vector<int64_t> prices(1024);
+    for (auto& price : prices) {
+        price = SYNTH_MID - static_cast<int64_t>(rng() % static_cast<uint64_t>(depth + 2)) * SYNTH_TICK;
+    }
+    size_t i = 0;
+    int sum = 0;
+    while (state.keep_running()) {
+        sum += book.calculate_depth(book_price(book, prices[i++ & 1023]), 'B');
+    }
+    do_not_optimize(sum);
+    state.set_items_processed(state.iterations());
+}
+
+template <typename Book>
+static void bm_snapshot(BenchState& state, Book book, int depth) {
+    fill_book(book, depth);
+    MBPFormatter formatter;
+    size_t total = 0;
+    while (state.keep_running()) {
+        MBPFormatter::Snapshot snapshot = formatter.generate_top_10_snapshot(book);
+        total += snapshot.size();
+    }
+    do_not_optimize(total);
+    state.set_items_processed(state.iterations());
+}
+
+// the legacy string entry point: std::stod on every call
+static void bm_calculate_depth_string(BenchState& state, int depth) {
+    OrderBook book;
+    fill_book(book, depth);
+    std::mt19937_64 rng(2);
+    std::vector<std::string> prices(1024);
+    for (auto& price : prices) {
+        price = std::to_string(price_to_double(SYNTH_MID - static_cast<int64_t>(rng() % static_cast<uint64_t>(depth + 2)) * SYNTH_TICK));
+    }
+    size_t i = 0;
+    int sum = 0;
+    while (state.keep_running()) {
+        sum += book.calculate_depth(prices[i++ & 1023], 'B');
+    }
+    do_not_optimize(sum);
+    state.set_items_processed(state.iterations());
+}
+
+// count_better_prices over a full 10-level top at the given kernel level
+static void bm_depth_kernel(BenchState& state, SimdLevel level) {
+    LadderBook book;
+    fill_book(book, 10);
+    std::mt19937_64 rng(2);
+    std::vector<int64_t> prices(1024);
+    for (auto& price : prices) {
+        price = SYNTH_MID - static_cast<int64_t>(rng() % 12) * SYNTH_TICK;
+    }
+    SimdLevel previous = simd_level();
+    set_simd_level(level);
+    const TopLevels& top = book.bids.top();
+    size_t i = 0;
+    int sum = 0;
+    while (state.keep_running()) {
+        sum += count_better_prices(top.price, top.count, prices[i++ & 1023], true);
+    }
+    set_simd_level(previous);
+    do_not_optimize(sum);
+    state.set_items_processed(state.iterations());
+}
+
+// current check_snapshot_changed on the map book: 60 strings built and compared
+static void bm_snapshot_changed_strings(BenchState& state) {
+    OrderBook book;
+    fill_book(book, 10);
+    MBPFormatter formatter;
+    MBPFormatter::Snapshot previous;
+    size_t i = 0;
+    int changed = 0;
+    while (state.keep_running()) {
+        // every other call moves one level, the rest compare equal
+        if (i++ & 1) {
+            book.add(book_price(book, SYNTH_MID - 3 * SYNTH_TICK), 1, 'B');
+        }
+        changed += formatter.check_snapshot_changed(previous, book);
+    }
+    do_not_optimize(changed);
+    state.set_items_processed(state.iterations());
+}
+
+static void bm_snapshot_changed_kernel(BenchState& state, SimdLevel level) {
+    LadderBook book;
+    fill_book(book, 10);
+    SimdLevel previous_level = simd_level();
+    set_simd_level(level);
+    MBPFormatter formatter;
+    TopLevels previous_bids, previous_asks;
+    size_t i = 0;
+    int changed = 0;
+    while (state.keep_running()) {
+        if (i++ & 1) {
+            book.add(SYNTH_MID - 3 * SYNTH_TICK, 1, 'B');
+        }
+        changed += formatter.check_snapshot_changed(previous_bids, previous_asks, book);
+    }
+    set_simd_level(previous_level);
+    do_not_optimize(changed);
+    state.set_items_processed(state.iterations());
+}
+
+// generate_mbp_row on the first 1024 records of mbo.csv against a 10-level book
+static void bm_generate_mbp_row(BenchState& state, const std::string& mbo) {
+    OrderBook book;
+    fill_book(book, 10);
+    MboReader reader(mbo.data(), mbo.data() + mbo.size());
+    reader.skip_header();
+    std::vector<MboRecord> records;
+    MboRecord record;
+    while (records.size() < 1024 && reader.next(record)) {
+        records.push_back(record);
+    }
+    std::ofstream devnull("/dev/null");
+    MBPFormatter formatter;
+    size_t i = 0;
+    while (state.keep_running()) {
+        formatter.generate_mbp_row(devnull, records[i & 1023], book, static_cast<int>(i), false);
+        i++;
+    }
+    state.set_items_processed(state.iterations());
+}
+
+static std::vector<std::string> mbo_lines(const std::string& mbo, size_t limit) {
+    std::vector<std::string> lines;
+    std::istringstream in(mbo);
+    std::string line;
+    std::getline(in, line);
+    while (lines.size() < limit && std::getline(in, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static void bm_parse_line_to_mbo(BenchState& state, const std::string& mbo) {
+    std::vector<std::string> lines = mbo_lines(mbo, 1024);
+    size_t i = 0;
+    size_t total = 0;
+    while (state.keep_running()) {
+        MboRow row = parse_line_to_mbo(lines[i++ & 1023]);
+        total += row.price.size();
+    }
+    do_not_optimize(total);
+    state.set_items_processed(state.iterations());
+}
+
+static void bm_parse_mbo_record(BenchState& state, const std::string& mbo) {
+    std::vector<std::string> lines = mbo_lines(mbo, 1024);
+    size_t i = 0;
+    MboRecord record;
+    while (state.keep_running()) {
+        const std::string& line = lines[i++ & 1023];
+        parse_mbo_record(line.data(), line.data() + line.size(), record);
+        do_not_optimize(record.price);
+    }
+    state.set_items_processed(state.iterations());
+}
+
+// ---------------------------------------------------------------------------
+// end to end: whole input to rows written to /dev/null, items are rows
+
+struct CountingFormatterSink : FormatterSink {
+    uint64_t rows = 0;
+    using FormatterSink::FormatterSink;
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        FormatterSink::write_row(record, book, rowIndex, is_trade, depth);
+        rows++;
+    }
+};
+
+struct CountingCsvWriter : MbpCsvWriter {
+    uint64_t rows = 0;
+    using MbpCsvWriter::MbpCsvWriter;
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        MbpCsvWriter::write_row(record, book, rowIndex, is_trade, depth);
+        rows++;
+    }
+};
+
+static void bm_end_to_end_reference(BenchState& state, const std::string& mbo, const char* output) {
+    uint64_t rows = 0;
+    while (state.keep_running()) {
+        std::ofstream outFile(output);
+        write_mbp_header(outFile);
+        CountingFormatterSink sink(outFile);
+        Reconstructor<OrderBook, CountingFormatterSink> reconstructor(sink);
+        MboReader reader(mbo.data(), mbo.data() + mbo.size());
+        reader.skip_header();
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+        rows += sink.rows;
+    }
+    state.set_items_processed(rows);
+}
+
+template <typename Book>
+static void bm_end_to_end_fast(BenchState& state, const std::string& mbo, const char* output) {
+    uint64_t rows = 0;
+    while (state.keep_running()) {
+        OutputBuffer out;
+        out.open(output);
+        CountingCsvWriter writer(out);
+        writer.write_header();
+        Reconstructor<Book, CountingCsvWriter> reconstructor(writer);
+        MboReader reader(mbo.data(), mbo.data() + mbo.size());
+        reader.skip_header();
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+        out.close();
+        rows += writer.rows;
+    }
+    state.set_items_processed(rows);
+}
+
+static void register_benchmarks(const std::string& mbo) {
+    static std::string deep = synthetic_deep_book(1000, 4, 20000);
+    static std::string cancels = synthetic_high_cancel(50000, 0.9);
+
+    for (int depth : {10, 100, 1000}) {
+        std::string d = "/" + std::to_string(depth);
+        add_benchmark("OrderBook_AddCancel" + d, [depth](BenchState& s) { bm_add_cancel(s, OrderBook(), depth); });
+        add_benchmark("LadderBook_AddCancel" + d, [depth](BenchState& s) { bm_add_cancel(s, LadderBook(), depth); });
+        add_benchmark("OrderBook_CalculateDepth" + d, [depth](BenchState& s) { bm_calculate_depth(s, OrderBook(), depth); });
+        add_benchmark("LadderBook_CalculateDepth" + d, [depth](BenchState& s) { bm_calculate_depth(s, LadderBook(), depth); });
+        add_benchmark("OrderBook_Top10Snapshot" + d, [depth](BenchState& s) { bm_snapshot(s, OrderBook(), depth); });
+        add_benchmark("LadderBook_Top10Snapshot" + d, [depth](BenchState& s) { bm_snapshot(s, LadderBook(), depth); });
+    }
+    add_benchmark("OrderBook_CalculateDepthString/10", [](BenchState& s) { bm_calculate_depth_string(s, 10); });
+    add_benchmark("SnapshotChanged_Strings", [](BenchState& s) { bm_snapshot_changed_strings(s); });
+    for (int level = SIMD_SCALAR; level <= supported_simd_level(); ++level) {
+        SimdLevel simd = static_cast<SimdLevel>(level);
+        std::string name = std::string("/") + simd_level_name(simd);
+        add_benchmark("DepthKernel" + name, [simd](BenchState& s) { bm_depth_kernel(s, simd); });
+        add_benchmark("SnapshotChanged_Kernel" + name, [simd](BenchState& s) { bm_snapshot_changed_kernel(s, simd); });
+    }
+    add_benchmark("MBPFormatter_GenerateMbpRow", [&mbo](BenchState& s) { bm_generate_mbp_row(s, mbo); });
+    add_benchmark("ParseLineToMbo", [&mbo](BenchState& s) { bm_parse_line_to_mbo(s, mbo); });
+    add_benchmark("ParseMboRecord", [&mbo](BenchState& s) { bm_parse_mbo_record(s, mbo); });
+
+    struct Input {
+        const char* name;
+        const std::string* csv;
+    };
+    struct Path {
+        const char* name;
+        const char* book;
+        void (*run)(BenchState&, const std::string&, const char*);
+    };
+    for (const Input& input : {Input{"mbo.csv", &mbo}, Input{"deep_book", &deep}, Input{"high_cancel", &cancels}}) {
+        const std::string* csv = input.csv;
+        std::string suffix = std::string("/") + input.name;
+        for (const Path& path : {Path{"Map", "map", bm_end_to_end_reference},
+                                 Path{"Ladder", "ladder", bm_end_to_end_fast<LadderBook>},
+                                 Path{"L3", "l3", bm_end_to_end_fast<L3Book>}}) {
+            auto run = path.run;
+            std::string name = std::string("EndToEnd_") + path.name + suffix;
+            add_benchmark(name, [csv, run](BenchState& s) { run(s, *csv, "/dev/null"); });
+            if (csv == &mbo) {
+                output_checks().push_back(OutputCheck{name, path.book, [csv, run](const char* output) {
+                    BenchState once(1);
+                    run(once, *csv, output);
+                }});
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// runner
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;
+    double mean_ns, median_ns, stddev_ns, min_ns;
+    double items_per_second;
+};
+
+static BenchResult run_benchmark(const Benchmark& benchmark) {
+    // grow the iteration count until one run takes MIN_RUN_TIME
+    uint64_t iterations = 1;
+    while (true) {
+        BenchState state(iterations);
+        benchmark.run(state);
+        double seconds = state.seconds();
+        if (seconds >= MIN_RUN_TIME || iterations >= (1ULL << 40)) {
+            break;
+        }
+        double scale = (seconds <= 0) ? 100.0 : std::min(100.0, 1.4 * MIN_RUN_TIME / seconds);
+        iterations = std::max(iterations + 1, static_cast<uint64_t>(static_cast<double>(iterations) * scale));
+    }
+
+    std::vector<double> per_iteration;
+    std::vector<double> items_per_second;
+    for (int r = 0; r < REPETITIONS; ++r) {
+        BenchState state(iterations);
+        benchmark.run(state);
+        per_iteration.push_back(state.seconds() * 1e9 / static_cast<double>(iterations));
+        items_per_second.push_back(static_cast<double>(state.items()) / state.seconds());
+    }
+
+    BenchResult result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    double sum = 0;
+    for (double v : per_iteration) sum += v;
+    result.mean_ns = sum / REPETITIONS;
+    double var = 0;
+    for (double v : per_iteration) var += (v - result.mean_ns) * (v - result.mean_ns);
+    result.stddev_ns = std::sqrt(var / (REPETITIONS - 1));
+    std::vector<double> sorted = per_iteration;
+    std::sort(sorted.begin(), sorted.end());
+    result.median_ns = sorted[REPETITIONS / 2];
+    result.min_ns = sorted.front();
+    std::sort(items_per_second.begin(), items_per_second.end());
+    result.items_per_second = items_per_second[REPETITIONS / 2];
+    return result;
+}
+
+struct CheckResult {
+    std::string name;
+    uint64_t rows;
+    bool diverged;
+    std::string divergence;
+};
+
+static constexpr const char* CHECK_OUTPUT_PATH = "bench_verify.csv";
+
+// writes each checked path's output once and diffs it against reference
+static bool run_output_checks(const std::string& filter, const std::string& reference, const VerifyOptions& options,
+                              std::vector<CheckResult>& results) {
+    std::set<std::string> printed_books;
+    for (const OutputCheck& check : output_checks()) {
+        if (!filter.empty() && check.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        check.write(CHECK_OUTPUT_PATH);
+        std::string path = reference;
+        size_t book = path.find("{book}");
+        if (book != std::string::npos) {
+            path.replace(book, 6, check.book);
+        }
+        VerifyResult verify;
+        std::string error;
+        if (!verify_mbp_csv(CHECK_OUTPUT_PATH, path, options, verify, error)) {
+            std::cerr << error << std::endl;
+            return false;
+        }
+        CheckResult r{check.name, verify.rows, verify.diverged,
+                      verify.diverged ? describe_divergence(verify.first) : std::string()};
+        std::printf("%-40s %s\n", r.name.c_str(),
+                    r.diverged ? ("DIVERGES at " + r.divergence).c_str()
+                               : ("ok, " + std::to_string(r.rows) + " rows").c_str());
+        // show each book type's state once
+        if (r.diverged && printed_books.insert(check.book).second) {
+            print_divergence_book("mbo.csv", verify.first, check.book);
+        }
+        std::fflush(stdout);
+        results.push_back(r);
+    }
+    std::remove(CHECK_OUTPUT_PATH);
+    return true;
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static bool write_json(const char* path, const std::string& label, const std::vector<BenchResult>& results,
+                       const std::vector<CheckResult>& checks) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        return false;
+    }
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << std::fixed << std::setprecision(1);
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"host\": \"" << json_escape(host) << "\",\n"
+        << "    \"label\": \"" << json_escape(label) << "\",\n"
+        << "    \"repetitions\": " << REPETITIONS << ",\n"
+        << "    \"min_run_time_s\": " << MIN_RUN_TIME << "\n  },\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << json_escape(r.name) << "\", \"iterations\": " << r.iterations
+            << ", \"mean_ns\": " << r.mean_ns << ", \"median_ns\": " << r.median_ns
+            << ", \"stddev_ns\": " << r.stddev_ns << ", \"min_ns\": " << r.min_ns
+            << ", \"items_per_second\": " << r.items_per_second << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ],\n  \"verify\": [\n";
+    for (size_t i = 0; i < checks.size(); ++i) {
+        const CheckResult& c = checks[i];
+        out << "    {\"name\": \"" << json_escape(c.name) << "\", \"rows\": " << c.rows
+            << ", \"diverged\": " << (c.diverged ? "true" : "false")
+            << ", \"divergence\": \"" << json_escape(c.divergence) << "\"}"
+            << (i + 1 < checks.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.good();
+}
+
+int main(int argc, char* argv[]) {
+    const char* json_path = nullptr;
+    std::string filter;
+    std::string label;
+    std::string reference = "mbp_golden_{book}.csv";
+    VerifyOptions verify_options;
+    bool verify = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else if (std::strncmp(argv[i], "--label=", 8) == 0) {
+            label = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--verify=", 9) == 0) {
+            reference = argv[i] + 9;
+        } else if (std::strcmp(argv[i], "--verify-skip-deep") == 0) {
+            verify_options.skip_deep = true;
+        } else if (std::strcmp(argv[i], "--no-verify") == 0) {
+            verify = false;
+        } else {
+            std::cerr << "usage: benchmarks [--json=FILE] [--filter=TEXT] [--label=TEXT] [--verify=PATH]"
+                         " [--verify-skip-deep] [--no-verify]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string mbo = read_whole_file("mbo.csv");
+    if (mbo.empty()) {
+        std::cerr << "Error opening mbo.csv" << std::endl;
+        return 1;
+    }
+    register_benchmarks(mbo);
+
+    std::vector<BenchResult> results;
+    std::printf("%-40s %14s %12s %10s %14s\n", "benchmark", "median ns", "stddev ns", "iters", "items/s");
+    for (const Benchmark& benchmark : registry()) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        BenchResult r = run_benchmark(benchmark);
+        std::printf("%-40s %14.1f %12.1f %10llu %14.0f\n", r.name.c_str(), r.median_ns, r.stddev_ns,
+                    static_cast<unsigned long long>(r.iterations), r.items_per_second);
+        std::fflush(stdout);
+        results.push_back(r);
+    }
+
+    std::vector<CheckResult> checks;
+    if (verify) {
+        std::printf("\noutput against %s\n", reference.c_str());
+        if (!run_output_checks(filter, reference, verify_options, checks)) {
+            return 1;
+        }
+    }
+
+    if (json_path != nullptr && !write_json(json_path, label, results, checks)) {
+        std::cerr << "Error writing " << json_path << std::endl;
+        return 1;
+    }
+    for (const CheckResult& c : checks) {
+        if (c.diverged) {
+            return 1;
+        }
+    }
+    return 0;
+}
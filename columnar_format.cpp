@@ -0,0 +1,392 @@
+#include "columnar_format.h"
+#include "instrumentation.h"
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+
+bool is_columnar_file(const char* data, size_t size) {
+    return size >= sizeof(ColumnarFileHeader) && std::memcmp(data, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) == 0;
+}
+
+static void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static bool get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+// UNDEF_PRICE passes through the scaling untouched
+static int64_t scale_down(int64_t v, int64_t scale) { return v == UNDEF_PRICE ? v : v / scale; }
+static int64_t scale_up(int64_t q, int64_t scale) { return q == UNDEF_PRICE ? q : q * scale; }
+
+static int64_t common_scale(const std::vector<int64_t>& values, size_t n) {
+    uint64_t g = 0;
+    for (size_t i = 0; i < n && g != 1; ++i) {
+        if (values[i] != UNDEF_PRICE && values[i] != INT64_MIN) {
+            g = std::gcd(g, static_cast<uint64_t>(values[i] < 0 ? -values[i] : values[i]));
+        }
+    }
+    return g == 0 ? 1 : static_cast<int64_t>(g);
+}
+
+// deltas wrap around in uint64 so UNDEF_PRICE next to a real price still round-trips
+static int64_t wrapped_delta(int64_t cur, int64_t prev) {
+    return static_cast<int64_t>(static_cast<uint64_t>(cur) - static_cast<uint64_t>(prev));
+}
+
+static void encode_rle(const std::vector<int64_t>& values, size_t n, std::string& out) {
+    for (size_t i = 0; i < n;) {
+        size_t run = 1;
+        while (i + run < n && values[i + run] == values[i]) {
+            run++;
+        }
+        put_varint(out, zigzag(values[i]));
+        put_varint(out, run);
+        i += run;
+    }
+}
+
+static void encode_delta(const std::vector<int64_t>& values, size_t n, int64_t scale, std::string& out) {
+    put_varint(out, static_cast<uint64_t>(scale));
+    int64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int64_t q = scale_down(values[i], scale);
+        put_varint(out, zigzag(wrapped_delta(q, prev)));
+        prev = q;
+    }
+}
+
+static void encode_sparse(const std::vector<int64_t>& values, size_t n, int64_t scale, std::string& out) {
+    put_varint(out, static_cast<uint64_t>(scale));
+    size_t bitmap = out.size();
+    out.append((n + 7) / 8, '\0');
+    int64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (i == 0 || values[i] != values[i - 1]) {
+            out[bitmap + i / 8] = static_cast<char>(out[bitmap + i / 8] | (1 << (i % 8)));
+            int64_t q = scale_down(values[i], scale);
+            put_varint(out, zigzag(wrapped_delta(q, prev)));
+            prev = q;
+        }
+    }
+}
+
+// picks the smallest encoding for one column and appends it to out
+static ColumnarEncoding encode_column(const std::vector<int64_t>& values, size_t n, std::string& out,
+                                      std::string& scratch) {
+    bool constant = true;
+    for (size_t i = 1; i < n && constant; ++i) {
+        constant = values[i] == values[0];
+    }
+    if (constant) {
+        put_varint(out, zigzag(values[0]));
+        return ENCODING_CONST;
+    }
+    int64_t scale = common_scale(values, n);
+    ColumnarEncoding best = ENCODING_RLE;
+    size_t start = out.size();
+    encode_rle(values, n, out);
+    ColumnarEncoding candidates[2] = {ENCODING_DELTA, ENCODING_SPARSE};
+    for (ColumnarEncoding candidate : candidates) {
+        scratch.clear();
+        if (candidate == ENCODING_DELTA) {
+            encode_delta(values, n, scale, scratch);
+        } else {
+            encode_sparse(values, n, scale, scratch);
+        }
+        if (scratch.size() < out.size() - start) {
+            out.resize(start);
+            out += scratch;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+static bool decode_payload(ColumnarEncoding encoding, const char* p, const char* end, uint32_t n,
+                           std::vector<int64_t>& out) {
+    out.resize(n);
+    uint64_t v;
+    switch (encoding) {
+    case ENCODING_CONST:
+        if (!get_varint(p, end, v)) return false;
+        std::fill(out.begin(), out.end(), unzigzag(v));
+        return true;
+    case ENCODING_RLE:
+        for (uint32_t i = 0; i < n;) {
+            uint64_t run;
+            if (!get_varint(p, end, v) || !get_varint(p, end, run) || run == 0 || run > n - i) return false;
+            std::fill(out.begin() + i, out.begin() + i + run, unzigzag(v));
+            i += static_cast<uint32_t>(run);
+        }
+        return true;
+    case ENCODING_DELTA:
+    case ENCODING_SPARSE: {
+        uint64_t scale;
+        if (!get_varint(p, end, scale) || scale == 0) return false;
+        const char* bitmap = p;
+        if (encoding == ENCODING_SPARSE) {
+            if (static_cast<size_t>(end - p) < (n + 7) / 8) return false;
+            p += (n + 7) / 8;
+        }
+        int64_t q = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            bool changed = encoding == ENCODING_DELTA || ((bitmap[i / 8] >> (i % 8)) & 1);
+            if (changed) {
+                if (!get_varint(p, end, v)) return false;
+                q = static_cast<int64_t>(static_cast<uint64_t>(q) + static_cast<uint64_t>(unzigzag(v)));
+                out[i] = scale_up(q, static_cast<int64_t>(scale));
+            } else {
+                if (i == 0) return false;
+                out[i] = out[i - 1];
+            }
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+MbpColumnarWriter::MbpColumnarWriter(OutputBuffer& out, uint32_t batch_rows)
+    : out_(out), batch_rows_(batch_rows == 0 ? DEFAULT_BATCH_ROWS : batch_rows) {
+    for (auto& column : columns_) {
+        column.resize(batch_rows_);
+    }
+}
+
+void MbpColumnarWriter::write_header() {
+    ColumnarFileHeader header = {};
+    std::memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+    header.version = COLUMNAR_VERSION;
+    header.column_count = COLUMNAR_COLUMNS;
+    header.batch_rows = batch_rows_;
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    stats_.bytes += sizeof(header);
+}
+
+// symbols change rarely within a batch, so check the last one first
+uint32_t MbpColumnarWriter::symbol_index(std::string_view symbol) {
+    if (!symbols_.empty() && symbols_.back() == symbol) {
+        return static_cast<uint32_t>(symbols_.size() - 1);
+    }
+    for (size_t i = 0; i < symbols_.size(); ++i) {
+        if (symbols_[i] == symbol) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    symbols_.emplace_back(symbol);
+    return static_cast<uint32_t>(symbols_.size() - 1);
+}
+
+void MbpColumnarWriter::write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+    OFA_STAGE(STAGE_FORMAT);
+    Mbp10BinaryRecord packed;
+    to_binary(record, book, rowIndex, is_trade, depth, packed);
+    append(packed, record.text(MBO_SYMBOL));
+}
+
+void MbpColumnarWriter::append(const Mbp10BinaryRecord& record, std::string_view symbol) {
+    uint32_t r = rows_;
+    columns_[COL_ROW_INDEX][r] = record.row_index;
+    columns_[COL_TS_EVENT][r] = static_cast<int64_t>(record.hd.ts_event);
+    columns_[COL_TS_RECV][r] = static_cast<int64_t>(record.ts_recv - record.hd.ts_event);
+    columns_[COL_RTYPE][r] = record.hd.rtype;
+    columns_[COL_PUBLISHER_ID][r] = record.hd.publisher_id;
+    columns_[COL_INSTRUMENT_ID][r] = record.hd.instrument_id;
+    columns_[COL_ACTION][r] = record.action;
+    columns_[COL_SIDE][r] = record.side;
+    columns_[COL_DEPTH][r] = record.depth;
+    columns_[COL_PRICE][r] = record.price;
+    columns_[COL_SIZE][r] = record.size;
+    columns_[COL_FLAGS][r] = record.flags;
+    columns_[COL_TS_IN_DELTA][r] = record.ts_in_delta;
+    columns_[COL_SEQUENCE][r] = record.sequence;
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        const BidAskPair& level = record.levels[i];
+        int c = COL_LEVELS + 6 * i;
+        columns_[c][r] = level.bid_px;
+        columns_[c + 1][r] = level.bid_sz;
+        columns_[c + 2][r] = level.bid_ct;
+        columns_[c + 3][r] = level.ask_px;
+        columns_[c + 4][r] = level.ask_sz;
+        columns_[c + 5][r] = level.ask_ct;
+    }
+    columns_[COL_SYMBOL][r] = symbol_index(symbol);
+    columns_[COL_ORDER_ID][r] = static_cast<int64_t>(record.order_id);
+    stats_.rows++;
+    if (++rows_ == batch_rows_) {
+        flush_batch();
+    }
+}
+
+void MbpColumnarWriter::flush_batch() {
+    if (rows_ == 0) {
+        return;
+    }
+    batch_.clear();
+    put_varint(batch_, symbols_.size());
+    for (const std::string& symbol : symbols_) {
+        put_varint(batch_, symbol.size());
+        batch_ += symbol;
+    }
+    size_t directory = batch_.size();
+    batch_.append(COLUMNAR_COLUMNS * sizeof(ColumnarColumnEntry), '\0');
+    payload_.clear();
+    for (int c = 0; c < COLUMNAR_COLUMNS; ++c) {
+        size_t start = payload_.size();
+        ColumnarColumnEntry entry = {};
+        entry.encoding = encode_column(columns_[c], rows_, payload_, scratch_);
+        entry.bytes = static_cast<uint32_t>(payload_.size() - start);
+        std::memcpy(&batch_[directory + c * sizeof(entry)], &entry, sizeof(entry));
+        if (entry.encoding == ENCODING_CONST) {
+            stats_.skipped_columns++;
+        }
+    }
+    ColumnarBatchHeader header = {rows_, static_cast<uint32_t>(batch_.size() + payload_.size())};
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    out_.append(batch_);
+    out_.append(payload_);
+    stats_.bytes += sizeof(header) + header.bytes;
+    stats_.batches++;
+    rows_ = 0;
+    symbols_.clear();
+}
+
+bool MbpColumnarWriter::finish() {
+    flush_batch();
+    return out_.close();
+}
+
+bool MbpColumnarReader::open(const char* data, size_t size) {
+    if (!is_columnar_file(data, size)) {
+        return false;
+    }
+    std::memcpy(&header_, data, sizeof(header_));
+    if (header_.version != COLUMNAR_VERSION || header_.column_count != COLUMNAR_COLUMNS) {
+        return false;
+    }
+    data_ = data;
+    size_ = size;
+    next_ = sizeof(header_);
+    rows_ = 0;
+    return true;
+}
+
+bool MbpColumnarReader::next_batch() {
+    ColumnarBatchHeader header;
+    if (size_ - next_ < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data_ + next_, sizeof(header));
+    const char* p = data_ + next_ + sizeof(header);
+    if (static_cast<size_t>(data_ + size_ - p) < header.bytes || header.rows == 0) {
+        return false;
+    }
+    const char* end = p + header.bytes;
+
+    uint64_t count, length;
+    symbols_.clear();
+    if (!get_varint(p, end, count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!get_varint(p, end, length) || static_cast<uint64_t>(end - p) < length) {
+            return false;
+        }
+        symbols_.emplace_back(p, static_cast<size_t>(length));
+        p += length;
+    }
+    if (static_cast<size_t>(end - p) < COLUMNAR_COLUMNS * sizeof(ColumnarColumnEntry)) {
+        return false;
+    }
+    entries_ = reinterpret_cast<const ColumnarColumnEntry*>(p);
+    payloads_ = p + COLUMNAR_COLUMNS * sizeof(ColumnarColumnEntry);
+    offsets_.assign(COLUMNAR_COLUMNS + 1, 0);
+    for (int c = 0; c < COLUMNAR_COLUMNS; ++c) {
+        ColumnarColumnEntry entry;
+        std::memcpy(&entry, entries_ + c, sizeof(entry));
+        offsets_[c + 1] = offsets_[c] + entry.bytes;
+    }
+    if (static_cast<size_t>(end - payloads_) != offsets_[COLUMNAR_COLUMNS]) {
+        return false;
+    }
+    rows_ = header.rows;
+    next_ = static_cast<size_t>(end - data_);
+    return true;
+}
+
+bool MbpColumnarReader::decode_column(int column, std::vector<int64_t>& out) const {
+    if (column < 0 || column >= COLUMNAR_COLUMNS || rows_ == 0) {
+        return false;
+    }
+    const char* begin = payloads_ + offsets_[column];
+    const char* end = payloads_ + offsets_[column + 1];
+    return decode_payload(encoding(column), begin, end, rows_, out);
+}
+
+bool MbpColumnarReader::decode_rows(std::vector<Mbp10BinaryRecord>& rows, std::vector<uint32_t>& symbols) {
+    for (int c = 0; c < COLUMNAR_COLUMNS; ++c) {
+        if (!decode_column(c, values_[c])) {
+            return false;
+        }
+    }
+    rows.resize(rows_);
+    symbols.resize(rows_);
+    for (uint32_t r = 0; r < rows_; ++r) {
+        Mbp10BinaryRecord& out = rows[r];
+        out = Mbp10BinaryRecord();
+        out.hd.length = sizeof(Mbp10BinaryRecord) / 4;
+        out.hd.rtype = static_cast<uint8_t>(values_[COL_RTYPE][r]);
+        out.hd.publisher_id = static_cast<uint16_t>(values_[COL_PUBLISHER_ID][r]);
+        out.hd.instrument_id = static_cast<uint32_t>(values_[COL_INSTRUMENT_ID][r]);
+        out.hd.ts_event = static_cast<uint64_t>(values_[COL_TS_EVENT][r]);
+        out.ts_recv = out.hd.ts_event + static_cast<uint64_t>(values_[COL_TS_RECV][r]);
+        out.action = static_cast<char>(values_[COL_ACTION][r]);
+        out.side = static_cast<char>(values_[COL_SIDE][r]);
+        out.depth = static_cast<uint8_t>(values_[COL_DEPTH][r]);
+        out.price = values_[COL_PRICE][r];
+        out.size = static_cast<uint32_t>(values_[COL_SIZE][r]);
+        out.flags = static_cast<uint8_t>(values_[COL_FLAGS][r]);
+        out.ts_in_delta = static_cast<int32_t>(values_[COL_TS_IN_DELTA][r]);
+        out.sequence = static_cast<uint32_t>(values_[COL_SEQUENCE][r]);
+        for (int i = 0; i < TOP_LEVELS; ++i) {
+            BidAskPair& level = out.levels[i];
+            int c = COL_LEVELS + 6 * i;
+            level.bid_px = values_[c][r];
+            level.bid_sz = static_cast<uint32_t>(values_[c + 1][r]);
+            level.bid_ct = static_cast<uint32_t>(values_[c + 2][r]);
+            level.ask_px = values_[c + 3][r];
+            level.ask_sz = static_cast<uint32_t>(values_[c + 4][r]);
+            level.ask_ct = static_cast<uint32_t>(values_[c + 5][r]);
+        }
+        out.order_id = static_cast<uint64_t>(values_[COL_ORDER_ID][r]);
+        out.row_index = static_cast<uint32_t>(values_[COL_ROW_INDEX][r]);
+        uint64_t symbol = static_cast<uint64_t>(values_[COL_SYMBOL][r]);
+        if (symbol >= symbols_.size()) {
+            return false;
+        }
+        symbols[r] = static_cast<uint32_t>(symbol);
+    }
+    return true;
+}
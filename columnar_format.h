@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "dbn_format.h"
+
+// Columnar MBP-10 files: rows are grouped into record batches and every
+// column of a batch is encoded on its own, so a reader can decode just the
+// columns it needs and skip the rest by their byte length.
+//
+// File layout: ColumnarFileHeader, then batches. A batch is a
+// ColumnarBatchHeader, the batch's symbol dictionary (count, then length +
+// bytes per entry, all varints), one ColumnarColumnEntry per column, then the
+// column payloads in column order. Every batch decodes on its own.
+//
+// All columns are int64 values (see ColumnarColumn) and each one is written
+// with whichever of these is smallest for the batch:
+//   CONST   one value for the whole batch (a skipped column)
+//   RLE     (value, run length) pairs, for dictionary indices and flags
+//   DELTA   a scale (gcd of the values), then per row the zigzag delta of value / scale
+//   SPARSE  the same scale, a bitmap of rows where the value changed, then
+//           deltas for those rows only; book levels that did not move cost one bit
+// Values are varints. UNDEF_PRICE is kept as is through the scaling.
+
+static constexpr char COLUMNAR_MAGIC[4] = {'O', 'F', 'A', 'M'};
+static constexpr uint16_t COLUMNAR_VERSION = 1;
+static constexpr uint32_t DEFAULT_BATCH_ROWS = 4096;
+
+enum ColumnarEncoding : uint8_t {
+    ENCODING_CONST = 0,
+    ENCODING_RLE = 1,
+    ENCODING_DELTA = 2,
+    ENCODING_SPARSE = 3,
+};
+
+// Column order of the file, which is the mbp csv order. ts_recv is stored as
+// its difference from ts_event and symbol as an index into the batch dictionary.
+enum ColumnarColumn {
+    COL_ROW_INDEX,
+    COL_TS_EVENT,
+    COL_TS_RECV,
+    COL_RTYPE,
+    COL_PUBLISHER_ID,
+    COL_INSTRUMENT_ID,
+    COL_ACTION,
+    COL_SIDE,
+    COL_DEPTH,
+    COL_PRICE,
+    COL_SIZE,
+    COL_FLAGS,
+    COL_TS_IN_DELTA,
+    COL_SEQUENCE,
+    COL_LEVELS,                                     // bid_px, bid_sz, bid_ct, ask_px, ask_sz, ask_ct per level
+    COL_SYMBOL = COL_LEVELS + 6 * TOP_LEVELS,
+    COL_ORDER_ID,
+    COLUMNAR_COLUMNS
+};
+
+struct ColumnarFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t column_count;
+    uint32_t batch_rows;        // rows per batch, the last one may be shorter
+    uint32_t reserved;
+};
+static_assert(sizeof(ColumnarFileHeader) == 16, "ColumnarFileHeader layout");
+
+struct ColumnarBatchHeader {
+    uint32_t rows;
+    uint32_t bytes;             // everything after this header up to the next batch
+};
+static_assert(sizeof(ColumnarBatchHeader) == 8, "ColumnarBatchHeader layout");
+
+struct ColumnarColumnEntry {
+    uint8_t encoding;
+    uint8_t reserved[3];
+    uint32_t bytes;
+};
+static_assert(sizeof(ColumnarColumnEntry) == 8, "ColumnarColumnEntry layout");
+
+bool is_columnar_file(const char* data, size_t size);
+
+struct ColumnarStats {
+    uint64_t rows = 0;
+    uint64_t batches = 0;
+    uint64_t bytes = 0;
+    uint64_t skipped_columns = 0;   // batch columns written as CONST
+};
+
+// Same write_row interface as MbpCsvWriter / MbpBinaryWriter.
+class MbpColumnarWriter {
+private:
+    OutputBuffer& out_;
+    uint32_t batch_rows_;
+    uint32_t rows_ = 0;
+    std::vector<int64_t> columns_[COLUMNAR_COLUMNS];
+    std::vector<std::string> symbols_;
+    std::string batch_;
+    std::string payload_;
+    std::string scratch_;
+    ColumnarStats stats_;
+
+    uint32_t symbol_index(std::string_view symbol);
+    void flush_batch();
+
+public:
+    explicit MbpColumnarWriter(OutputBuffer& out, uint32_t batch_rows = DEFAULT_BATCH_ROWS);
+
+    void write_header();
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth);
+    void write_row(const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        write_row(record, book.levels, rowIndex, is_trade, depth);
+    }
+    void append(const Mbp10BinaryRecord& record, std::string_view symbol);
+    // writes the last batch and closes the buffer
+    bool finish();
+
+    const ColumnarStats& stats() const { return stats_; }
+};
+
+// Walks the batches of a columnar file held in memory.
+class MbpColumnarReader {
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    ColumnarFileHeader header_ = {};
+    size_t next_ = 0;
+    uint32_t rows_ = 0;
+    std::vector<std::string_view> symbols_;
+    const ColumnarColumnEntry* entries_ = nullptr;
+    const char* payloads_ = nullptr;
+    std::vector<size_t> offsets_;
+    std::vector<int64_t> values_[COLUMNAR_COLUMNS];
+
+public:
+    bool open(const char* data, size_t size);
+    // moves to the next batch; false at the end or on a malformed batch (see failed())
+    bool next_batch();
+    bool failed() const { return next_ != size_; }
+
+    uint32_t batch_rows() const { return rows_; }
+    const std::vector<std::string_view>& symbols() const { return symbols_; }
+    ColumnarEncoding encoding(int column) const { return static_cast<ColumnarEncoding>(entries_[column].encoding); }
+    // decodes one column of the current batch, leaving the others untouched
+    bool decode_column(int column, std::vector<int64_t>& out) const;
+    // whole rows of the current batch; symbols index symbols()
+    bool decode_rows(std::vector<Mbp10BinaryRecord>& rows, std::vector<uint32_t>& symbols);
+};
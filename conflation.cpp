@@ -0,0 +1,62 @@
+#include "conflation.h"
+#include "order_book.h"
+#include "simd_kernels.h"
+
+void ConflatingCsvWriter::write_header() {
+    std::string header = mbp_header_line();
+    header.insert(header.size() - 1, ",conflated");
+    out_.append(header);
+}
+
+bool ConflatingCsvWriter::due(const LadderBook& book) const {
+    if (options_.every > 0 && pending_ < options_.every) {
+        return false;
+    }
+    if (!written_) {
+        return true;
+    }
+    if (options_.interval_ns > 0 && record_.ts_event - last_ts_ < options_.interval_ns) {
+        return false;
+    }
+    if (options_.on_change && top_levels_equal(book.bids.top(), last_bids_) &&
+        top_levels_equal(book.asks.top(), last_asks_)) {
+        return false;
+    }
+    return true;
+}
+
+void ConflatingCsvWriter::emit(const LadderBook& book) {
+    char* p = out_.reserve(MbpRowRenderer::max_row_size(record_) + 32);
+    p = renderer_.render(p, record_, book, row_index_, is_trade_, depth_);
+    p[-1] = ',';
+    p = uint_to_chars(p, pending_);
+    *p++ = '\n';
+    out_.commit(p);
+
+    written_ = true;
+    last_ts_ = record_.ts_event;
+    if (options_.on_change) {
+        last_bids_ = book.bids.top();
+        last_asks_ = book.asks.top();
+    }
+    pending_ = 0;
+    stats_.rows++;
+}
+
+void ConflatingCsvWriter::write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+    record_ = record;
+    row_index_ = rowIndex;
+    is_trade_ = is_trade;
+    depth_ = depth;
+    pending_++;
+    stats_.updates++;
+    if (due(book)) {
+        emit(book);
+    }
+}
+
+void ConflatingCsvWriter::finish(const LadderBook& book) {
+    if (pending_ > 0) {
+        emit(book);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include "mbp_writer.h"
+
+struct ConflationOptions {
+    int64_t interval_ns = 0;    // at most one row per this much ts_event, 0 = no limit
+    uint64_t every = 0;         // at most one row per this many updates, 0 = no limit
+    bool on_change = false;     // only when the published top levels differ from the last row
+
+    bool enabled() const { return interval_ns > 0 || every > 0 || on_change; }
+};
+
+struct ConflationStats {
+    uint64_t updates = 0;       // rows the unconflated output would have
+    uint64_t rows = 0;          // rows written
+};
+
+// MBP-10 csv writer that holds rows back and writes the book as it stands
+// after the last held-back update, once every limit in the options allows
+// it. Each row ends with a "conflated" column: the number of updates it
+// stands for (1 = nothing was dropped). Skipped rows leave their dirty
+// levels marked in the book, so the next row re-renders just those.
+// finish() writes whatever is still held back.
+class ConflatingCsvWriter {
+private:
+    OutputBuffer& out_;
+    ConflationOptions options_;
+    MbpRowRenderer renderer_;
+    ConflationStats stats_;
+
+    // the latest update not written yet
+    MboRecord record_;
+    int row_index_ = 0;
+    bool is_trade_ = false;
+    int depth_ = 0;
+    uint64_t pending_ = 0;
+
+    bool written_ = false;
+    int64_t last_ts_ = 0;
+    TopLevels last_bids_;
+    TopLevels last_asks_;
+
+    bool due(const LadderBook& book) const;
+    void emit(const LadderBook& book);
+
+public:
+    ConflatingCsvWriter(OutputBuffer& out, const ConflationOptions& options) : out_(out), options_(options) {}
+
+    void write_header();
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth);
+    void write_row(const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        write_row(record, book.levels, rowIndex, is_trade, depth);
+    }
+    void finish(const LadderBook& book);
+    void finish(const L3Book& book) { finish(book.levels); }
+
+    const ConflationStats& stats() const { return stats_; }
+};
@@ -0,0 +1,219 @@
+#include "dbn_format.h"
+#include "columnar_format.h"
+#include "delta_format.h"
+#include "order_book.h"
+#include <iostream>
+
+// Converts between the csv files and the binary format in dbn_format.h.
+// The direction and schema come from the input: a binary file is written
+// back out as csv, an mbo or mbp csv (told apart by its header) as binary.
+// An output ending in .mbpc takes mbp rows (csv or binary) in the columnar
+// layout of columnar_format.h, and a columnar input is written out as csv.
+// A differential file (delta_format.h) is expanded back into the exact csv.
+//
+//   dbn_convert <input> <output>
+
+static const char* MBO_HEADER =
+    "ts_recv,ts_event,rtype,publisher_id,instrument_id,action,side,price,size,"
+    "channel_id,order_id,flags,ts_in_delta,sequence,symbol\n";
+
+static bool mbo_csv_to_binary(const MappedFile& in, OutputBuffer& out, uint64_t* count) {
+    DbnFileWriter writer(out, SCHEMA_MBO);
+    writer.begin();
+    MboReader reader(in);
+    reader.skip_header();
+    MboRecord record;
+    MboBinaryRecord packed;
+    while (reader.next(record)) {
+        writer.note_symbol(record.publisher_id, record.instrument_id, record.text(MBO_SYMBOL));
+        to_binary(record, packed);
+        writer.append(&packed);
+        (*count)++;
+    }
+    return writer.finish();
+}
+
+static bool mbp_csv_to_binary(const MappedFile& in, OutputBuffer& out, uint64_t* count) {
+    DbnFileWriter writer(out, SCHEMA_MBP10);
+    writer.begin();
+    const char* cur = in.data();
+    const char* end = in.data() + in.size();
+    const char* eol = find_newline(cur, end);
+    cur = (eol < end) ? eol + 1 : end;  // header
+    Mbp10BinaryRecord packed;
+    std::string_view symbol;
+    while (cur < end) {
+        eol = find_newline(cur, end);
+        const char* line = cur;
+        cur = (eol < end) ? eol + 1 : end;
+        if (eol == line) {
+            continue;
+        }
+        if (!parse_mbp_csv_row(line, eol, packed, symbol)) {
+            std::cerr << "malformed mbp row: " << std::string(line, eol) << std::endl;
+            return false;
+        }
+        writer.note_symbol(packed.hd.publisher_id, packed.hd.instrument_id, symbol);
+        writer.append(&packed);
+        (*count)++;
+    }
+    return writer.finish();
+}
+
+static bool mbo_binary_to_csv(const DbnFile& file, OutputBuffer& out, uint64_t* count) {
+    out.append(MBO_HEADER);
+    MboBinaryReader reader(file, true);
+    MboRecord record;
+    while (reader.next(record)) {
+        for (int i = 0; i < MBO_FIELD_COUNT; ++i) {
+            std::string_view field = record.raw[i];
+            char* p = out.reserve(field.size() + 1);
+            std::memcpy(p, field.data(), field.size());
+            p += field.size();
+            *p++ = (i + 1 < MBO_FIELD_COUNT) ? ',' : '\n';
+            out.commit(p);
+        }
+        (*count)++;
+    }
+    return out.close();
+}
+
+static bool mbp_binary_to_csv(const DbnFile& file, OutputBuffer& out, uint64_t* count) {
+    out.append(mbp_header_line());
+    const Mbp10BinaryRecord* records = file.mbp_records();
+    for (uint64_t i = 0; i < file.record_count(); ++i) {
+        const Mbp10BinaryRecord& record = records[i];
+        std::string_view symbol = file.symbol(record.hd.publisher_id, record.hd.instrument_id);
+        char* p = out.reserve(MBP_ROW_TEXT_MAX + symbol.size());
+        out.commit(render_mbp_csv_row(p, record, symbol));
+        (*count)++;
+    }
+    return out.close();
+}
+
+static bool mbp_to_columnar(const MappedFile& in, OutputBuffer& out, uint64_t* count) {
+    MbpColumnarWriter writer(out);
+    writer.write_header();
+    if (is_dbn_file(in.data(), in.size())) {
+        DbnFile file;
+        if (!file.open(in.data(), in.size()) || file.schema() != SCHEMA_MBP10) {
+            return false;
+        }
+        const Mbp10BinaryRecord* records = file.mbp_records();
+        for (uint64_t i = 0; i < file.record_count(); ++i) {
+            writer.append(records[i], file.symbol(records[i].hd.publisher_id, records[i].hd.instrument_id));
+            (*count)++;
+        }
+        return writer.finish();
+    }
+    const char* cur = in.data();
+    const char* end = in.data() + in.size();
+    const char* eol = find_newline(cur, end);
+    cur = (eol < end) ? eol + 1 : end;  // header
+    Mbp10BinaryRecord packed;
+    std::string_view symbol;
+    while (cur < end) {
+        eol = find_newline(cur, end);
+        const char* line = cur;
+        cur = (eol < end) ? eol + 1 : end;
+        if (eol == line) {
+            continue;
+        }
+        if (!parse_mbp_csv_row(line, eol, packed, symbol)) {
+            std::cerr << "malformed mbp row: " << std::string(line, eol) << std::endl;
+            return false;
+        }
+        writer.append(packed, symbol);
+        (*count)++;
+    }
+    return writer.finish();
+}
+
+static bool columnar_to_csv(const MappedFile& in, OutputBuffer& out, uint64_t* count) {
+    MbpColumnarReader reader;
+    if (!reader.open(in.data(), in.size())) {
+        return false;
+    }
+    out.append(mbp_header_line());
+    std::vector<Mbp10BinaryRecord> rows;
+    std::vector<uint32_t> symbols;
+    while (reader.next_batch()) {
+        if (!reader.decode_rows(rows, symbols)) {
+            return false;
+        }
+        for (size_t i = 0; i < rows.size(); ++i) {
+            std::string_view symbol = reader.symbols()[symbols[i]];
+            char* p = out.reserve(MBP_ROW_TEXT_MAX + symbol.size());
+            out.commit(render_mbp_csv_row(p, rows[i], symbol));
+            (*count)++;
+        }
+    }
+    return !reader.failed() && out.close();
+}
+
+static bool delta_to_csv(const MappedFile& in, OutputBuffer& out, uint64_t* count) {
+    MbpDeltaReader reader;
+    if (!reader.open(in.data(), in.size())) {
+        return false;
+    }
+    out.append(mbp_header_line());
+    Mbp10BinaryRecord row;
+    std::string_view symbol;
+    while (reader.next(row, symbol)) {
+        char* p = out.reserve(MBP_ROW_TEXT_MAX + symbol.size());
+        out.commit(render_mbp_csv_row(p, row, symbol));
+        (*count)++;
+    }
+    return !reader.failed() && out.close();
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: dbn_convert <input> <output>" << std::endl;
+        return 1;
+    }
+
+    MappedFile in;
+    if (!in.open(argv[1])) {
+        std::cerr << "Error opening " << argv[1] << std::endl;
+        return 1;
+    }
+    OutputBuffer out;
+    if (!out.open(argv[2])) {
+        std::cerr << "Error opening " << argv[2] << std::endl;
+        return 1;
+    }
+
+    uint64_t count = 0;
+    bool ok = false;
+    if (is_columnar_file(in.data(), in.size())) {
+        ok = columnar_to_csv(in, out, &count);
+    } else if (is_delta_file(in.data(), in.size())) {
+        ok = delta_to_csv(in, out, &count);
+    } else if (ends_with(argv[2], ".mbpc")) {
+        ok = mbp_to_columnar(in, out, &count);
+    } else if (is_dbn_file(in.data(), in.size())) {
+        DbnFile file;
+        if (!file.open(in.data(), in.size())) {
+            std::cerr << "corrupt binary file: " << argv[1] << std::endl;
+            return 1;
+        }
+        ok = (file.schema() == SCHEMA_MBO) ? mbo_binary_to_csv(file, out, &count)
+                                           : mbp_binary_to_csv(file, out, &count);
+    } else if (in.data()[0] == ',') {
+        // the mbp header starts with the unnamed row index column
+        ok = mbp_csv_to_binary(in, out, &count);
+    } else {
+        ok = mbo_csv_to_binary(in, out, &count);
+    }
+    if (!ok) {
+        std::cerr << "Error writing " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Converted " << count << " records" << std::endl;
+    return 0;
+}
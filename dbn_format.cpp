@@ -0,0 +1,335 @@
+#include "dbn_format.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <cstring>
+
+bool is_dbn_file(const char* data, size_t size) {
+    return size >= sizeof(DbnFileHeader) && std::memcmp(data, DBN_MAGIC, sizeof(DBN_MAGIC)) == 0;
+}
+
+static size_t schema_record_size(uint8_t schema) {
+    switch (schema) {
+    case SCHEMA_MBO:
+        return sizeof(MboBinaryRecord);
+    case SCHEMA_MBP10:
+        return sizeof(Mbp10BinaryRecord);
+    default:
+        return 0;
+    }
+}
+
+bool DbnFile::open(const char* data, size_t size) {
+    if (!is_dbn_file(data, size)) {
+        return false;
+    }
+    std::memcpy(&header_, data, sizeof(header_));
+    size_t record_size = schema_record_size(header_.schema);
+    if (header_.version != DBN_VERSION || record_size == 0 || header_.record_size != record_size) {
+        return false;
+    }
+    uint64_t records_end = sizeof(DbnFileHeader) + header_.record_count * record_size;
+    uint64_t symbols_end = header_.symbol_offset + uint64_t(header_.symbol_count) * sizeof(SymbolEntry);
+    if (records_end > size || header_.symbol_offset < records_end || symbols_end > size) {
+        return false;
+    }
+    records_ = data + sizeof(DbnFileHeader);
+    symbols_ = reinterpret_cast<const SymbolEntry*>(data + header_.symbol_offset);
+    return true;
+}
+
+std::string_view DbnFile::symbol(uint16_t publisher_id, uint32_t instrument_id) const {
+    // a handful of entries per file, a scan is fine
+    for (uint32_t i = 0; i < header_.symbol_count; ++i) {
+        const SymbolEntry& entry = symbols_[i];
+        if (entry.instrument_id == instrument_id && entry.publisher_id == publisher_id) {
+            return std::string_view(entry.symbol, strnlen(entry.symbol, sizeof(entry.symbol)));
+        }
+    }
+    return std::string_view();
+}
+
+DbnFileWriter::DbnFileWriter(OutputBuffer& out, DbnSchema schema) : out_(out), known_(16) {
+    std::memcpy(header_.magic, DBN_MAGIC, sizeof(DBN_MAGIC));
+    header_.version = DBN_VERSION;
+    header_.schema = schema;
+    header_.record_size = static_cast<uint16_t>(schema_record_size(schema));
+}
+
+void DbnFileWriter::begin() {
+    header_.record_count = 0;
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header_), sizeof(header_)));
+}
+
+void DbnFileWriter::note_symbol(uint16_t publisher_id, uint32_t instrument_id, std::string_view symbol) {
+    uint64_t key = (static_cast<uint64_t>(publisher_id) << 32) | instrument_id;
+    if (known_.find(key) != nullptr) {
+        return;
+    }
+    known_.insert(key, static_cast<uint32_t>(symbols_.size()));
+    SymbolEntry entry = {};
+    entry.instrument_id = instrument_id;
+    entry.publisher_id = publisher_id;
+    std::memcpy(entry.symbol, symbol.data(), std::min(symbol.size(), sizeof(entry.symbol)));
+    symbols_.push_back(entry);
+}
+
+bool DbnFileWriter::finish() {
+    header_.symbol_offset = sizeof(DbnFileHeader) + header_.record_count * header_.record_size;
+    header_.symbol_count = static_cast<uint32_t>(symbols_.size());
+    if (!symbols_.empty()) {
+        out_.append(std::string_view(reinterpret_cast<const char*>(symbols_.data()),
+                                     symbols_.size() * sizeof(SymbolEntry)));
+    }
+    bool ok = out_.write_at(0, &header_, sizeof(header_));
+    return out_.close() && ok;
+}
+
+void to_binary(const MboRecord& record, MboBinaryRecord& out) {
+    out.hd.length = sizeof(MboBinaryRecord) / 4;
+    out.hd.rtype = record.rtype;
+    out.hd.publisher_id = record.publisher_id;
+    out.hd.instrument_id = record.instrument_id;
+    out.hd.ts_event = static_cast<uint64_t>(record.ts_event);
+    out.order_id = record.order_id;
+    out.price = record.price;
+    out.size = static_cast<uint32_t>(record.size);
+    out.flags = record.flags;
+    out.channel_id = record.channel_id;
+    out.action = record.action;
+    out.side = record.side;
+    out.ts_recv = static_cast<uint64_t>(record.ts_recv);
+    out.ts_in_delta = record.ts_in_delta;
+    out.sequence = record.sequence;
+}
+
+void from_binary(const MboBinaryRecord& in, MboRecord& record) {
+    record.ts_recv = static_cast<int64_t>(in.ts_recv);
+    record.ts_event = static_cast<int64_t>(in.hd.ts_event);
+    record.price = in.price;
+    record.size = static_cast<int32_t>(in.size);
+    record.order_id = in.order_id;
+    record.sequence = in.sequence;
+    record.instrument_id = in.hd.instrument_id;
+    record.ts_in_delta = in.ts_in_delta;
+    record.publisher_id = in.hd.publisher_id;
+    record.rtype = in.hd.rtype;
+    record.channel_id = in.channel_id;
+    record.flags = in.flags;
+    record.action = in.action;
+    record.side = in.side;
+}
+
+void MboBinaryReader::render_text(const MboBinaryRecord& in, MboRecord& record) {
+    char* p = text_;
+    auto field = [&](MboField f, char* begin) {
+        record.raw[f] = std::string_view(begin, static_cast<size_t>(p - begin));
+    };
+    char* begin = p;
+    p = timestamp_to_chars(p, record.ts_recv);
+    field(MBO_TS_RECV, begin);
+    begin = p;
+    p = timestamp_to_chars(p, record.ts_event);
+    field(MBO_TS_EVENT, begin);
+    begin = p;
+    p = uint_to_chars(p, in.hd.rtype);
+    field(MBO_RTYPE, begin);
+    begin = p;
+    p = uint_to_chars(p, in.hd.publisher_id);
+    field(MBO_PUBLISHER_ID, begin);
+    begin = p;
+    p = uint_to_chars(p, in.hd.instrument_id);
+    field(MBO_INSTRUMENT_ID, begin);
+    begin = p;
+    *p++ = in.action;
+    field(MBO_ACTION, begin);
+    begin = p;
+    *p++ = in.side;
+    field(MBO_SIDE, begin);
+    begin = p;
+    p = price_to_chars_fixed(p, in.price);
+    field(MBO_PRICE, begin);
+    begin = p;
+    p = int_to_chars(p, record.size);
+    field(MBO_SIZE, begin);
+    begin = p;
+    p = uint_to_chars(p, in.channel_id);
+    field(MBO_CHANNEL_ID, begin);
+    begin = p;
+    p = uint_to_chars(p, in.order_id);
+    field(MBO_ORDER_ID, begin);
+    begin = p;
+    p = uint_to_chars(p, in.flags);
+    field(MBO_FLAGS, begin);
+    begin = p;
+    p = int_to_chars(p, in.ts_in_delta);
+    field(MBO_TS_IN_DELTA, begin);
+    begin = p;
+    p = uint_to_chars(p, in.sequence);
+    field(MBO_SEQUENCE, begin);
+}
+
+bool MboBinaryReader::next(MboRecord& record) {
+    OFA_STAGE(STAGE_PARSE);
+    if (next_ >= file_.record_count()) {
+        return false;
+    }
+    const MboBinaryRecord& in = file_.mbo_records()[next_++];
+    from_binary(in, record);
+    uint64_t key = (static_cast<uint64_t>(in.hd.publisher_id) << 32) | in.hd.instrument_id;
+    if (key != symbol_key_) {
+        symbol_key_ = key;
+        symbol_ = file_.symbol(in.hd.publisher_id, in.hd.instrument_id);
+    }
+    record.raw[MBO_SYMBOL] = symbol_;
+    if (with_text_) {
+        render_text(in, record);
+    }
+    return true;
+}
+
+void to_binary(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth,
+               Mbp10BinaryRecord& out) {
+    OFA_STAGE(STAGE_SNAPSHOT);
+    out.hd.length = sizeof(Mbp10BinaryRecord) / 4;
+    out.hd.rtype = RTYPE_MBP10;
+    out.hd.publisher_id = record.publisher_id;
+    out.hd.instrument_id = record.instrument_id;
+    out.hd.ts_event = static_cast<uint64_t>(record.ts_event);
+    out.price = record.price;
+    out.size = static_cast<uint32_t>(record.size);
+    out.action = is_trade ? 'T' : record.action;
+    out.side = record.side;
+    out.flags = record.flags;
+    out.depth = static_cast<uint8_t>(depth);
+    out.ts_recv = static_cast<uint64_t>(record.ts_recv);
+    out.ts_in_delta = record.ts_in_delta;
+    out.sequence = record.sequence;
+
+    const TopLevels& bids = book.bids.top();
+    const TopLevels& asks = book.asks.top();
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        BidAskPair& level = out.levels[i];
+        level.bid_px = i < bids.count ? bids.price[i] : UNDEF_PRICE;
+        level.ask_px = i < asks.count ? asks.price[i] : UNDEF_PRICE;
+        level.bid_sz = static_cast<uint32_t>(bids.level[i].size);
+        level.ask_sz = static_cast<uint32_t>(asks.level[i].size);
+        level.bid_ct = static_cast<uint32_t>(bids.level[i].count);
+        level.ask_ct = static_cast<uint32_t>(asks.level[i].count);
+    }
+    out.order_id = record.order_id;
+    out.row_index = static_cast<uint32_t>(rowIndex);
+    out.reserved = 0;
+}
+
+void MbpBinaryWriter::write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+    OFA_STAGE(STAGE_FORMAT);
+    file_.note_symbol(record.publisher_id, record.instrument_id, record.text(MBO_SYMBOL));
+    Mbp10BinaryRecord out;
+    to_binary(record, book, rowIndex, is_trade, depth, out);
+    file_.append(&out);
+}
+
+static char* put(char* p, std::string_view s) {
+    std::memcpy(p, s.data(), s.size());
+    return p + s.size();
+}
+
+static char* put_level(char* p, int64_t price, uint32_t size, uint32_t count) {
+    p = level_price_to_chars(p, price);
+    *p++ = ',';
+    p = int_to_chars(p, static_cast<int32_t>(size));
+    *p++ = ',';
+    return int_to_chars(p, static_cast<int32_t>(count));
+}
+
+// The csv repeats ts_event in the ts_recv column (as the reference formatter
+// does), so ts_recv from the binary record is not printed.
+char* render_mbp_csv_row(char* p, const Mbp10BinaryRecord& in, std::string_view symbol) {
+    p = uint_to_chars(p, in.row_index);
+    *p++ = ',';
+    p = timestamp_to_chars(p, static_cast<int64_t>(in.hd.ts_event));
+    *p++ = ',';
+    p = timestamp_to_chars(p, static_cast<int64_t>(in.hd.ts_event));
+    *p++ = ',';
+    p = uint_to_chars(p, in.hd.rtype);
+    *p++ = ',';
+    p = uint_to_chars(p, in.hd.publisher_id);
+    *p++ = ',';
+    p = uint_to_chars(p, in.hd.instrument_id);
+    *p++ = ',';
+    *p++ = in.action;
+    *p++ = ',';
+    *p++ = in.side;
+    *p++ = ',';
+    p = uint_to_chars(p, in.depth);
+    *p++ = ',';
+    p = price_to_chars(p, in.price);
+    *p++ = ',';
+    p = int_to_chars(p, static_cast<int32_t>(in.size));
+    *p++ = ',';
+    p = uint_to_chars(p, in.flags);
+    *p++ = ',';
+    p = int_to_chars(p, in.ts_in_delta);
+    *p++ = ',';
+    p = uint_to_chars(p, in.sequence);
+    for (const BidAskPair& level : in.levels) {
+        *p++ = ',';
+        p = put_level(p, level.bid_px, level.bid_sz, level.bid_ct);
+        *p++ = ',';
+        p = put_level(p, level.ask_px, level.ask_sz, level.ask_ct);
+    }
+    *p++ = ',';
+    p = put(p, symbol);
+    *p++ = ',';
+    p = uint_to_chars(p, in.order_id);
+    *p++ = '\n';
+    return p;
+}
+
+bool parse_mbp_csv_row(const char* begin, const char* end, Mbp10BinaryRecord& out, std::string_view& symbol) {
+    static constexpr int BASE_FIELDS = 14;
+    static constexpr int FIELD_COUNT = BASE_FIELDS + TOP_LEVELS * 6 + 2;
+    if (end > begin && end[-1] == '\r') {
+        end--;
+    }
+    std::string_view fields[FIELD_COUNT];
+    const char* p = begin;
+    for (int i = 0; i < FIELD_COUNT; ++i) {
+        if (p > end) {
+            return false;
+        }
+        const char* delim = find_delimiter(p, end);
+        fields[i] = std::string_view(p, static_cast<size_t>(delim - p));
+        p = delim + 1;
+    }
+
+    out = Mbp10BinaryRecord();
+    out.hd.length = sizeof(Mbp10BinaryRecord) / 4;
+    out.row_index = static_cast<uint32_t>(parse_uint(fields[0]));
+    out.ts_recv = static_cast<uint64_t>(parse_timestamp(fields[1]));
+    out.hd.ts_event = static_cast<uint64_t>(parse_timestamp(fields[2]));
+    out.hd.rtype = static_cast<uint8_t>(parse_uint(fields[3]));
+    out.hd.publisher_id = static_cast<uint16_t>(parse_uint(fields[4]));
+    out.hd.instrument_id = static_cast<uint32_t>(parse_uint(fields[5]));
+    out.action = fields[6].empty() ? 0 : fields[6][0];
+    out.side = fields[7].empty() ? 0 : fields[7][0];
+    out.depth = static_cast<uint8_t>(parse_uint(fields[8]));
+    out.price = parse_price(fields[9]);
+    out.size = static_cast<uint32_t>(parse_int(fields[10]));
+    out.flags = static_cast<uint8_t>(parse_uint(fields[11]));
+    out.ts_in_delta = static_cast<int32_t>(parse_int(fields[12]));
+    out.sequence = static_cast<uint32_t>(parse_uint(fields[13]));
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        const std::string_view* level = fields + BASE_FIELDS + i * 6;
+        BidAskPair& pair = out.levels[i];
+        pair.bid_px = parse_price(level[0]);
+        pair.bid_sz = static_cast<uint32_t>(parse_int(level[1]));
+        pair.bid_ct = static_cast<uint32_t>(parse_int(level[2]));
+        pair.ask_px = parse_price(level[3]);
+        pair.ask_sz = static_cast<uint32_t>(parse_int(level[4]));
+        pair.ask_ct = static_cast<uint32_t>(parse_int(level[5]));
+    }
+    symbol = fields[FIELD_COUNT - 2];
+    out.order_id = parse_uint(fields[FIELD_COUNT - 1]);
+    return true;
+}
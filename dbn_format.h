@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "mbo_reader.h"
+#include "ladder_book.h"
+#include "l3_book.h"
+#include "mbp_writer.h"
+
+// Fixed-width binary records modelled on Databento's DBN MboMsg / Mbp10Msg.
+// Prices are int64 in 1e-9 units (UNDEF_PRICE for none), timestamps are ns
+// since epoch, so a mapped file can be handed to the book without parsing.
+//
+// File layout: DbnFileHeader, record_count fixed-size records, then the
+// symbol table (symbol_count SymbolEntry) at symbol_offset. Everything is
+// little endian and 8-byte aligned.
+
+static constexpr char DBN_MAGIC[4] = {'O', 'F', 'A', 'B'};
+static constexpr uint8_t DBN_VERSION = 1;
+static constexpr uint8_t RTYPE_MBP10 = 10;
+static constexpr uint8_t RTYPE_MBO = 160;
+
+enum DbnSchema : uint8_t {
+    SCHEMA_MBO = 1,
+    SCHEMA_MBP10 = 2
+};
+
+struct DbnFileHeader {
+    char magic[4];
+    uint8_t version;
+    uint8_t schema;
+    uint16_t record_size;
+    uint32_t symbol_count;
+    uint32_t reserved;
+    uint64_t record_count;
+    uint64_t symbol_offset;
+};
+static_assert(sizeof(DbnFileHeader) == 32, "DbnFileHeader layout");
+
+struct SymbolEntry {
+    uint32_t instrument_id;
+    uint16_t publisher_id;
+    uint16_t reserved;
+    char symbol[24];            // nul padded
+};
+static_assert(sizeof(SymbolEntry) == 32, "SymbolEntry layout");
+
+struct RecordHeader {
+    uint8_t length;             // record size in 4-byte words
+    uint8_t rtype;
+    uint16_t publisher_id;
+    uint32_t instrument_id;
+    uint64_t ts_event;
+};
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader layout");
+
+struct MboBinaryRecord {
+    RecordHeader hd;
+    uint64_t order_id;
+    int64_t price;
+    uint32_t size;
+    uint8_t flags;
+    uint8_t channel_id;
+    char action;
+    char side;
+    uint64_t ts_recv;
+    int32_t ts_in_delta;
+    uint32_t sequence;
+};
+static_assert(sizeof(MboBinaryRecord) == 56, "MboBinaryRecord layout");
+
+struct BidAskPair {
+    int64_t bid_px;
+    int64_t ask_px;
+    uint32_t bid_sz;
+    uint32_t ask_sz;
+    uint32_t bid_ct;
+    uint32_t ask_ct;
+};
+static_assert(sizeof(BidAskPair) == 32, "BidAskPair layout");
+
+// Mbp10Msg plus the two columns our csv carries that DBN does not
+// (the source order_id and the row index, which repeats for T-F-C rows).
+struct Mbp10BinaryRecord {
+    RecordHeader hd;
+    int64_t price;
+    uint32_t size;
+    char action;
+    char side;
+    uint8_t flags;
+    uint8_t depth;
+    uint64_t ts_recv;
+    int32_t ts_in_delta;
+    uint32_t sequence;
+    BidAskPair levels[TOP_LEVELS];
+    uint64_t order_id;
+    uint32_t row_index;
+    uint32_t reserved;
+};
+static_assert(sizeof(Mbp10BinaryRecord) == 384, "Mbp10BinaryRecord layout");
+
+bool is_dbn_file(const char* data, size_t size);
+
+// Read-only view of a binary file held in memory (usually a MappedFile).
+class DbnFile {
+private:
+    DbnFileHeader header_ = {};
+    const char* records_ = nullptr;
+    const SymbolEntry* symbols_ = nullptr;
+
+public:
+    // false if the buffer is not a complete file of a known schema
+    bool open(const char* data, size_t size);
+
+    DbnSchema schema() const { return static_cast<DbnSchema>(header_.schema); }
+    uint64_t record_count() const { return header_.record_count; }
+    uint32_t symbol_count() const { return header_.symbol_count; }
+    const SymbolEntry& symbol_entry(uint32_t i) const { return symbols_[i]; }
+
+    const MboBinaryRecord* mbo_records() const { return reinterpret_cast<const MboBinaryRecord*>(records_); }
+    const Mbp10BinaryRecord* mbp_records() const { return reinterpret_cast<const Mbp10BinaryRecord*>(records_); }
+
+    // empty if the instrument has no entry
+    std::string_view symbol(uint16_t publisher_id, uint32_t instrument_id) const;
+};
+
+// Writes the header, records and symbol table of one binary file through an
+// OutputBuffer. The header is written as a placeholder and patched in finish().
+class DbnFileWriter {
+private:
+    OutputBuffer& out_;
+    DbnFileHeader header_ = {};
+    std::vector<SymbolEntry> symbols_;
+    FlatHashTable<uint32_t> known_;     // instrument key -> index in symbols_
+
+public:
+    DbnFileWriter(OutputBuffer& out, DbnSchema schema);
+
+    void begin();
+    void note_symbol(uint16_t publisher_id, uint32_t instrument_id, std::string_view symbol);
+    void append(const void* record) {
+        out_.append(std::string_view(static_cast<const char*>(record), header_.record_size));
+        header_.record_count++;
+    }
+    // writes the symbol table and the final header, then closes the buffer
+    bool finish();
+};
+
+// Packs/unpacks the typed fields of an mbo record.
+void to_binary(const MboRecord& record, MboBinaryRecord& out);
+void from_binary(const MboBinaryRecord& in, MboRecord& record);
+// Packs one mbp row: the record's fields and the book's top levels.
+void to_binary(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth,
+               Mbp10BinaryRecord& out);
+
+// Yields the records of an mbo binary file as MboRecords. With text enabled
+// the raw[] columns are rendered into an internal buffer in the same form as
+// the mbo csv, so csv sinks can echo them; otherwise only the symbol is set.
+// The text is overwritten by the next call.
+class MboBinaryReader {
+private:
+    static constexpr size_t TEXT_MAX = 512;
+
+    const DbnFile& file_;
+    uint64_t next_ = 0;
+    bool with_text_;
+    uint64_t symbol_key_ = UINT64_MAX;
+    std::string_view symbol_;
+    char text_[TEXT_MAX];
+
+    void render_text(const MboBinaryRecord& in, MboRecord& record);
+
+public:
+    MboBinaryReader(const DbnFile& file, bool with_text) : file_(file), with_text_(with_text) {}
+
+    bool next(MboRecord& record);
+    uint64_t position() const { return next_; }
+};
+
+// MBP-10 output as binary records, same write_row interface as MbpCsvWriter.
+class MbpBinaryWriter {
+private:
+    DbnFileWriter file_;
+
+public:
+    explicit MbpBinaryWriter(OutputBuffer& out) : file_(out, SCHEMA_MBP10) {}
+
+    void write_header() { file_.begin(); }
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth);
+    void write_row(const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        write_row(record, book.levels, rowIndex, is_trade, depth);
+    }
+    bool finish() { return file_.finish(); }
+};
+
+// One mbp csv row (with trailing newline) for a binary record, byte-identical
+// to what MbpCsvWriter writes for the same row. Needs MBP_ROW_TEXT_MAX bytes.
+static constexpr size_t MBP_ROW_TEXT_MAX = 2048;
+char* render_mbp_csv_row(char* p, const Mbp10BinaryRecord& in, std::string_view symbol);
+
+// Parses one line of mbp csv (as written by this program) back into a record.
+bool parse_mbp_csv_row(const char* begin, const char* end, Mbp10BinaryRecord& out, std::string_view& symbol);
@@ -0,0 +1,301 @@
+#include "delta_format.h"
+#include "instrumentation.h"
+#include <cstring>
+
+bool is_delta_file(const char* data, size_t size) {
+    return size >= sizeof(DeltaFileHeader) && std::memcmp(data, DELTA_MAGIC, sizeof(DELTA_MAGIC)) == 0;
+}
+
+static char* put_varint(char* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    *p++ = static_cast<char>(v);
+    return p;
+}
+
+static bool get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// zigzag of the wrapped difference, so UNDEF_PRICE and unsigned fields round-trip
+static uint64_t zigzag_delta(uint64_t value, uint64_t prev) {
+    int64_t d = static_cast<int64_t>(value - prev);
+    return (static_cast<uint64_t>(d) << 1) ^ static_cast<uint64_t>(d >> 63);
+}
+
+static bool get_delta(const char*& p, const char* end, uint64_t prev, uint64_t& value) {
+    uint64_t v;
+    if (!get_varint(p, end, v)) {
+        return false;
+    }
+    value = prev + static_cast<uint64_t>(static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1));
+    return true;
+}
+
+// price, size and count of one side of a level
+struct LevelValues {
+    uint64_t v[3];
+};
+
+static LevelValues level_values(const BidAskPair& level, int side) {
+    if (side == 0) {
+        return {{static_cast<uint64_t>(level.bid_px), level.bid_sz, level.bid_ct}};
+    }
+    return {{static_cast<uint64_t>(level.ask_px), level.ask_sz, level.ask_ct}};
+}
+
+static void set_level_values(BidAskPair& level, int side, const LevelValues& values) {
+    if (side == 0) {
+        level.bid_px = static_cast<int64_t>(values.v[0]);
+        level.bid_sz = static_cast<uint32_t>(values.v[1]);
+        level.bid_ct = static_cast<uint32_t>(values.v[2]);
+    } else {
+        level.ask_px = static_cast<int64_t>(values.v[0]);
+        level.ask_sz = static_cast<uint32_t>(values.v[1]);
+        level.ask_ct = static_cast<uint32_t>(values.v[2]);
+    }
+}
+
+static uint8_t changed_fields(const LevelValues& now, const LevelValues& before) {
+    return static_cast<uint8_t>((now.v[0] != before.v[0]) | (now.v[1] != before.v[1]) << 1 |
+                                (now.v[2] != before.v[2]) << 2);
+}
+
+// level code: bits 0-2 the fields that follow, bits 3-4 where the level came
+// from in the previous row: its own slot, the one above or the one below
+static constexpr int SOURCE_OFFSET[3] = {0, -1, 1};
+
+// every row fits in this many bytes plus the symbol
+static constexpr size_t DELTA_ROW_MAX = 16 + 10 * 14 + 2 * TOP_LEVELS * (1 + 3 * 10);
+
+MbpDeltaWriter::MbpDeltaWriter(OutputBuffer& out, uint32_t refresh_rows)
+    : out_(out), refresh_rows_(refresh_rows > 0 ? refresh_rows : 1) {}
+
+void MbpDeltaWriter::write_header() {
+    DeltaFileHeader header = {};
+    std::memcpy(header.magic, DELTA_MAGIC, sizeof(header.magic));
+    header.version = DELTA_VERSION;
+    header.refresh_rows = refresh_rows_;
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    stats_.bytes += sizeof(header);
+}
+
+void MbpDeltaWriter::write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+    OFA_STAGE(STAGE_FORMAT);
+    uint32_t masks[2] = {book.bids.take_dirty(), book.asks.take_dirty()};
+    Mbp10BinaryRecord row;
+    to_binary(record, book, rowIndex, is_trade, depth, row);
+
+    uint8_t tag = 0;
+    if (since_refresh_ == 0) {
+        tag = DELTA_ROW_REFRESH | DELTA_ROW_INSTRUMENT | DELTA_ROW_SYMBOL;
+        prev_ = Mbp10BinaryRecord();
+        masks[0] = masks[1] = (1u << TOP_LEVELS) - 1;
+        stats_.refreshes++;
+    }
+    since_refresh_ = (since_refresh_ + 1) % refresh_rows_;
+    if (row.hd.publisher_id != prev_.hd.publisher_id || row.hd.instrument_id != prev_.hd.instrument_id) {
+        tag |= DELTA_ROW_INSTRUMENT;
+    }
+    std::string_view symbol = record.text(MBO_SYMBOL);
+    if (symbol != symbol_) {
+        tag |= DELTA_ROW_SYMBOL;
+        symbol_.assign(symbol.data(), symbol.size());
+    }
+
+    char* begin = out_.reserve(DELTA_ROW_MAX + symbol.size());
+    char* p = begin;
+    *p++ = static_cast<char>(tag);
+    if (tag & DELTA_ROW_INSTRUMENT) {
+        p = put_varint(p, row.hd.publisher_id);
+        p = put_varint(p, row.hd.instrument_id);
+    }
+    if (tag & DELTA_ROW_SYMBOL) {
+        p = put_varint(p, symbol.size());
+        std::memcpy(p, symbol.data(), symbol.size());
+        p += symbol.size();
+    }
+    p = put_varint(p, zigzag_delta(row.row_index, prev_.row_index));
+    p = put_varint(p, zigzag_delta(row.hd.ts_event, prev_.hd.ts_event));
+    p = put_varint(p, zigzag_delta(row.sequence, prev_.sequence));
+    p = put_varint(p, zigzag_delta(row.ts_recv - row.hd.ts_event, prev_.ts_recv - prev_.hd.ts_event));
+    p = put_varint(p, zigzag_delta(static_cast<uint64_t>(row.price), static_cast<uint64_t>(prev_.price)));
+    p = put_varint(p, row.size);
+    p = put_varint(p, zigzag_delta(static_cast<uint64_t>(static_cast<int64_t>(row.ts_in_delta)),
+                                   static_cast<uint64_t>(static_cast<int64_t>(prev_.ts_in_delta))));
+    p = put_varint(p, row.order_id);
+    *p++ = row.action;
+    *p++ = row.side;
+    *p++ = static_cast<char>(row.flags);
+    *p++ = static_cast<char>(row.depth);
+
+    // per dirty level: which fields moved, against the same slot or a neighbour
+    // (a level inserted or removed above shifts the rest by one)
+    uint8_t codes[2][TOP_LEVELS];
+    for (int side = 0; side < 2; ++side) {
+        for (uint32_t dirty = masks[side]; dirty != 0; dirty &= dirty - 1) {
+            int i = __builtin_ctz(dirty);
+            LevelValues now = level_values(row.levels[i], side);
+            uint8_t best = 0;
+            int best_count = 4;
+            for (int source = 0; source < 3; ++source) {
+                int j = i + SOURCE_OFFSET[source];
+                if (j < 0 || j >= TOP_LEVELS) {
+                    continue;
+                }
+                uint8_t fields = changed_fields(now, level_values(prev_.levels[j], side));
+                int count = __builtin_popcount(fields);
+                if (count < best_count) {
+                    best = static_cast<uint8_t>(fields | (source << 3));
+                    best_count = count;
+                }
+            }
+            codes[side][i] = best;
+            if (best == 0) {
+                masks[side] &= ~(1u << i);      // marked dirty but back where it was
+            }
+        }
+    }
+    p = put_varint(p, masks[0]);
+    p = put_varint(p, masks[1]);
+    for (int side = 0; side < 2; ++side) {
+        for (uint32_t dirty = masks[side]; dirty != 0; dirty &= dirty - 1) {
+            int i = __builtin_ctz(dirty);
+            uint8_t code = codes[side][i];
+            LevelValues now = level_values(row.levels[i], side);
+            LevelValues from = level_values(prev_.levels[i + SOURCE_OFFSET[code >> 3]], side);
+            *p++ = static_cast<char>(code);
+            for (int f = 0; f < 3; ++f) {
+                if (code & (1 << f)) {
+                    p = put_varint(p, zigzag_delta(now.v[f], from.v[f]));
+                }
+            }
+            if (!(tag & DELTA_ROW_REFRESH)) {
+                stats_.levels++;
+            }
+        }
+    }
+    out_.commit(p);
+    stats_.rows++;
+    stats_.bytes += static_cast<uint64_t>(p - begin);
+    prev_ = row;
+}
+
+bool MbpDeltaWriter::finish() {
+    return out_.close();
+}
+
+bool MbpDeltaReader::open(const char* data, size_t size) {
+    if (!is_delta_file(data, size)) {
+        return false;
+    }
+    DeltaFileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != DELTA_VERSION) {
+        return false;
+    }
+    cur_ = data + sizeof(header);
+    end_ = data + size;
+    started_ = false;
+    failed_ = false;
+    return true;
+}
+
+bool MbpDeltaReader::next(Mbp10BinaryRecord& out, std::string_view& symbol) {
+    if (cur_ >= end_) {
+        return false;
+    }
+    const char* p = cur_;
+    uint8_t tag = static_cast<uint8_t>(*p++);
+    if (tag & DELTA_ROW_REFRESH) {
+        row_ = Mbp10BinaryRecord();
+        started_ = true;
+    } else if (!started_) {
+        failed_ = true;     // a delta row needs a refresh before it
+        return false;
+    }
+    Mbp10BinaryRecord& row = row_;
+    uint64_t v = 0, ts_recv_delta = 0, price = 0, ts_in_delta = 0, masks[2] = {0, 0};
+    bool ok = true;
+    if (tag & DELTA_ROW_INSTRUMENT) {
+        ok = ok && get_varint(p, end_, v);
+        row.hd.publisher_id = static_cast<uint16_t>(v);
+        ok = ok && get_varint(p, end_, v);
+        row.hd.instrument_id = static_cast<uint32_t>(v);
+    }
+    if (ok && (tag & DELTA_ROW_SYMBOL)) {
+        ok = get_varint(p, end_, v) && v <= static_cast<uint64_t>(end_ - p);
+        if (ok) {
+            symbol_ = std::string_view(p, static_cast<size_t>(v));
+            p += v;
+        }
+    }
+    uint64_t prev_recv_offset = row.ts_recv - row.hd.ts_event;
+    ok = ok && get_delta(p, end_, row.row_index, v);
+    row.row_index = static_cast<uint32_t>(v);
+    ok = ok && get_delta(p, end_, row.hd.ts_event, v);
+    row.hd.ts_event = v;
+    ok = ok && get_delta(p, end_, row.sequence, v);
+    row.sequence = static_cast<uint32_t>(v);
+    ok = ok && get_delta(p, end_, prev_recv_offset, ts_recv_delta);
+    row.ts_recv = row.hd.ts_event + ts_recv_delta;
+    ok = ok && get_delta(p, end_, static_cast<uint64_t>(row.price), price);
+    row.price = static_cast<int64_t>(price);
+    ok = ok && get_varint(p, end_, v);
+    row.size = static_cast<uint32_t>(v);
+    ok = ok && get_delta(p, end_, static_cast<uint64_t>(static_cast<int64_t>(row.ts_in_delta)), ts_in_delta);
+    row.ts_in_delta = static_cast<int32_t>(static_cast<int64_t>(ts_in_delta));
+    ok = ok && get_varint(p, end_, row.order_id);
+    ok = ok && end_ - p >= 4;
+    if (ok) {
+        row.action = p[0];
+        row.side = p[1];
+        row.flags = static_cast<uint8_t>(p[2]);
+        row.depth = static_cast<uint8_t>(p[3]);
+        p += 4;
+    }
+    ok = ok && get_varint(p, end_, masks[0]) && get_varint(p, end_, masks[1]);
+    ok = ok && masks[0] < (1u << TOP_LEVELS) && masks[1] < (1u << TOP_LEVELS);
+    BidAskPair before[TOP_LEVELS];
+    std::memcpy(before, row.levels, sizeof(before));
+    for (int side = 0; side < 2 && ok; ++side) {
+        for (uint64_t dirty = masks[side]; dirty != 0 && ok; dirty &= dirty - 1) {
+            int i = __builtin_ctzll(dirty);
+            ok = p < end_;
+            uint8_t code = ok ? static_cast<uint8_t>(*p++) : 0;
+            int source = code >> 3;
+            int j = i + (source < 3 ? SOURCE_OFFSET[source] : TOP_LEVELS);
+            ok = ok && source < 3 && j >= 0 && j < TOP_LEVELS;
+            if (!ok) {
+                break;
+            }
+            LevelValues values = level_values(before[j], side);
+            for (int f = 0; f < 3 && ok; ++f) {
+                if (code & (1 << f)) {
+                    ok = get_delta(p, end_, values.v[f], values.v[f]);
+                }
+            }
+            set_level_values(row.levels[i], side, values);
+        }
+    }
+    if (!ok) {
+        failed_ = true;
+        return false;
+    }
+    row.hd.length = sizeof(Mbp10BinaryRecord) / 4;
+    row.hd.rtype = RTYPE_MBP10;
+    cur_ = p;
+    out = row;
+    symbol = symbol_;
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "dbn_format.h"
+
+// Differential MBP-10 files: each row holds its own fields as small deltas
+// against the previous row, and only the book levels the row changed. Which
+// levels changed comes from the book's dirty masks (LadderSide::take_dirty),
+// so nothing is compared on the way out. Every refresh_rows rows a refresh
+// row carries all 20 levels and every field in full. Rows have no length
+// prefix and the file has no offset index, so a refresh cannot be found
+// without decoding what comes before it: a reader starts at the first row
+// and stops at the first malformed one.
+//
+// File layout: DeltaFileHeader, then rows back to back. A row is a tag byte
+// (DELTA_ROW_* bits), then as varints:
+//   [publisher_id, instrument_id]      if DELTA_ROW_INSTRUMENT
+//   [symbol length, symbol bytes]      if DELTA_ROW_SYMBOL
+//   row_index, ts_event, sequence,     zigzag deltas against the previous row
+//   ts_recv - ts_event, price
+//   size                               plain
+//   ts_in_delta                        zigzag delta
+//   order_id                           plain
+//   action, side, flags, depth         one byte each
+//   bid mask, ask mask                 bit i = level i follows
+//   per level in the masks, bids first: a code byte (which of price, size and
+//   count follow, and whether they are deltas against the same level of the
+//   previous row or its neighbour above or below, for levels shifted by an
+//   insert or a removal), then those fields as zigzag deltas
+// A refresh row is encoded against an all-zero previous row with full masks.
+// Prices keep UNDEF_PRICE and wrap in the deltas.
+
+static constexpr char DELTA_MAGIC[4] = {'O', 'F', 'A', 'D'};
+static constexpr uint16_t DELTA_VERSION = 1;
+static constexpr uint32_t DEFAULT_REFRESH_ROWS = 1000;
+
+enum DeltaRowFlags : uint8_t {
+    DELTA_ROW_REFRESH = 1,
+    DELTA_ROW_INSTRUMENT = 2,
+    DELTA_ROW_SYMBOL = 4,
+};
+
+struct DeltaFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t refresh_rows;
+    uint32_t reserved2;
+};
+static_assert(sizeof(DeltaFileHeader) == 16, "DeltaFileHeader layout");
+
+bool is_delta_file(const char* data, size_t size);
+
+struct DeltaStats {
+    uint64_t rows = 0;
+    uint64_t refreshes = 0;
+    uint64_t levels = 0;        // levels written by delta rows
+    uint64_t bytes = 0;
+};
+
+// Same write_row interface as MbpCsvWriter / MbpBinaryWriter. Must be the
+// only consumer of the book's dirty masks.
+class MbpDeltaWriter {
+private:
+    OutputBuffer& out_;
+    uint32_t refresh_rows_;
+    uint32_t since_refresh_ = 0;
+    Mbp10BinaryRecord prev_ = {};
+    std::string symbol_;
+    std::string row_;
+    DeltaStats stats_;
+
+public:
+    explicit MbpDeltaWriter(OutputBuffer& out, uint32_t refresh_rows = DEFAULT_REFRESH_ROWS);
+
+    void write_header();
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth);
+    void write_row(const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        write_row(record, book.levels, rowIndex, is_trade, depth);
+    }
+    bool finish();
+
+    const DeltaStats& stats() const { return stats_; }
+};
+
+// Expands a delta file held in memory back into full rows; render them with
+// render_mbp_csv_row for the exact csv MbpCsvWriter writes.
+class MbpDeltaReader {
+private:
+    const char* cur_ = nullptr;
+    const char* end_ = nullptr;
+    Mbp10BinaryRecord row_ = {};
+    std::string_view symbol_;
+    bool started_ = false;      // seen a refresh row
+    bool failed_ = false;
+
+public:
+    bool open(const char* data, size_t size);
+    // false at the end or on a malformed row (see failed())
+    bool next(Mbp10BinaryRecord& row, std::string_view& symbol);
+    bool failed() const { return failed_; }
+};
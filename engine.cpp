@@ -0,0 +1,399 @@
+#include "engine.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include "spsc_queue.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <sys/resource.h>
+#include <type_traits>
+
+namespace {
+
+static constexpr uint64_t END_OF_STREAM = UINT64_MAX;
+static constexpr uint64_t HEARTBEAT_INTERVAL = 1024;
+static constexpr size_t CHUNK_BYTES = 1 << 16;
+static constexpr size_t SPLIT_BUFFER_BYTES = 1 << 16;
+
+// what the parser thread hands a worker; action 0 is a heartbeat that only
+// moves the worker's watermark
+struct SequencedRecord {
+    uint64_t seq = 0;
+    MboRecord record;
+};
+
+// rows rendered by one worker, in input order
+struct RowChunk {
+    std::vector<char> text;
+    size_t used = 0;
+    std::vector<std::pair<uint64_t, size_t>> rows; // (input seq, end offset in text)
+    uint64_t watermark = 0; // no later row from this worker has seq <= watermark
+
+    RowChunk() : text(CHUNK_BYTES) {}
+    void reset() {
+        used = 0;
+        rows.clear();
+    }
+};
+
+template <typename Book> Book make_instrument_book();
+template <> LadderBook make_instrument_book<LadderBook>() { return LadderBook(INSTRUMENT_LADDER_SLOTS); }
+template <> L3Book make_instrument_book<L3Book>() { return L3Book(1 << 12, INSTRUMENT_LADDER_SLOTS); }
+
+// merged mode: rows go into the worker's current chunk, tagged with the input seq
+struct ChunkSink {
+    MbpRowRenderer renderer;
+    std::unique_ptr<RowChunk>* chunk;
+    const uint64_t* seq;
+    uint64_t rows = 0;
+
+    ChunkSink(std::unique_ptr<RowChunk>* c, const uint64_t* s) : chunk(c), seq(s) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        RowChunk& c = **chunk;
+        size_t need = MbpRowRenderer::max_row_size(record);
+        if (c.text.size() - c.used < need) {
+            c.text.resize(std::max(c.text.size() * 2, c.used + need));
+        }
+        char* begin = c.text.data() + c.used;
+        char* end = renderer.render(begin, record, book, rowIndex, is_trade, depth);
+        c.used += static_cast<size_t>(end - begin);
+        c.rows.emplace_back(*seq, c.used);
+        rows++;
+    }
+};
+
+// split mode: every instrument writes its own csv, through one of the worker's
+// few open outputs while it has one (see Worker::open_output)
+struct FileSink {
+    std::string path;
+    MbpRowRenderer renderer;
+    OutputBuffer* out = nullptr;
+    uint64_t size = 0;          // file size when it was last closed
+    uint64_t last_use = 0;
+    bool created = false;
+    uint64_t rows = 0;
+
+    explicit FileSink(std::string p) : path(std::move(p)) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        char* p = out->reserve(MbpRowRenderer::max_row_size(record));
+        out->commit(renderer.render(p, record, book, rowIndex, is_trade, depth));
+        rows++;
+    }
+};
+
+template <typename Book, typename Sink>
+struct Instrument {
+    Sink sink;
+    Reconstructor<Book, Sink> reconstructor;
+
+    template <typename... Args>
+    explicit Instrument(Args&&... args)
+        : sink(std::forward<Args>(args)...), reconstructor(sink, make_instrument_book<Book>()) {}
+};
+
+std::string split_path(const std::string& output_path, const MboRecord& record) {
+    std::string base = output_path;
+    if (base.size() > 4 && base.compare(base.size() - 4, 4, ".csv") == 0) {
+        base.resize(base.size() - 4);
+    }
+    return base + "_" + std::to_string(record.publisher_id) + "_" + std::to_string(record.instrument_id) + ".csv";
+}
+
+template <typename Book, typename Sink>
+class Worker {
+private:
+    static constexpr bool MERGED = std::is_same<Sink, ChunkSink>::value;
+
+    const EngineOptions& options_;
+    FlatHashTable<uint32_t> index_;
+    std::vector<std::unique_ptr<Instrument<Book, Sink>>> instruments_;
+    std::unique_ptr<RowChunk> chunk_;
+    uint64_t seq_ = 0;
+    uint64_t published_watermark_ = 0;
+    // split mode: open outputs and the sink holding each
+    size_t max_open_;
+    std::vector<std::unique_ptr<OutputBuffer>> outputs_;
+    std::vector<FileSink*> holders_;
+    uint64_t clock_ = 0;
+
+    Instrument<Book, Sink>& instrument_for(const MboRecord& record) {
+        uint64_t key = instrument_key(record);
+        const uint32_t* found = index_.find(key);
+        if (found != nullptr) {
+            return *instruments_[*found];
+        }
+        index_.insert(key, static_cast<uint32_t>(instruments_.size()));
+        if constexpr (MERGED) {
+            instruments_.emplace_back(new Instrument<Book, Sink>(&chunk_, &seq_));
+        } else {
+            instruments_.emplace_back(new Instrument<Book, Sink>(split_path(options_.output_path, record)));
+        }
+        return *instruments_.back();
+    }
+
+    // gives sink an open output, closing the least recently used file when all are taken
+    void open_output(FileSink& sink) {
+        sink.last_use = ++clock_;
+        if (sink.out != nullptr) {
+            return;
+        }
+        size_t slot = outputs_.size();
+        if (slot < max_open_) {
+            outputs_.emplace_back(new OutputBuffer(SPLIT_BUFFER_BYTES));
+            holders_.push_back(nullptr);
+        } else {
+            slot = 0;
+            for (size_t i = 1; i < holders_.size(); ++i) {
+                if (holders_[i]->last_use < holders_[slot]->last_use) {
+                    slot = i;
+                }
+            }
+            close_output(*holders_[slot]);
+        }
+        OutputBuffer& out = *outputs_[slot];
+        bool opened = sink.created ? out.open_at(sink.path.c_str(), sink.size) : out.open(sink.path.c_str());
+        if (!opened) {
+            failed = true;
+        } else if (!sink.created) {
+            out.append(mbp_header_line());
+            sink.created = true;
+        }
+        sink.out = &out;
+        holders_[slot] = &sink;
+    }
+
+    void close_output(FileSink& sink) {
+        sink.size = sink.out->tell();
+        if (!sink.out->close()) {
+            failed = true;
+        }
+        sink.out = nullptr;
+    }
+
+    void take_fresh_chunk() {
+        if (!free_chunks.try_pop(chunk_)) {
+            chunk_.reset(new RowChunk());
+        }
+        chunk_->reset();
+    }
+
+    void publish_chunk(uint64_t watermark) {
+        chunk_->watermark = watermark;
+        published_watermark_ = watermark;
+        output.push(std::move(chunk_));
+        take_fresh_chunk();
+    }
+
+public:
+    SpscQueue<SequencedRecord> input;
+    SpscQueue<std::unique_ptr<RowChunk>> output;      // worker -> merger
+    SpscQueue<std::unique_ptr<RowChunk>> free_chunks; // merger -> worker, recycled chunks
+    bool failed = false;
+
+    Worker(const EngineOptions& options, size_t max_open)
+        : options_(options), max_open_(std::max<size_t>(1, max_open)), input(options.queue_capacity),
+          output(1024), free_chunks(1024) {
+        if constexpr (MERGED) {
+            take_fresh_chunk();
+        }
+    }
+
+    void run() {
+        SequencedRecord item;
+        while (true) {
+            input.pop(item);
+            if (item.seq == END_OF_STREAM) {
+                break;
+            }
+            if (item.record.action != 0) {
+                seq_ = item.seq;
+                Instrument<Book, Sink>& instrument = instrument_for(item.record);
+                if constexpr (!MERGED) {
+                    open_output(instrument.sink);
+                }
+                instrument.reconstructor.process(item.record);
+            }
+            if constexpr (MERGED) {
+                bool heartbeat = item.record.action == 0;
+                if (chunk_->used >= CHUNK_BYTES / 2 || (heartbeat && item.seq != published_watermark_)) {
+                    publish_chunk(item.seq);
+                }
+            }
+        }
+        if constexpr (MERGED) {
+            publish_chunk(END_OF_STREAM);
+        } else {
+            for (FileSink* sink : holders_) {
+                close_output(*sink);
+            }
+        }
+    }
+
+    uint64_t rows() const {
+        uint64_t total = 0;
+        for (const auto& instrument : instruments_) total += instrument->sink.rows;
+        return total;
+    }
+    size_t instrument_count() const { return instruments_.size(); }
+};
+
+// Interleaves the workers' rows in input order. A row with seq t is safe to
+// write once every other worker has either a pending row (necessarily later)
+// or a watermark >= t.
+template <typename Book>
+bool merge_rows(std::vector<std::unique_ptr<Worker<Book, ChunkSink>>>& workers, OutputBuffer& out) {
+    struct Cursor {
+        std::deque<std::unique_ptr<RowChunk>> chunks;
+        size_t next_row = 0;
+        uint64_t watermark = 0;
+    };
+    std::vector<Cursor> cursors(workers.size());
+
+    while (true) {
+        for (size_t w = 0; w < workers.size(); ++w) {
+            std::unique_ptr<RowChunk> chunk;
+            while (workers[w]->output.try_pop(chunk)) {
+                cursors[w].watermark = chunk->watermark;
+                cursors[w].chunks.push_back(std::move(chunk));
+            }
+            // drop fully written chunks, they go back to the worker
+            Cursor& c = cursors[w];
+            while (!c.chunks.empty() && c.next_row == c.chunks.front()->rows.size()) {
+                workers[w]->free_chunks.try_push(std::move(c.chunks.front()));
+                c.chunks.pop_front();
+                c.next_row = 0;
+            }
+        }
+
+        bool progressed = false;
+        while (true) {
+            size_t best = workers.size();
+            uint64_t best_seq = END_OF_STREAM;
+            for (size_t w = 0; w < workers.size(); ++w) {
+                Cursor& c = cursors[w];
+                if (!c.chunks.empty() && c.next_row < c.chunks.front()->rows.size()) {
+                    uint64_t seq = c.chunks.front()->rows[c.next_row].first;
+                    if (seq < best_seq) {
+                        best_seq = seq;
+                        best = w;
+                    }
+                }
+            }
+            if (best == workers.size()) {
+                break;
+            }
+            bool safe = true;
+            for (size_t w = 0; w < workers.size() && safe; ++w) {
+                Cursor& c = cursors[w];
+                bool has_row = !c.chunks.empty() && c.next_row < c.chunks.front()->rows.size();
+                safe = w == best || has_row || c.watermark >= best_seq;
+            }
+            if (!safe) {
+                break;
+            }
+            Cursor& c = cursors[best];
+            RowChunk& chunk = *c.chunks.front();
+            size_t begin = (c.next_row == 0) ? 0 : chunk.rows[c.next_row - 1].second;
+            size_t end = chunk.rows[c.next_row].second;
+            out.append(std::string_view(chunk.text.data() + begin, end - begin));
+            c.next_row++;
+            if (c.next_row == chunk.rows.size()) {
+                workers[best]->free_chunks.try_push(std::move(c.chunks.front()));
+                c.chunks.pop_front();
+                c.next_row = 0;
+            }
+            progressed = true;
+        }
+
+        bool finished = true;
+        for (const Cursor& c : cursors) {
+            finished = finished && c.watermark == END_OF_STREAM && c.chunks.empty();
+        }
+        if (finished) {
+            return true;
+        }
+        if (!progressed) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+} // namespace
+
+template <typename Book>
+bool run_engine(MboReader& reader, const EngineOptions& options, EngineStats* stats) {
+    size_t n = static_cast<size_t>(std::max(1, options.threads));
+    EngineStats local;
+    bool ok = true;
+
+    auto dispatch = [&](auto& workers) {
+        std::vector<std::thread> threads;
+        for (auto& worker : workers) {
+            threads.emplace_back([&worker] { worker->run(); });
+        }
+        SequencedRecord item;
+        uint64_t seq = 0;
+        while (reader.next(item.record)) {
+            item.seq = ++seq;
+            workers[mix_key(instrument_key(item.record)) % n]->input.push(item);
+            if (seq % HEARTBEAT_INTERVAL == 0) {
+                SequencedRecord heartbeat;
+                heartbeat.seq = seq;
+                for (auto& worker : workers) worker->input.push(heartbeat);
+            }
+        }
+        SequencedRecord end;
+        end.seq = END_OF_STREAM;
+        for (auto& worker : workers) worker->input.push(end);
+        local.records = seq;
+        return threads;
+    };
+
+    if (options.split_output) {
+        // leave half the descriptors to the rest of the process
+        size_t max_open = options.max_open_files;
+        rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            max_open = std::min<size_t>(max_open, static_cast<size_t>(limit.rlim_cur) / 2);
+        }
+        std::vector<std::unique_ptr<Worker<Book, FileSink>>> workers;
+        for (size_t i = 0; i < n; ++i) workers.emplace_back(new Worker<Book, FileSink>(options, max_open / n));
+        std::vector<std::thread> threads = dispatch(workers);
+        for (auto& t : threads) t.join();
+        for (auto& worker : workers) {
+            ok = ok && !worker->failed;
+            local.rows += worker->rows();
+            local.instruments += worker->instrument_count();
+        }
+    } else {
+        OutputBuffer out;
+        if (!out.open(options.output_path.c_str())) {
+            return false;
+        }
+        out.append(mbp_header_line());
+        std::vector<std::unique_ptr<Worker<Book, ChunkSink>>> workers;
+        for (size_t i = 0; i < n; ++i) workers.emplace_back(new Worker<Book, ChunkSink>(options, 0));
+        bool merged = false;
+        std::thread merger([&] { merged = merge_rows(workers, out); });
+        std::vector<std::thread> threads = dispatch(workers);
+        for (auto& t : threads) t.join();
+        merger.join();
+        ok = merged && out.close();
+        for (auto& worker : workers) {
+            local.rows += worker->rows();
+            local.instruments += worker->instrument_count();
+        }
+    }
+
+    if (stats != nullptr) {
+        *stats = local;
+    }
+    return ok;
+}
+
+template bool run_engine<LadderBook>(MboReader&, const EngineOptions&, EngineStats*);
+template bool run_engine<L3Book>(MboReader&, const EngineOptions&, EngineStats*);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "mbo_reader.h"
+
+static constexpr size_t INSTRUMENT_LADDER_SLOTS = 1024;
+
+struct EngineOptions {
+    int threads = 1;
+    // one csv per (publisher_id, instrument_id) named <output_path stem>_<publisher>_<instrument>.csv,
+    // otherwise a single file with every instrument's rows in input (ts_recv) order
+    bool split_output = false;
+    // split mode keeps at most this many files open (also capped by RLIMIT_NOFILE), closing the
+    // least recently written one and reopening it for append when its instrument comes back
+    size_t max_open_files = 256;
+    std::string output_path = "mbp_reconstruction.csv";
+    size_t queue_capacity = 1 << 14;
+};
+
+struct EngineStats {
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    size_t instruments = 0;
+};
+
+// Multi-instrument reconstruction: one book per (publisher_id, instrument_id),
+// instruments hashed onto worker threads, each fed by its own SPSC queue from
+// the calling (parser) thread. In merged mode a merge thread interleaves the
+// workers' rows back into input order. Book is LadderBook or L3Book.
+template <typename Book>
+bool run_engine(MboReader& reader, const EngineOptions& options, EngineStats* stats = nullptr);
+
+inline uint64_t instrument_key(const MboRecord& record) {
+    return (static_cast<uint64_t>(record.publisher_id) << 32) | record.instrument_id;
+}
@@ -0,0 +1,145 @@
+#include "instrumentation.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+
+namespace {
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadMetrics>>& registry() {
+    static std::vector<std::unique_ptr<ThreadMetrics>> threads;
+    return threads;
+}
+
+// TSC and clock at startup, for the cycles -> ns rate
+const uint64_t start_cycles = read_cycles();
+const uint64_t start_ns = monotonic_ns();
+
+const char* STAGE_NAMES[STAGE_COUNT] = {"parse", "tfc", "book", "depth", "snapshot", "format", "write"};
+const char* ACTION_NAMES[ACTION_KIND_COUNT] = {"A", "C", "T", "F", "R", "M", "other"};
+const char* ROW_NAMES[ROW_OUTCOME_COUNT] = {"emitted", "trade", "suppressed", "tfc_pending", "ignored"};
+
+double cycles_per_ns() {
+    uint64_t ns = monotonic_ns() - start_ns;
+    uint64_t cycles = read_cycles() - start_cycles;
+    if (ns < 1000000) {
+        // too early to tell; take a short sample
+        uint64_t c0 = read_cycles(), n0 = monotonic_ns();
+        while (monotonic_ns() - n0 < 1000000) {
+        }
+        cycles = read_cycles() - c0;
+        ns = monotonic_ns() - n0;
+    }
+    return static_cast<double>(cycles) / static_cast<double>(ns);
+}
+
+} // namespace
+
+ThreadMetrics* register_thread_metrics() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry().emplace_back(new ThreadMetrics());
+    return registry().back().get();
+}
+
+void reset_metrics() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto& metrics : registry()) {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            metrics->stage_cycles[i].reset();
+            metrics->stage_calls[i].reset();
+        }
+        for (auto& counter : metrics->actions) counter.reset();
+        for (auto& counter : metrics->rows) counter.reset();
+        metrics->max_bid_levels.reset();
+        metrics->max_ask_levels.reset();
+        metrics->max_orders.reset();
+    }
+}
+
+void write_metrics_json(std::ostream& out) {
+    uint64_t cycles[STAGE_COUNT] = {}, calls[STAGE_COUNT] = {};
+    uint64_t actions[ACTION_KIND_COUNT] = {}, rows[ROW_OUTCOME_COUNT] = {};
+    uint64_t max_bids = 0, max_asks = 0, max_orders = 0;
+    size_t threads = 0;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        threads = registry().size();
+        for (const auto& metrics : registry()) {
+            for (int i = 0; i < STAGE_COUNT; ++i) {
+                cycles[i] += metrics->stage_cycles[i].get();
+                calls[i] += metrics->stage_calls[i].get();
+            }
+            for (int i = 0; i < ACTION_KIND_COUNT; ++i) actions[i] += metrics->actions[i].get();
+            for (int i = 0; i < ROW_OUTCOME_COUNT; ++i) rows[i] += metrics->rows[i].get();
+            max_bids = std::max(max_bids, metrics->max_bid_levels.get());
+            max_asks = std::max(max_asks, metrics->max_ask_levels.get());
+            max_orders = std::max(max_orders, metrics->max_orders.get());
+        }
+    }
+    double rate = cycles_per_ns();
+
+    out << "{\n  \"enabled\": " << (OFA_INSTRUMENTATION ? "true" : "false")
+        << ",\n  \"threads\": " << threads
+        << ",\n  \"cycles_per_ns\": " << rate
+        << ",\n  \"stages\": {";
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        out << (i ? "," : "") << "\n    \"" << STAGE_NAMES[i] << "\": {\"calls\": " << calls[i]
+            << ", \"cycles\": " << cycles[i]
+            << ", \"ns\": " << static_cast<uint64_t>(static_cast<double>(cycles[i]) / rate)
+            << ", \"cycles_per_call\": " << (calls[i] ? static_cast<double>(cycles[i]) / calls[i] : 0.0) << "}";
+    }
+    out << "\n  },\n  \"actions\": {";
+    for (int i = 0; i < ACTION_KIND_COUNT; ++i) {
+        out << (i ? ", " : "") << "\"" << ACTION_NAMES[i] << "\": " << actions[i];
+    }
+    out << "},\n  \"rows\": {";
+    for (int i = 0; i < ROW_OUTCOME_COUNT; ++i) {
+        out << (i ? ", " : "") << "\"" << ROW_NAMES[i] << "\": " << rows[i];
+    }
+    out << "},\n  \"book_high_water\": {\"bid_levels\": " << max_bids << ", \"ask_levels\": " << max_asks
+        << ", \"orders\": " << max_orders << "}\n}\n";
+}
+
+bool write_metrics_file(const std::string& path) {
+    if (path == "-") {
+        write_metrics_json(std::cerr);
+        return true;
+    }
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        write_metrics_json(out);
+        if (!out.good()) {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool start_metrics_signal_thread(const std::string& path) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) {
+        return false;
+    }
+    std::thread([set, path]() {
+        while (true) {
+            int sig = 0;
+            if (sigwait(&set, &sig) == 0 && sig == SIGUSR1) {
+                write_metrics_file(path);
+            }
+        }
+    }).detach();
+    return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "latency_histogram.h"
+
+// Hot-path probes: per-stage cycle counts, per-action counters, row outcomes
+// and book size high-water marks, kept per thread and summed when dumped.
+// They are compiled in only with -DOFA_INSTRUMENTATION=1 (make INSTRUMENT=1);
+// otherwise every probe macro below compiles to nothing.
+#ifndef OFA_INSTRUMENTATION
+#define OFA_INSTRUMENTATION 0
+#endif
+
+enum Stage {
+    STAGE_PARSE,
+    STAGE_TFC,
+    STAGE_BOOK,         // add / cancel (and modify / clear on the L3 book)
+    STAGE_DEPTH,
+    STAGE_SNAPSHOT,
+    STAGE_FORMAT,
+    STAGE_WRITE,
+    STAGE_COUNT
+};
+
+enum ActionKind {
+    ACTION_KIND_ADD,
+    ACTION_KIND_CANCEL,
+    ACTION_KIND_TRADE,
+    ACTION_KIND_FILL,
+    ACTION_KIND_CLEAR,
+    ACTION_KIND_MODIFY,
+    ACTION_KIND_OTHER,
+    ACTION_KIND_COUNT
+};
+
+enum RowOutcome {
+    ROW_EMITTED,        // a row from an add/cancel within the published depth
+    ROW_TRADE,          // a trade row, written on the C of a T-F-C group
+    ROW_SUPPRESSED,     // applied to the book, but deeper than the published depth
+    ROW_TFC_PENDING,    // T or F waiting for its C
+    ROW_IGNORED,        // T with side N
+    ROW_OUTCOME_COUNT
+};
+
+// Counter written by one thread and read by any: relaxed loads and stores
+// compile to plain moves, so there is no locked instruction on the hot path.
+class RelaxedCounter {
+private:
+    std::atomic<uint64_t> value_{0};
+
+public:
+    void add(uint64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void raise(uint64_t n) {
+        if (n > value_.load(std::memory_order_relaxed)) value_.store(n, std::memory_order_relaxed);
+    }
+    void reset() { value_.store(0, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+};
+
+class StageTimer;
+
+struct ThreadMetrics {
+    RelaxedCounter stage_cycles[STAGE_COUNT];
+    RelaxedCounter stage_calls[STAGE_COUNT];
+    RelaxedCounter actions[ACTION_KIND_COUNT];
+    RelaxedCounter rows[ROW_OUTCOME_COUNT];
+    RelaxedCounter max_bid_levels;
+    RelaxedCounter max_ask_levels;
+    RelaxedCounter max_orders;
+    StageTimer* current = nullptr;      // innermost running timer, owner thread only
+};
+
+ThreadMetrics* register_thread_metrics();
+
+// this thread's counters, registered on first use and kept until exit
+inline ThreadMetrics& thread_metrics() {
+    thread_local ThreadMetrics* metrics = nullptr;
+    if (metrics == nullptr) {
+        metrics = register_thread_metrics();
+    }
+    return *metrics;
+}
+
+inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+// Times a scope into one stage. Timers nest: the time of an inner stage is
+// taken out of the enclosing one, so every stage reports its own cycles only.
+class StageTimer {
+private:
+    ThreadMetrics& metrics_;
+    StageTimer* parent_;
+    Stage stage_;
+    uint64_t start_;
+    uint64_t nested_ = 0;
+
+public:
+    explicit StageTimer(Stage stage) : metrics_(thread_metrics()), parent_(metrics_.current), stage_(stage) {
+        metrics_.current = this;
+        start_ = read_cycles();
+    }
+    ~StageTimer() {
+        uint64_t elapsed = read_cycles() - start_;
+        metrics_.stage_cycles[stage_].add(elapsed - nested_);
+        metrics_.stage_calls[stage_].add(1);
+        if (parent_ != nullptr) {
+            parent_->nested_ += elapsed;
+        }
+        metrics_.current = parent_;
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+inline void count_action(char action) {
+    ActionKind kind;
+    switch (action) {
+    case 'A': kind = ACTION_KIND_ADD; break;
+    case 'C': kind = ACTION_KIND_CANCEL; break;
+    case 'T': kind = ACTION_KIND_TRADE; break;
+    case 'F': kind = ACTION_KIND_FILL; break;
+    case 'R': kind = ACTION_KIND_CLEAR; break;
+    case 'M': kind = ACTION_KIND_MODIFY; break;
+    default: kind = ACTION_KIND_OTHER; break;
+    }
+    thread_metrics().actions[kind].add(1);
+}
+
+inline void note_book_levels(uint64_t bid_levels, uint64_t ask_levels, uint64_t orders) {
+    ThreadMetrics& metrics = thread_metrics();
+    metrics.max_bid_levels.raise(bid_levels);
+    metrics.max_ask_levels.raise(ask_levels);
+    metrics.max_orders.raise(orders);
+}
+
+#if OFA_INSTRUMENTATION
+#define OFA_STAGE_CONCAT_(a, b) a##b
+#define OFA_STAGE_NAME_(line) OFA_STAGE_CONCAT_(ofa_stage_timer_, line)
+#define OFA_STAGE(stage) StageTimer OFA_STAGE_NAME_(__LINE__)(stage)
+#define OFA_ACTION(action) count_action(action)
+#define OFA_ROW(outcome) thread_metrics().rows[outcome].add(1)
+#define OFA_BOOK_SIZE(bids, asks, orders) note_book_levels(bids, asks, orders)
+#else
+#define OFA_STAGE(stage) ((void)0)
+#define OFA_ACTION(action) ((void)0)
+#define OFA_ROW(outcome) ((void)0)
+#define OFA_BOOK_SIZE(bids, asks, orders) ((void)0)
+#endif
+
+// Sum of every thread's counters as one JSON object; cycles are also given
+// in ns using the TSC rate measured since startup.
+void write_metrics_json(std::ostream& out);
+// "-" writes to stderr; a file is written whole and renamed into place
+bool write_metrics_file(const std::string& path);
+// Dumps to path on every SIGUSR1, from a background thread that waits for
+// the signal. Call before any other thread starts so they all inherit the mask.
+bool start_metrics_signal_thread(const std::string& path);
+// zeroes every thread's counters (tests, or between runs in one process)
+void reset_metrics();
@@ -0,0 +1,220 @@
+#include "l3_book.h"
+#include <cstring>
+
+L3Book::L3Book(size_t expected_orders, size_t ladder_slots)
+    : orders_(expected_orders), queues_(1024), levels(ladder_slots) {
+    nodes_.reserve(expected_orders);
+}
+
+uint32_t L3Book::alloc_node() {
+    if (free_head_ != NIL_NODE) {
+        uint32_t index = free_head_;
+        free_head_ = nodes_[index].next;
+        return index;
+    }
+    nodes_.push_back(OrderNode());
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+// append to the back of its level queue
+void L3Book::link(uint32_t index) {
+    OrderNode& node = nodes_[index];
+    LevelQueue* queue = queues_.insert(level_key(node.price, node.side), LevelQueue());
+    node.prev = queue->tail;
+    node.next = NIL_NODE;
+    if (queue->tail != NIL_NODE) {
+        nodes_[queue->tail].next = index;
+    } else {
+        queue->head = index;
+    }
+    queue->tail = index;
+}
+
+void L3Book::unlink(uint32_t index) {
+    OrderNode& node = nodes_[index];
+    if (node.prev != NIL_NODE && node.next != NIL_NODE) {
+        nodes_[node.prev].next = node.next;
+        nodes_[node.next].prev = node.prev;
+        return;
+    }
+    uint64_t key = level_key(node.price, node.side);
+    LevelQueue* queue = queues_.find(key);
+    if (node.prev != NIL_NODE) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        queue->head = node.next;
+    }
+    if (node.next != NIL_NODE) {
+        nodes_[node.next].prev = node.prev;
+    } else {
+        queue->tail = node.prev;
+    }
+    if (queue->head == NIL_NODE) {
+        queues_.erase(key);
+    }
+}
+
+void L3Book::remove_order(uint32_t index) {
+    OrderNode& node = nodes_[index];
+    unlink(index);
+    orders_.erase(node.order_id);
+    node.next = free_head_;
+    free_head_ = index;
+}
+
+bool L3Book::add(uint64_t order_id, int64_t price, int32_t size, char side) {
+    if ((side != 'B' && side != 'A') || orders_.find(order_id) != nullptr) {
+        return false;
+    }
+    uint32_t index = alloc_node();
+    OrderNode& node = nodes_[index];
+    node.order_id = order_id;
+    node.price = price;
+    node.size = size;
+    node.side = side;
+    orders_.insert(order_id, index);
+    link(index);
+    levels.add(price, size, side);
+    return true;
+}
+
+bool L3Book::cancel(uint64_t order_id, int32_t size) {
+    const uint32_t* found = orders_.find(order_id);
+    if (found == nullptr) {
+        return false;
+    }
+    uint32_t index = *found;
+    OrderNode& node = nodes_[index];
+    LadderSide& ladder = (node.side == 'B') ? levels.bids : levels.asks;
+    if (size >= node.size) {
+        ladder.reduce(node.price, node.size, 1);
+        remove_order(index);
+    } else {
+        ladder.reduce(node.price, size, 0);
+        node.size -= size;
+    }
+    return true;
+}
+
+bool L3Book::modify(uint64_t order_id, int64_t price, int32_t size) {
+    const uint32_t* found = orders_.find(order_id);
+    if (found == nullptr) {
+        return false;
+    }
+    uint32_t index = *found;
+    OrderNode& node = nodes_[index];
+    LadderSide& ladder = (node.side == 'B') ? levels.bids : levels.asks;
+    if (size <= 0) {
+        ladder.reduce(node.price, node.size, 1);
+        remove_order(index);
+        return true;
+    }
+    if (price == node.price && size <= node.size) {
+        ladder.reduce(node.price, node.size - size, 0);
+        node.size = size;
+        return true;
+    }
+    ladder.reduce(node.price, node.size, 1);
+    unlink(index);
+    node.price = price;
+    node.size = size;
+    link(index);
+    ladder.add(price, size, 1);
+    return true;
+}
+
+void L3Book::clear() {
+    nodes_.clear();
+    free_head_ = NIL_NODE;
+    orders_.clear();
+    queues_.clear();
+    levels.clear();
+}
+
+namespace {
+
+struct SnapshotOrder {
+    uint64_t order_id;
+    int64_t price;
+    int32_t size;
+    char side;
+    char reserved[3];
+};
+
+} // namespace
+
+void L3Book::save_snapshot(std::string& out) const {
+    uint32_t n = static_cast<uint32_t>(orders_.size());
+    out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    queues_.for_each([&](uint64_t, const LevelQueue& queue) {
+        for (uint32_t i = queue.head; i != NIL_NODE; i = nodes_[i].next) {
+            const OrderNode& node = nodes_[i];
+            SnapshotOrder entry{node.order_id, node.price, node.size, node.side, {}};
+            out.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+    });
+}
+
+bool L3Book::load_snapshot(const char* data, size_t size, size_t* used) {
+    clear();
+    uint32_t n;
+    if (size < sizeof(n)) {
+        return false;
+    }
+    std::memcpy(&n, data, sizeof(n));
+    const char* p = data + sizeof(n);
+    if ((size - sizeof(n)) / sizeof(SnapshotOrder) < n) {
+        return false;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        SnapshotOrder entry;
+        std::memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        if (!add(entry.order_id, entry.price, entry.size, entry.side)) {
+            clear();
+            return false;
+        }
+    }
+    if (used != nullptr) {
+        *used = static_cast<size_t>(p - data);
+    }
+    return true;
+}
+
+const OrderNode* L3Book::find(uint64_t order_id) const {
+    const uint32_t* found = orders_.find(order_id);
+    return found == nullptr ? nullptr : &nodes_[*found];
+}
+
+int64_t L3Book::size_ahead(uint64_t order_id) const {
+    const uint32_t* found = orders_.find(order_id);
+    if (found == nullptr) {
+        return -1;
+    }
+    int64_t ahead = 0;
+    for (uint32_t i = nodes_[*found].prev; i != NIL_NODE; i = nodes_[i].prev) {
+        ahead += nodes_[i].size;
+    }
+    return ahead;
+}
+
+void apply_record(L3Book& book, const MboRecord& record) {
+    switch (record.action) {
+    case 'A':
+        book.add(record.order_id, record.price, record.size, record.side);
+        break;
+    case 'C':
+        book.cancel(record.order_id, record.size);
+        break;
+    case 'M':
+        if (!book.modify(record.order_id, record.price, record.size)) {
+            book.add(record.order_id, record.price, record.size, record.side);
+        }
+        break;
+    case 'R':
+        book.clear();
+        break;
+    default:
+        break;
+    }
+}
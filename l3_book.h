@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "mbo_reader.h"
+#include "ladder_book.h"
+
+static constexpr uint32_t NIL_NODE = UINT32_MAX;
+
+// Spreads every bit of key over the result (murmur3 finalizer style), so keys
+// that only differ in high bits or share a stride still land apart.
+inline uint64_t mix_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// Flat open-addressing hash table keyed on uint64 (linear probing, backward
+// shift deletion, so no tombstones). Kept at most half full.
+template <typename V>
+class FlatHashTable {
+private:
+    struct Slot {
+        uint64_t key;
+        V value;
+        bool used;
+    };
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_ = 0;
+
+    static size_t hash(uint64_t key) { return static_cast<size_t>(mix_key(key)); }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.assign(old.size() * 2, Slot{0, V(), false});
+        mask_ = slots_.size() - 1;
+        size_ = 0;
+        for (const Slot& slot : old) {
+            if (slot.used) {
+                insert(slot.key, slot.value);
+            }
+        }
+    }
+
+public:
+    explicit FlatHashTable(size_t capacity = 1024) {
+        size_t n = 16;
+        while (n < capacity * 2) n <<= 1;
+        slots_.assign(n, Slot{0, V(), false});
+        mask_ = n - 1;
+    }
+
+    size_t size() const { return size_; }
+
+    V* find(uint64_t key) {
+        for (size_t i = hash(key) & mask_; slots_[i].used; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) return &slots_[i].value;
+        }
+        return nullptr;
+    }
+
+    const V* find(uint64_t key) const {
+        return const_cast<FlatHashTable*>(this)->find(key);
+    }
+
+    // returns the existing value when the key is already present
+    V* insert(uint64_t key, const V& value) {
+        if ((size_ + 1) * 2 > slots_.size()) {
+            grow();
+        }
+        size_t i = hash(key) & mask_;
+        for (; slots_[i].used; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) return &slots_[i].value;
+        }
+        slots_[i] = Slot{key, value, true};
+        size_++;
+        return &slots_[i].value;
+    }
+
+    bool erase(uint64_t key) {
+        size_t i = hash(key) & mask_;
+        for (; slots_[i].used; i = (i + 1) & mask_) {
+            if (slots_[i].key == key) break;
+        }
+        if (!slots_[i].used) {
+            return false;
+        }
+        // shift back the rest of the cluster so lookups never see a hole
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask_; slots_[j].used; j = (j + 1) & mask_) {
+            size_t home = hash(slots_[j].key) & mask_;
+            if (((j - home) & mask_) >= ((j - hole) & mask_)) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole].used = false;
+        size_--;
+        return true;
+    }
+
+    void clear() {
+        for (Slot& slot : slots_) slot.used = false;
+        size_ = 0;
+    }
+
+    template <typename F>
+    void for_each(F&& f) const {
+        for (const Slot& slot : slots_) {
+            if (slot.used) f(slot.key, slot.value);
+        }
+    }
+};
+
+struct OrderNode {
+    uint64_t order_id;
+    int64_t price;
+    int32_t size;
+    char side;
+    uint32_t prev; // FIFO neighbours at the same price level
+    uint32_t next;
+};
+
+struct LevelQueue {
+    uint32_t head = NIL_NODE;
+    uint32_t tail = NIL_NODE;
+};
+
+// Per-order (L3) book. Orders live in a pooled node array indexed by an
+// order_id hash table, and each price level keeps its orders in a FIFO linked
+// list, so cancel/modify/fill never need a price lookup. Aggregated sizes and
+// counts are mirrored into a LadderBook, which is what depth and snapshots read.
+class L3Book {
+private:
+    std::vector<OrderNode> nodes_;
+    uint32_t free_head_ = NIL_NODE;
+    FlatHashTable<uint32_t> orders_;
+    FlatHashTable<LevelQueue> queues_;
+
+    static uint64_t level_key(int64_t price, char side) {
+        return (static_cast<uint64_t>(price) << 1) | (side == 'B' ? 1 : 0);
+    }
+    uint32_t alloc_node();
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void remove_order(uint32_t index);
+
+public:
+    LadderBook levels;
+
+    explicit L3Book(size_t expected_orders = 1 << 16, size_t ladder_slots = DEFAULT_LADDER_SLOTS);
+
+    bool add(uint64_t order_id, int64_t price, int32_t size, char side);
+    // reduces the resting order by size, removing it once nothing is left
+    bool cancel(uint64_t order_id, int32_t size);
+    // price change or size increase loses queue priority, a size decrease keeps it
+    bool modify(uint64_t order_id, int64_t price, int32_t size);
+    void clear();
+
+    // resting orders level by level in queue order; restoring re-adds them,
+    // which rebuilds the same queues and aggregated levels
+    void save_snapshot(std::string& out) const;
+    bool load_snapshot(const char* data, size_t size, size_t* used = nullptr);
+
+    const OrderNode* find(uint64_t order_id) const;
+    size_t order_count() const { return orders_.size(); }
+    // total resting size queued in front of the order at its price level
+    int64_t size_ahead(uint64_t order_id) const;
+    int calculate_depth(int64_t price, char side) const { return levels.calculate_depth(price, side); }
+};
+
+inline int64_t book_price(const L3Book&, int64_t price) { return price; }
+
+// A adds, C cancels, M modifies and R clears; T and F leave the book alone,
+// the following C carries the fill.
+void apply_record(L3Book& book, const MboRecord& record);
@@ -0,0 +1,378 @@
+#include "ladder_book.h"
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+// OrderBook::calculate_depth stops walking after 11 levels, keep the same cap
+static constexpr int DEPTH_SCAN_LIMIT = 11;
+
+LadderSide::LadderSide(bool is_bid, size_t capacity, int64_t tick)
+    : is_bid_(is_bid),
+      capacity_((capacity + 63) & ~static_cast<size_t>(63)),
+      tick_(tick),
+      levels_(capacity_),
+      occupied_(capacity_ / 64, 0),
+      best_slot_(capacity_) {}
+
+size_t LadderSide::next_occupied(size_t from) const {
+    if (from >= capacity_) {
+        return capacity_;
+    }
+    size_t word = from >> 6;
+    uint64_t bits = occupied_[word] & (~0ULL << (from & 63));
+    while (bits == 0) {
+        if (++word == occupied_.size()) {
+            return capacity_;
+        }
+        bits = occupied_[word];
+    }
+    return (word << 6) + static_cast<size_t>(__builtin_ctzll(bits));
+}
+
+// Re-lays out every level with the given tick, starting the window a little
+// before anchor_price so the touch can improve without another rebuild.
+void LadderSide::rebuild(int64_t new_tick, int64_t anchor_price) {
+    std::vector<std::pair<int64_t, PriceLevel>> all;
+    all.reserve(size());
+    for_each_level(static_cast<int>(size()), [&](int64_t price, const PriceLevel& level) {
+        all.emplace_back(price, level);
+    });
+    clear_storage();
+    tick_ = new_tick;
+    base_ = key_of(anchor_price) - static_cast<int64_t>(capacity_ / 8);
+    for (const auto& entry : all) {
+        level_for(entry.first) = entry.second;
+    }
+}
+
+// Slot (or overflow entry) for price, created empty if missing. The caller has
+// already made sure the price is on the tick grid and not better than the window.
+PriceLevel& LadderSide::level_for(int64_t price) {
+    int64_t key = key_of(price);
+    int64_t offset = key - base_;
+    if (offset >= static_cast<int64_t>(capacity_)) {
+        return overflow_[key];
+    }
+    size_t slot = static_cast<size_t>(offset);
+    if (!is_occupied(slot)) {
+        occupied_[slot >> 6] |= 1ULL << (slot & 63);
+        levels_[slot] = PriceLevel();
+        window_levels_++;
+        if (slot < best_slot_) {
+            best_slot_ = slot;
+        }
+    }
+    return levels_[slot];
+}
+
+void LadderSide::erase_level(int64_t key) {
+    int64_t offset = key - base_;
+    if (offset >= static_cast<int64_t>(capacity_)) {
+        overflow_.erase(key);
+        return;
+    }
+    size_t slot = static_cast<size_t>(offset);
+    occupied_[slot >> 6] &= ~(1ULL << (slot & 63));
+    levels_[slot] = PriceLevel();
+    window_levels_--;
+    if (slot == best_slot_) {
+        best_slot_ = next_occupied(slot + 1);
+    }
+    // keep the best levels in the window
+    if (window_levels_ == 0 && !overflow_.empty()) {
+        rebuild(tick_, price_of(overflow_.begin()->first));
+    }
+}
+
+// Moves the grid/window so price fits, then returns its level.
+PriceLevel& LadderSide::prepare(int64_t price) {
+    if (price % tick_ != 0) {
+        bool better = empty() || (is_bid_ ? price > best_price() : price < best_price());
+        rebuild(std::gcd(tick_, price), better ? price : best_price());
+    }
+    if (empty() && overflow_.empty()) {
+        base_ = key_of(price) - static_cast<int64_t>(capacity_ / 8);
+    } else if (key_of(price) < base_) {
+        rebuild(tick_, price);
+    }
+    return level_for(price);
+}
+
+void LadderSide::add(int64_t price, int32_t size, int32_t count) {
+    size_t before = this->size();
+    PriceLevel& level = prepare(price);
+    level.size += size;
+    level.count += count;
+    if (this->size() != before) {
+        top_insert(price, level);
+    } else {
+        top_update(price, level);
+    }
+}
+
+void LadderSide::reduce(int64_t price, int32_t size, int32_t count) {
+    size_t before = this->size();
+    PriceLevel& level = prepare(price);
+    bool created = this->size() != before;
+    level.size -= size;
+    level.count -= count;
+    if (level.size <= 0) {
+        erase_level(key_of(price));
+        if (!created) {
+            top_erase(price);
+        }
+    } else if (created) {
+        top_insert(price, level);
+    } else {
+        top_update(price, level);
+    }
+}
+
+void LadderSide::clear_storage() {
+    for (size_t slot = best_slot_; slot < capacity_; slot = next_occupied(slot + 1)) {
+        levels_[slot] = PriceLevel();
+    }
+    std::fill(occupied_.begin(), occupied_.end(), 0);
+    overflow_.clear();
+    window_levels_ = 0;
+    best_slot_ = capacity_;
+}
+
+void LadderSide::clear() {
+    clear_storage();
+    dirty_ |= (1u << top_.count) - 1;
+    top_ = TopLevels();
+}
+
+// first level strictly worse than price, false when there is none
+bool LadderSide::next_level_after(int64_t price, int64_t& next_price, PriceLevel& next_level) const {
+    int64_t key = key_of(price);
+    int64_t offset = key - base_;
+    if (offset < static_cast<int64_t>(capacity_)) {
+        size_t slot = next_occupied(offset < 0 ? 0 : static_cast<size_t>(offset) + 1);
+        if (slot < capacity_) {
+            next_price = price_of(base_ + static_cast<int64_t>(slot));
+            next_level = levels_[slot];
+            return true;
+        }
+        if (overflow_.empty()) {
+            return false;
+        }
+        next_price = price_of(overflow_.begin()->first);
+        next_level = overflow_.begin()->second;
+        return true;
+    }
+    auto it = overflow_.upper_bound(key);
+    if (it == overflow_.end()) {
+        return false;
+    }
+    next_price = price_of(it->first);
+    next_level = it->second;
+    return true;
+}
+
+// a new level appeared, shift it into the top if it belongs there
+void LadderSide::top_insert(int64_t price, const PriceLevel& level) {
+    int d = 0;
+    while (d < top_.count && better(top_.price[d], price)) {
+        d++;
+    }
+    if (d == TOP_LEVELS) {
+        return;
+    }
+    int last = (top_.count < TOP_LEVELS) ? top_.count : TOP_LEVELS - 1;
+    for (int i = last; i > d; --i) {
+        top_.price[i] = top_.price[i - 1];
+        top_.level[i] = top_.level[i - 1];
+    }
+    top_.price[d] = price;
+    top_.level[d] = level;
+    if (top_.count < TOP_LEVELS) {
+        top_.count++;
+    }
+    dirty_ |= ((1u << top_.count) - 1) & ~((1u << d) - 1);
+}
+
+void LadderSide::top_update(int64_t price, const PriceLevel& level) {
+    for (int d = 0; d < top_.count; ++d) {
+        if (top_.price[d] == price) {
+            top_.level[d] = level;
+            dirty_ |= 1u << d;
+            return;
+        }
+    }
+}
+
+// a level disappeared, close the gap and pull in the next level from the ladder
+void LadderSide::top_erase(int64_t price) {
+    int d = 0;
+    while (d < top_.count && top_.price[d] != price) {
+        d++;
+    }
+    if (d == top_.count) {
+        return;
+    }
+    int old_count = top_.count;
+    for (int i = d; i < old_count - 1; ++i) {
+        top_.price[i] = top_.price[i + 1];
+        top_.level[i] = top_.level[i + 1];
+    }
+    top_.count--;
+    top_.price[top_.count] = 0;
+    top_.level[top_.count] = PriceLevel();
+    if (old_count == TOP_LEVELS) {
+        int64_t next_price;
+        PriceLevel next_level;
+        bool found = false;
+        if (top_.count > 0) {
+            found = next_level_after(top_.price[top_.count - 1], next_price, next_level);
+        } else if (!empty()) {
+            next_price = best_price();
+            next_level = *find(next_price);
+            found = true;
+        }
+        if (found) {
+            top_.price[top_.count] = next_price;
+            top_.level[top_.count] = next_level;
+            top_.count++;
+        }
+    }
+    dirty_ |= ((1u << old_count) - 1) & ~((1u << d) - 1);
+}
+
+const PriceLevel* LadderSide::find(int64_t price) const {
+    if (price % tick_ != 0) {
+        return nullptr;
+    }
+    int64_t offset = key_of(price) - base_;
+    if (offset < 0) {
+        return nullptr;
+    }
+    if (offset >= static_cast<int64_t>(capacity_)) {
+        auto it = overflow_.find(key_of(price));
+        return it == overflow_.end() ? nullptr : &it->second;
+    }
+    size_t slot = static_cast<size_t>(offset);
+    return is_occupied(slot) ? &levels_[slot] : nullptr;
+}
+
+int LadderSide::depth_of(int64_t price, int limit) const {
+    // nearly always answered by one vector compare over the top levels; the
+    // walk below is only needed when every top level is better and there are more
+    int top_depth = count_better_prices(top_.price, top_.count, price, is_bid_);
+    if (top_depth < top_.count || size() == static_cast<size_t>(top_.count) || top_depth >= limit) {
+        return std::min(top_depth, limit);
+    }
+    if (limit == TOP_LEVELS + 1) {
+        int64_t next_price;
+        PriceLevel next_level;
+        bool deeper = next_level_after(top_.price[TOP_LEVELS - 1], next_price, next_level) && better(next_price, price);
+        return TOP_LEVELS + (deeper ? 1 : 0);
+    }
+
+    // a level is strictly better when its key is below ceil(signed price / tick)
+    int64_t signed_price = is_bid_ ? -price : price;
+    int64_t threshold = signed_price / tick_;
+    if (signed_price % tick_ != 0 && signed_price > 0) {
+        threshold++;
+    }
+    int depth = 0;
+    for (size_t slot = best_slot_; slot < capacity_; slot = next_occupied(slot + 1)) {
+        if (depth >= limit || base_ + static_cast<int64_t>(slot) >= threshold) {
+            return depth;
+        }
+        depth++;
+    }
+    for (auto it = overflow_.begin(); it != overflow_.end(); ++it) {
+        if (depth >= limit || it->first >= threshold) {
+            return depth;
+        }
+        depth++;
+    }
+    return depth;
+}
+
+void LadderBook::add(int64_t price, int32_t size, char side) {
+    if (side == 'B') {
+        bids.add(price, size, 1);
+    } else if (side == 'A') {
+        asks.add(price, size, 1);
+    }
+}
+
+void LadderBook::cancel(int64_t price, int32_t size, char side) {
+    if (side == 'B') {
+        bids.reduce(price, size, 1);
+    } else if (side == 'A') {
+        asks.reduce(price, size, 1);
+    }
+}
+
+void LadderBook::clear() {
+    bids.clear();
+    asks.clear();
+}
+
+int LadderBook::calculate_depth(int64_t price, char side) const {
+    if (side == 'B') {
+        return bids.depth_of(price, DEPTH_SCAN_LIMIT);
+    }
+    return asks.depth_of(price, DEPTH_SCAN_LIMIT);
+}
+
+namespace {
+
+struct SnapshotLevel {
+    int64_t price;
+    int32_t size;
+    int32_t count;
+};
+
+void save_side(const LadderSide& side, std::string& out) {
+    uint32_t n = static_cast<uint32_t>(side.size());
+    out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    side.for_each_level(static_cast<int>(n), [&](int64_t price, const PriceLevel& level) {
+        SnapshotLevel entry{price, level.size, level.count};
+        out.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    });
+}
+
+bool load_side(LadderSide& side, const char*& p, const char* end) {
+    uint32_t n;
+    if (static_cast<size_t>(end - p) < sizeof(n)) {
+        return false;
+    }
+    std::memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    if (static_cast<size_t>(end - p) / sizeof(SnapshotLevel) < n) {
+        return false;
+    }
+    side.clear();
+    for (uint32_t i = 0; i < n; ++i) {
+        SnapshotLevel entry;
+        std::memcpy(&entry, p, sizeof(entry));
+        p += sizeof(entry);
+        side.add(entry.price, entry.size, entry.count);
+    }
+    return true;
+}
+
+} // namespace
+
+void LadderBook::save_snapshot(std::string& out) const {
+    save_side(bids, out);
+    save_side(asks, out);
+}
+
+bool LadderBook::load_snapshot(const char* data, size_t size, size_t* used) {
+    const char* p = data;
+    if (!load_side(bids, p, data + size) || !load_side(asks, p, data + size)) {
+        clear();
+        return false;
+    }
+    if (used != nullptr) {
+        *used = static_cast<size_t>(p - data);
+    }
+    return true;
+}
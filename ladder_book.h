@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mbo_reader.h"
+
+static constexpr size_t DEFAULT_LADDER_SLOTS = 1 << 14;
+static constexpr int64_t DEFAULT_TICK = PRICE_SCALE / 100; // 0.01, refined on the fly
+
+static constexpr int TOP_LEVELS = 10;
+
+struct PriceLevel {
+    int32_t size = 0;
+    int32_t count = 0;
+};
+
+// Best TOP_LEVELS levels of one side, kept in place by LadderSide. Unused
+// entries stay zeroed so two tops compare equal slot by slot.
+struct TopLevels {
+    int64_t price[TOP_LEVELS] = {};
+    PriceLevel level[TOP_LEVELS];
+    int count = 0;
+
+    bool operator==(const TopLevels& other) const {
+        if (count != other.count) return false;
+        for (int i = 0; i < TOP_LEVELS; ++i) {
+            if (price[i] != other.price[i] || level[i].size != other.level[i].size ||
+                level[i].count != other.level[i].count) {
+                return false;
+            }
+        }
+        return true;
+    }
+    bool operator!=(const TopLevels& other) const { return !(*this == other); }
+};
+
+// One side of the book as a contiguous array of levels indexed by tick.
+// Levels are stored by "key", which is the tick index negated for bids, so a
+// lower key is always the better price on both sides. The window covers keys
+// [base_, base_ + capacity_) around the touch; anything worse than the window
+// spills into overflow_, anything better re-centers the window. A price that is
+// not a multiple of the current tick shrinks the tick to the gcd and rebuilds.
+class LadderSide {
+private:
+    bool is_bid_;
+    size_t capacity_;
+    int64_t tick_;
+    int64_t base_ = 0;
+    std::vector<PriceLevel> levels_;
+    std::vector<uint64_t> occupied_;
+    size_t window_levels_ = 0;
+    size_t best_slot_;
+    std::map<int64_t, PriceLevel> overflow_; // keys >= base_ + capacity_
+    TopLevels top_;
+    mutable uint32_t dirty_ = 0; // bit i set when top_ level i changed since the last take_dirty()
+
+    int64_t key_of(int64_t price) const { return is_bid_ ? -(price / tick_) : price / tick_; }
+    int64_t price_of(int64_t key) const { return (is_bid_ ? -key : key) * tick_; }
+    bool is_occupied(size_t slot) const { return (occupied_[slot >> 6] >> (slot & 63)) & 1; }
+    size_t next_occupied(size_t from) const;
+    PriceLevel& level_for(int64_t price);
+    PriceLevel& prepare(int64_t price);
+    void erase_level(int64_t key);
+    void rebuild(int64_t new_tick, int64_t anchor_price);
+    void clear_storage();
+    bool better(int64_t a, int64_t b) const { return is_bid_ ? a > b : a < b; }
+    bool next_level_after(int64_t price, int64_t& next_price, PriceLevel& next_level) const;
+    void top_insert(int64_t price, const PriceLevel& level);
+    void top_update(int64_t price, const PriceLevel& level);
+    void top_erase(int64_t price);
+
+public:
+    LadderSide(bool is_bid, size_t capacity = DEFAULT_LADDER_SLOTS, int64_t tick = DEFAULT_TICK);
+
+    // add never drops a level, reduce drops it once size <= 0 (same rules as OrderBook)
+    void add(int64_t price, int32_t size, int32_t count);
+    void reduce(int64_t price, int32_t size, int32_t count);
+    void clear();
+
+    const PriceLevel* find(int64_t price) const;
+    size_t size() const { return window_levels_ + overflow_.size(); }
+    bool empty() const { return window_levels_ == 0; }
+    int64_t best_price() const { return empty() ? UNDEF_PRICE : price_of(base_ + static_cast<int64_t>(best_slot_)); }
+    int64_t tick() const { return tick_; }
+    bool is_bid() const { return is_bid_; }
+
+    const TopLevels& top() const { return top_; }
+    // dirty top levels since the last call; consumed by the snapshot renderer
+    uint32_t take_dirty() const {
+        uint32_t dirty = dirty_;
+        dirty_ = 0;
+        return dirty;
+    }
+
+    // number of levels strictly better than price, stops counting at limit
+    int depth_of(int64_t price, int limit) const;
+
+    // calls f(price, level) for up to max_levels levels, best first
+    template <typename F>
+    void for_each_level(int max_levels, F&& f) const {
+        int n = 0;
+        for (size_t slot = best_slot_; slot < capacity_ && n < max_levels; slot = next_occupied(slot + 1)) {
+            f(price_of(base_ + static_cast<int64_t>(slot)), levels_[slot]);
+            n++;
+        }
+        for (auto it = overflow_.begin(); it != overflow_.end() && n < max_levels; ++it) {
+            f(price_of(it->first), it->second);
+            n++;
+        }
+    }
+};
+
+// Price ladder book keyed on integer prices (1e-9 units). Same behaviour as the
+// map based OrderBook, which stays around as the reference implementation.
+class LadderBook {
+public:
+    LadderSide bids;
+    LadderSide asks;
+
+    explicit LadderBook(size_t capacity = DEFAULT_LADDER_SLOTS, int64_t tick = DEFAULT_TICK)
+        : bids(true, capacity, tick), asks(false, capacity, tick) {}
+
+    void add(int64_t price, int32_t size, char side);
+    void cancel(int64_t price, int32_t size, char side);
+    void clear();
+    int calculate_depth(int64_t price, char side) const;
+
+    // same layout as OrderBook::save_snapshot with integer prices; restoring
+    // re-adds the levels, so the ladder window and tick may differ but the
+    // levels do not
+    void save_snapshot(std::string& out) const;
+    bool load_snapshot(const char* data, size_t size, size_t* used = nullptr);
+};
+
+inline int64_t book_price(const LadderBook&, int64_t price) { return price; }
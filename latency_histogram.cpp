@@ -0,0 +1,48 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    sum_ += other.sum_;
+    if (other.min_ < min_) min_ = other.min_;
+    if (other.max_ > max_) max_ = other.max_;
+}
+
+void LatencyHistogram::clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    total_ = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double pct) const {
+    if (total_ == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(pct / 100.0 * static_cast<double>(total_)));
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            return high < max_ ? high : max_;
+        }
+    }
+    return max_;
+}
+
+void LatencyHistogram::print(std::ostream& out) const {
+    out << "count=" << total_
+        << " min=" << min()
+        << " mean=" << static_cast<uint64_t>(mean())
+        << " p50=" << percentile(50.0)
+        << " p99=" << percentile(99.0)
+        << " p99.9=" << percentile(99.9)
+        << " max=" << max_;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+// CLOCK_MONOTONIC in ns; shared by every process on the host, so a stamp taken
+// by the replay tool can be compared with one taken by the reconstructor.
+inline uint64_t monotonic_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// HDR-style log-linear histogram of ns values. Values below 2^SUB_BITS are
+// counted exactly; above that every power of two is split into 2^(SUB_BITS-1)
+// buckets, so any recorded value is reported within 1/64 (~1.6%) of itself.
+// Recording is a couple of shifts and an increment, no allocation.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BITS = 7;
+    static constexpr uint64_t SUB_COUNT = 1u << SUB_BITS;
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+
+    static size_t bucket_of(uint64_t value) {
+        int exp = (value < SUB_COUNT) ? 0 : (64 - __builtin_clzll(value)) - SUB_BITS;
+        return (static_cast<size_t>(exp) << SUB_BITS) + static_cast<size_t>(value >> exp);
+    }
+    // largest value that lands in the bucket
+    static uint64_t bucket_high(size_t index) {
+        int exp = static_cast<int>(index >> SUB_BITS);
+        uint64_t sub = index & (SUB_COUNT - 1);
+        return ((sub + 1) << exp) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts_((64 - SUB_BITS + 1) << SUB_BITS) {}
+
+    void record(uint64_t value) {
+        counts_[bucket_of(value)]++;
+        total_++;
+        sum_ += value;
+        if (value < min_) min_ = value;
+        if (value > max_) max_ = value;
+    }
+
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ == 0 ? 0 : min_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(total_); }
+    // value at or below which pct percent of the recorded values fall, 0 when empty
+    uint64_t percentile(double pct) const;
+
+    // "count=... p50=... p99=... p99.9=... max=..." in ns
+    void print(std::ostream& out) const;
+};
@@ -0,0 +1,226 @@
+#include "mbo_reader.h"
+#include "instrumentation.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// delimiter scanning, 16 bytes at a time when SSE2 is available
+const char* find_delimiter(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma),
+                                                  _mm_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+const char* find_newline(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+uint64_t parse_uint(std::string_view s) {
+    uint64_t value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') break;
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return value;
+}
+
+int64_t parse_int(std::string_view s) {
+    if (!s.empty() && s[0] == '-') {
+        return -static_cast<int64_t>(parse_uint(s.substr(1)));
+    }
+    return static_cast<int64_t>(parse_uint(s));
+}
+
+// "5.510000000" -> 5510000000, empty -> UNDEF_PRICE; digits past 1e-9 are dropped
+int64_t parse_price(std::string_view s) {
+    if (s.empty()) {
+        return UNDEF_PRICE;
+    }
+    bool negative = false;
+    size_t i = 0;
+    if (s[0] == '-') {
+        negative = true;
+        i = 1;
+    }
+    int64_t whole = 0;
+    for (; i < s.size() && s[i] != '.'; ++i) {
+        whole = whole * 10 + (s[i] - '0');
+    }
+    int64_t frac = 0;
+    int64_t scale = PRICE_SCALE;
+    if (i < s.size()) {
+        for (++i; i < s.size() && scale > 1; ++i) {
+            frac = frac * 10 + (s[i] - '0');
+            scale /= 10;
+        }
+    }
+    int64_t value = whole * PRICE_SCALE + frac * scale;
+    return negative ? -value : value;
+}
+
+// days since 1970-01-01 for a proleptic gregorian date
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+static unsigned two_digits(const char* p) {
+    return static_cast<unsigned>((p[0] - '0') * 10 + (p[1] - '0'));
+}
+
+// accepts both ISO 8601 ("2025-07-17T07:05:09.035793433Z") and plain ns integers
+int64_t parse_timestamp(std::string_view s) {
+    if (s.size() < 19 || s[4] != '-' || s[10] != 'T') {
+        return parse_int(s);
+    }
+    const char* p = s.data();
+    int64_t year = static_cast<int64_t>(two_digits(p)) * 100 + two_digits(p + 2);
+    int64_t days = days_from_civil(year, two_digits(p + 5), two_digits(p + 8));
+    int64_t seconds = days * 86400 + two_digits(p + 11) * 3600 + two_digits(p + 14) * 60 + two_digits(p + 17);
+
+    int64_t nanos = 0;
+    int64_t scale = 1000000000;
+    if (s.size() > 19 && s[19] == '.') {
+        for (size_t i = 20; i < s.size() && s[i] >= '0' && s[i] <= '9' && scale > 1; ++i) {
+            nanos = nanos * 10 + (s[i] - '0');
+            scale /= 10;
+        }
+    }
+    return seconds * 1000000000 + nanos * scale;
+}
+
+void parse_mbo_record(const char* begin, const char* end, MboRecord& rec) {
+    if (end > begin && end[-1] == '\r') {
+        end--;
+    }
+    const char* p = begin;
+    for (int i = 0; i < MBO_FIELD_COUNT; ++i) {
+        if (p > end) {
+            rec.raw[i] = std::string_view();
+            continue;
+        }
+        const char* delim = find_delimiter(p, end);
+        rec.raw[i] = std::string_view(p, static_cast<size_t>(delim - p));
+        p = delim + 1;
+    }
+
+    std::string_view action = rec.raw[MBO_ACTION];
+    std::string_view side = rec.raw[MBO_SIDE];
+    rec.action = action.empty() ? 0 : action[0];
+    rec.side = side.empty() ? 0 : side[0];
+    rec.ts_recv = parse_timestamp(rec.raw[MBO_TS_RECV]);
+    rec.ts_event = parse_timestamp(rec.raw[MBO_TS_EVENT]);
+    rec.price = parse_price(rec.raw[MBO_PRICE]);
+    rec.size = static_cast<int32_t>(parse_int(rec.raw[MBO_SIZE]));
+    rec.order_id = parse_uint(rec.raw[MBO_ORDER_ID]);
+    rec.sequence = static_cast<uint32_t>(parse_uint(rec.raw[MBO_SEQUENCE]));
+    rec.instrument_id = static_cast<uint32_t>(parse_uint(rec.raw[MBO_INSTRUMENT_ID]));
+    rec.publisher_id = static_cast<uint16_t>(parse_uint(rec.raw[MBO_PUBLISHER_ID]));
+    rec.flags = static_cast<uint8_t>(parse_uint(rec.raw[MBO_FLAGS]));
+    rec.rtype = static_cast<uint8_t>(parse_uint(rec.raw[MBO_RTYPE]));
+    rec.channel_id = static_cast<uint8_t>(parse_uint(rec.raw[MBO_CHANNEL_ID]));
+    rec.ts_in_delta = static_cast<int32_t>(parse_int(rec.raw[MBO_TS_IN_DELTA]));
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    // mmap rejects a zero length; an empty file is an empty range
+    if (st.st_size == 0) {
+        ::close(fd);
+        data_ = "";
+        size_ = 0;
+        return true;
+    }
+    void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(addr);
+    size_ = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_ != nullptr) {
+        if (size_ > 0) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+bool MboReader::skip_header() {
+    if (cur_ >= end_) {
+        return false;
+    }
+    const char* eol = find_newline(cur_, end_);
+    cur_ = (eol < end_) ? eol + 1 : end_;
+    return true;
+}
+
+bool MboReader::next(MboRecord& rec) {
+    OFA_STAGE(STAGE_PARSE);
+    while (cur_ < end_) {
+        const char* eol = find_newline(cur_, end_);
+        const char* line = cur_;
+        cur_ = (eol < end_) ? eol + 1 : end_;
+        if (eol == line || (eol - line == 1 && *line == '\r')) {
+            continue; // blank line
+        }
+        parse_mbo_record(line, eol, rec);
+        return true;
+    }
+    return false;
+}
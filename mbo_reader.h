@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+// prices are fixed-point integers in units of 1e-9, same as Databento's native format
+static constexpr int64_t PRICE_SCALE = 1000000000;
+static constexpr int64_t UNDEF_PRICE = INT64_MAX;
+
+inline double price_to_double(int64_t price) {
+    return static_cast<double>(price) / static_cast<double>(PRICE_SCALE);
+}
+
+// column order of the mbo csv input
+enum MboField {
+    MBO_TS_RECV = 0,
+    MBO_TS_EVENT,
+    MBO_RTYPE,
+    MBO_PUBLISHER_ID,
+    MBO_INSTRUMENT_ID,
+    MBO_ACTION,
+    MBO_SIDE,
+    MBO_PRICE,
+    MBO_SIZE,
+    MBO_CHANNEL_ID,
+    MBO_ORDER_ID,
+    MBO_FLAGS,
+    MBO_TS_IN_DELTA,
+    MBO_SEQUENCE,
+    MBO_SYMBOL,
+    MBO_FIELD_COUNT
+};
+
+// Compact typed view of one mbo line. The typed fields are what the book needs,
+// the raw text points straight into the input buffer for columns we only echo back.
+struct MboRecord {
+    int64_t ts_recv = 0;        // ns since epoch
+    int64_t ts_event = 0;       // ns since epoch
+    int64_t price = UNDEF_PRICE;
+    int32_t size = 0;
+    uint64_t order_id = 0;
+    uint32_t sequence = 0;
+    uint32_t instrument_id = 0;
+    int32_t ts_in_delta = 0;
+    uint16_t publisher_id = 0;
+    uint8_t rtype = 0;
+    uint8_t channel_id = 0;
+    uint8_t flags = 0;
+    char action = 0;
+    char side = 0;
+
+    std::string_view raw[MBO_FIELD_COUNT];
+
+    std::string_view text(MboField field) const { return raw[field]; }
+    bool has_price() const { return price != UNDEF_PRICE; }
+};
+
+// Parsers for single fields, exposed for the other readers and for tests.
+int64_t parse_price(std::string_view s);
+int64_t parse_timestamp(std::string_view s);
+uint64_t parse_uint(std::string_view s);
+int64_t parse_int(std::string_view s);
+
+// Parse one line (without the trailing newline) into rec. Never allocates.
+void parse_mbo_record(const char* begin, const char* end, MboRecord& rec);
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char* path);
+    void close();
+    bool is_open() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// Line-by-line reader over an in-memory mbo csv buffer.
+class MboReader {
+private:
+    const char* cur_;
+    const char* end_;
+
+public:
+    MboReader(const char* begin, const char* end) : cur_(begin), end_(end) {}
+    explicit MboReader(const MappedFile& file) : cur_(file.data()), end_(file.data() + file.size()) {}
+
+    bool skip_header();
+    bool next(MboRecord& rec);
+    const char* position() const { return cur_; }
+};
+
+// Position of the next ',' or '\n' in [p, end), or end if there is none.
+const char* find_delimiter(const char* p, const char* end);
+// Position of the next '\n' in [p, end), or end if there is none.
+const char* find_newline(const char* p, const char* end);
@@ -0,0 +1,216 @@
+#include "mbo_reader.h"
+#include "dbn_format.h"
+#include "stream.h"
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+// Replays an mbo csv (or binary mbo file) into a stream endpoint as a
+// stand-in for a live feed, paced by ts_recv at 1x, Nx or as fast as the
+// consumer takes it. Each line gets its send time (monotonic ns) appended as
+// a 16th column, which the reconstructor turns into tick-to-mbp latency.
+//
+//   mbo_replay <mbo.csv|mbo.bin> [--to=-|PATH|tcp:PORT|unix:PATH] [--speed=N|max] [--no-stamp]
+
+static constexpr size_t MAX_BATCH_BYTES = 1 << 16;
+
+static bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// one csv line (without newline) and its ts_recv at a time, from either format
+class ReplaySource {
+private:
+    const char* cur_;
+    const char* end_;
+    DbnFile binary_;
+    bool is_binary_ = false;
+    std::unique_ptr<MboBinaryReader> binary_reader_;
+    MboRecord record_;
+    std::string text_;
+
+public:
+    bool open(const MappedFile& file) {
+        cur_ = file.data();
+        end_ = file.data() + file.size();
+        if (is_dbn_file(file.data(), file.size())) {
+            is_binary_ = true;
+            if (!binary_.open(file.data(), file.size()) || binary_.schema() != SCHEMA_MBO) {
+                return false;
+            }
+            binary_reader_.reset(new MboBinaryReader(binary_, true));
+        }
+        return true;
+    }
+
+    std::string_view header() {
+        if (is_binary_) {
+            return "ts_recv,ts_event,rtype,publisher_id,instrument_id,action,side,price,size,"
+                   "channel_id,order_id,flags,ts_in_delta,sequence,symbol";
+        }
+        std::string_view line;
+        int64_t ts;
+        next(line, ts);
+        return line;
+    }
+
+    bool next(std::string_view& line, int64_t& ts_recv) {
+        if (is_binary_) {
+            if (!binary_reader_->next(record_)) {
+                return false;
+            }
+            text_.clear();
+            for (int i = 0; i < MBO_FIELD_COUNT; ++i) {
+                if (i > 0) text_ += ',';
+                text_.append(record_.raw[i].data(), record_.raw[i].size());
+            }
+            line = text_;
+            ts_recv = record_.ts_recv;
+            return true;
+        }
+        while (cur_ < end_) {
+            const char* eol = find_newline(cur_, end_);
+            const char* begin = cur_;
+            cur_ = (eol < end_) ? eol + 1 : end_;
+            if (eol > begin && eol[-1] == '\r') {
+                eol--;
+            }
+            if (eol == begin) {
+                continue;
+            }
+            line = std::string_view(begin, static_cast<size_t>(eol - begin));
+            const char* comma = find_delimiter(begin, eol);
+            ts_recv = parse_timestamp(std::string_view(begin, static_cast<size_t>(comma - begin)));
+            return true;
+        }
+        return false;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: mbo_replay <mbo.csv|mbo.bin> [--to=ENDPOINT] [--speed=N|max] [--no-stamp]" << std::endl;
+        return 1;
+    }
+    std::string to = "-";
+    double speed = 1.0;     // 0 = max
+    bool stamp = true;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--to=", 5) == 0) {
+            to = argv[i] + 5;
+        } else if (std::strcmp(argv[i], "--speed=max") == 0) {
+            speed = 0;
+        } else if (std::strncmp(argv[i], "--speed=", 8) == 0) {
+            speed = std::atof(argv[i] + 8);
+            if (speed <= 0) {
+                std::cerr << "speed must be positive or max" << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--no-stamp") == 0) {
+            stamp = false;
+        } else {
+            std::cerr << "unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    MappedFile input;
+    ReplaySource source;
+    if (!input.open(argv[1]) || !source.open(input)) {
+        std::cerr << "Error opening " << argv[1] << std::endl;
+        return 1;
+    }
+    Endpoint endpoint;
+    if (!parse_endpoint(to, endpoint)) {
+        std::cerr << "bad endpoint: " << to << std::endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int fd = open_stream_output(endpoint);
+    if (fd < 0) {
+        std::cerr << "Error opening " << to << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::string batch(source.header());
+    batch += '\n';
+    bool ok = write_all(fd, batch.data(), batch.size());
+
+    // lines are collected until the next one is not due yet (or the batch is
+    // full), then stamped and sent with one write
+    std::string lines;
+    std::vector<size_t> line_ends;
+    auto flush = [&]() {
+        if (line_ends.empty()) {
+            return true;
+        }
+        char stamp_text[24];
+        size_t stamp_len = 0;
+        if (stamp) {
+            stamp_text[0] = ',';
+            stamp_len = static_cast<size_t>(uint_to_chars(stamp_text + 1, monotonic_ns()) - stamp_text);
+        }
+        batch.clear();
+        size_t begin = 0;
+        for (size_t end : line_ends) {
+            batch.append(lines, begin, end - begin);
+            batch.append(stamp_text, stamp_len);
+            batch += '\n';
+            begin = end;
+        }
+        lines.clear();
+        line_ends.clear();
+        return write_all(fd, batch.data(), batch.size());
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t first_ts = -1;
+    uint64_t records = 0;
+    std::string_view line;
+    int64_t ts;
+    while (ok && source.next(line, ts)) {
+        if (first_ts < 0) {
+            first_ts = ts;
+        }
+        if (speed > 0) {
+            auto due = start + std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(ts - first_ts) / speed));
+            if (due > std::chrono::steady_clock::now()) {
+                ok = flush();
+                std::this_thread::sleep_until(due);
+            }
+        }
+        lines.append(line.data(), line.size());
+        line_ends.push_back(lines.size());
+        records++;
+        if (lines.size() >= MAX_BATCH_BYTES) {
+            ok = ok && flush();
+        }
+    }
+    ok = ok && flush();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (fd != STDOUT_FILENO) {
+        ::close(fd);
+    }
+    if (!ok) {
+        std::cerr << "Error writing " << to << std::endl;
+        return 1;
+    }
+    std::cerr << "Replayed " << records << " records in " << elapsed.count() << " ms" << std::endl;
+    return 0;
+}
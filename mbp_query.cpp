@@ -0,0 +1,158 @@
+#include "time_index.h"
+#include "order_book.h"
+#include "l3_book.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Random access into a reconstructed run through the time index written by
+// reconstruction_xuanruli --index=PATH: the book as of a time, or the mbp rows
+// of a time range, without replaying the file from the top.
+//
+//   mbp_query <index> book <mbo.csv> <time> [--levels=N]
+//   mbp_query <index> rows <mbp.csv> <from> <to>
+//
+// Times are "2025-07-17T10:31:07.123Z", ns since epoch, or a time of day
+// ("10:31:07.123", UTC) on the day of the file's first record.
+
+// ts_event of the first data row; column is where ts_event sits in the csv
+static int64_t first_ts_event(const MappedFile& file, int column) {
+    const char* end = file.data() + file.size();
+    const char* p = find_newline(file.data(), end);
+    if (p == end) {
+        return 0;
+    }
+    p++;
+    for (int i = 0; i < column && p < end; ++i) {
+        p = find_delimiter(p, end) + 1;
+    }
+    if (p >= end) {
+        return 0;
+    }
+    return parse_timestamp(std::string_view(p, static_cast<size_t>(find_delimiter(p, end) - p)));
+}
+
+static void print_level(const char* side, int i, int64_t price, int64_t size, int64_t count) {
+    char text[32];
+    *level_price_to_chars(text, price) = '\0';
+    std::cout << side << ' ' << i << '\t' << text << '\t' << size << '\t' << count << '\n';
+}
+
+static void print_levels(const LadderBook& book, int levels) {
+    int i = 0;
+    book.asks.for_each_level(levels, [&](int64_t price, const PriceLevel& level) {
+        print_level("ask", i++, price, level.size, level.count);
+    });
+    i = 0;
+    book.bids.for_each_level(levels, [&](int64_t price, const PriceLevel& level) {
+        print_level("bid", i++, price, level.size, level.count);
+    });
+}
+
+static void print_levels(const L3Book& book, int levels) {
+    print_levels(book.levels, levels);
+    std::cout << "orders\t" << book.order_count() << '\n';
+}
+
+static void print_levels(const OrderBook& book, int levels) {
+    int i = 0;
+    for (auto it = book.asks.begin(); it != book.asks.end() && i < levels; ++it) {
+        print_level("ask", i++, parse_price(std::to_string(it->first)), it->second.first, it->second.second);
+    }
+    i = 0;
+    for (auto it = book.bids.begin(); it != book.bids.end() && i < levels; ++it) {
+        print_level("bid", i++, parse_price(std::to_string(it->first)), it->second.first, it->second.second);
+    }
+}
+
+template <typename Book>
+static bool query_book(const TimeIndex& index, const MappedFile& mbo, int64_t ts, int levels) {
+    auto start = std::chrono::steady_clock::now();
+    Book book;
+    StreamPosition position;
+    if (!book_at(index, mbo, ts, book, &position)) {
+        return false;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    print_levels(book, levels);
+    std::cerr << "book after " << position.records << " records, lookup "
+              << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 5) {
+        std::cerr << "usage: mbp_query <index> book <mbo.csv> <time> [--levels=N]\n"
+                  << "       mbp_query <index> rows <mbp.csv> <from> <to>" << std::endl;
+        return 1;
+    }
+    TimeIndex index;
+    if (!index.open(argv[1])) {
+        std::cerr << "not a time index: " << argv[1] << std::endl;
+        return 1;
+    }
+    MappedFile file;
+    if (!file.open(argv[3])) {
+        std::cerr << "Error opening " << argv[3] << std::endl;
+        return 1;
+    }
+    std::string mode = argv[2];
+
+    if (mode == "book") {
+        int levels = TOP_LEVELS;
+        for (int i = 5; i < argc; ++i) {
+            if (std::strncmp(argv[i], "--levels=", 9) == 0) {
+                levels = std::atoi(argv[i] + 9);
+            } else {
+                std::cerr << "unknown option: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        int64_t ts;
+        if (!parse_query_time(argv[4], first_ts_event(file, MBO_TS_EVENT), ts)) {
+            std::cerr << "bad time: " << argv[4] << std::endl;
+            return 1;
+        }
+        bool ok = false;
+        switch (index.book_kind()) {
+        case SNAPSHOT_MAP: ok = query_book<OrderBook>(index, file, ts, levels); break;
+        case SNAPSHOT_LADDER: ok = query_book<LadderBook>(index, file, ts, levels); break;
+        case SNAPSHOT_L3: ok = query_book<L3Book>(index, file, ts, levels); break;
+        }
+        if (!ok) {
+            std::cerr << "index does not match " << argv[3] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (mode == "rows" && argc == 6) {
+        int64_t day_of = first_ts_event(file, 2);
+        int64_t from, to;
+        if (!parse_query_time(argv[4], day_of, from) || !parse_query_time(argv[5], day_of, to)) {
+            std::cerr << "bad time range: " << argv[4] << " " << argv[5] << std::endl;
+            return 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        uint64_t rows = 0;
+        std::string text;
+        bool ok = rows_between(index, file, from, to, [&](std::string_view line) {
+            text.append(line.data(), line.size());
+            text += '\n';
+            rows++;
+        });
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (!ok) {
+            std::cerr << "index does not match " << argv[3] << std::endl;
+            return 1;
+        }
+        std::cout << text;
+        std::cerr << rows << " rows, lookup "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " us" << std::endl;
+        return 0;
+    }
+
+    std::cerr << "unknown query: " << mode << std::endl;
+    return 1;
+}
@@ -0,0 +1,417 @@
+#include "mbp_writer.h"
+#include "order_book.h"
+#include "instrumentation.h"
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+char* uint_to_chars(char* out, uint64_t value) {
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (value >= 100) {
+        unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10) {
+        unsigned pair = static_cast<unsigned>(value) * 2;
+        *--p = DIGIT_PAIRS[pair + 1];
+        *--p = DIGIT_PAIRS[pair];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+    size_t n = static_cast<size_t>(tmp + sizeof(tmp) - p);
+    std::memcpy(out, p, n);
+    return out + n;
+}
+
+char* int_to_chars(char* out, int64_t value) {
+    if (value < 0) {
+        *out++ = '-';
+        return uint_to_chars(out, 0 - static_cast<uint64_t>(value));
+    }
+    return uint_to_chars(out, static_cast<uint64_t>(value));
+}
+
+char* price_to_chars(char* out, int64_t price) {
+    if (price == UNDEF_PRICE) {
+        return out;
+    }
+    uint64_t magnitude = static_cast<uint64_t>(price);
+    if (price < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+    out = uint_to_chars(out, magnitude / PRICE_SCALE);
+    *out++ = '.';
+    uint64_t frac = magnitude % PRICE_SCALE;
+    if (frac == 0) {
+        *out++ = '0';
+        return out;
+    }
+    // 9 fractional digits, then drop the trailing zeros
+    char digits[9];
+    for (int i = 8; i >= 0; --i) {
+        digits[i] = static_cast<char>('0' + frac % 10);
+        frac /= 10;
+    }
+    int len = 9;
+    while (digits[len - 1] == '0') {
+        len--;
+    }
+    std::memcpy(out, digits, static_cast<size_t>(len));
+    return out + len;
+}
+
+char* level_price_to_chars(char* out, int64_t price) {
+    if (price == UNDEF_PRICE || price % 1000 == 0) {
+        return price_to_chars(out, price);
+    }
+    // finer than a micro: take std::to_string's own rounding of the double
+    char text[64];
+    int len = std::snprintf(text, sizeof(text), "%f", price_to_double(price));
+    while (text[len - 1] == '0' && text[len - 2] != '.') {
+        len--;
+    }
+    std::memcpy(out, text, static_cast<size_t>(len));
+    return out + len;
+}
+
+char* price_to_chars_fixed(char* out, int64_t price) {
+    if (price == UNDEF_PRICE) {
+        return out;
+    }
+    uint64_t magnitude = static_cast<uint64_t>(price);
+    if (price < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+    out = uint_to_chars(out, magnitude / PRICE_SCALE);
+    *out++ = '.';
+    uint64_t frac = magnitude % PRICE_SCALE;
+    for (int i = 8; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + frac % 10);
+        frac /= 10;
+    }
+    return out + 9;
+}
+
+static char* two_digits_to_chars(char* out, unsigned value) {
+    out[0] = DIGIT_PAIRS[value * 2];
+    out[1] = DIGIT_PAIRS[value * 2 + 1];
+    return out + 2;
+}
+
+char* timestamp_to_chars(char* out, int64_t ns) {
+    int64_t seconds = ns / 1000000000;
+    int64_t nanos = ns % 1000000000;
+    if (nanos < 0) {
+        nanos += 1000000000;
+        seconds--;
+    }
+    int64_t days = seconds / 86400;
+    int64_t secs_of_day = seconds % 86400;
+    if (secs_of_day < 0) {
+        secs_of_day += 86400;
+        days--;
+    }
+    // civil date from days since 1970-01-01
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    const int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+
+    out = two_digits_to_chars(out, static_cast<unsigned>(year / 100));
+    out = two_digits_to_chars(out, static_cast<unsigned>(year % 100));
+    *out++ = '-';
+    out = two_digits_to_chars(out, month);
+    *out++ = '-';
+    out = two_digits_to_chars(out, day);
+    *out++ = 'T';
+    out = two_digits_to_chars(out, static_cast<unsigned>(secs_of_day / 3600));
+    *out++ = ':';
+    out = two_digits_to_chars(out, static_cast<unsigned>(secs_of_day / 60 % 60));
+    *out++ = ':';
+    out = two_digits_to_chars(out, static_cast<unsigned>(secs_of_day % 60));
+    *out++ = '.';
+    for (int i = 8; i >= 0; --i) {
+        out[i] = static_cast<char>('0' + nanos % 10);
+        nanos /= 10;
+    }
+    out += 9;
+    *out++ = 'Z';
+    return out;
+}
+
+OutputBuffer::OutputBuffer(size_t capacity) : capacity_(capacity) {
+    buffers_[0].resize(capacity_);
+    buffers_[1].resize(capacity_);
+    cur_ = buffers_[0].data();
+    end_ = cur_ + capacity_;
+}
+
+OutputBuffer::~OutputBuffer() {
+    close();
+}
+
+bool OutputBuffer::open(const char* path) {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    attach(fd);
+    owns_fd_ = true;
+    return true;
+}
+
+bool OutputBuffer::open_at(const char* path, uint64_t offset) {
+    int fd = ::open(path, O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    off_t size = ::lseek(fd, 0, SEEK_END);
+    if (size < static_cast<off_t>(offset) || ::ftruncate(fd, static_cast<off_t>(offset)) != 0 ||
+        ::lseek(fd, static_cast<off_t>(offset), SEEK_SET) < 0) {
+        ::close(fd);
+        return false;
+    }
+    attach(fd);
+    owns_fd_ = true;
+    handed_off_ = offset;
+    return true;
+}
+
+void OutputBuffer::attach(int fd) {
+    fd_ = fd;
+    owns_fd_ = false;
+    handed_off_ = 0;
+}
+
+void OutputBuffer::start_async() {
+    if (async_) {
+        return;
+    }
+    async_ = true;
+    stopping_ = false;
+    writer_ = std::thread(&OutputBuffer::writer_loop, this);
+}
+
+void OutputBuffer::write_all(const char* data, size_t size) {
+    OFA_STAGE(STAGE_WRITE);
+    while (size > 0 && !failed_) {
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed_ = true;
+            return;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void OutputBuffer::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return pending_size_ > 0 || stopping_; });
+        if (pending_size_ == 0 && stopping_) {
+            return;
+        }
+        const char* data = buffers_[pending_index_].data();
+        size_t size = pending_size_;
+        lock.unlock();
+        write_all(data, size);
+        lock.lock();
+        pending_size_ = 0;
+        cv_.notify_all();
+    }
+}
+
+// hand the filled buffer to the disk (directly or via the writer thread)
+// and continue in an empty one with room for at least need bytes
+void OutputBuffer::swap_buffers(size_t need) {
+    char* begin = buffers_[active_].data();
+    size_t used = static_cast<size_t>(cur_ - begin);
+    handed_off_ += used;
+    if (!async_) {
+        write_all(begin, used);
+    } else if (used > 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return pending_size_ == 0; });
+        pending_index_ = active_;
+        pending_size_ = used;
+        active_ = 1 - active_;
+        cv_.notify_all();
+    }
+    std::vector<char>& buffer = buffers_[active_];
+    if (buffer.size() < need) {
+        buffer.resize(need);
+    }
+    cur_ = buffer.data();
+    end_ = cur_ + buffer.size();
+}
+
+void OutputBuffer::flush() {
+    swap_buffers(0);
+    if (async_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return pending_size_ == 0; });
+    }
+}
+
+uint64_t OutputBuffer::offset() {
+    flush();
+    off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+    return pos < 0 ? 0 : static_cast<uint64_t>(pos);
+}
+
+bool OutputBuffer::write_at(uint64_t offset, const void* data, size_t size) {
+    flush();
+    const char* p = static_cast<const char*>(data);
+    while (size > 0 && !failed_) {
+        ssize_t n = ::pwrite(fd_, p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            failed_ = true;
+            break;
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+    return !failed_;
+}
+
+bool OutputBuffer::close() {
+    if (fd_ < 0) {
+        return !failed_;
+    }
+    flush();
+    if (async_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        writer_.join();
+        async_ = false;
+    }
+    if (owns_fd_) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+    return !failed_;
+}
+
+void MbpCsvWriter::write_header() {
+    out_.append(mbp_header_line());
+}
+
+void MbpRowRenderer::render_levels(const TopLevels* tops[2], const uint32_t dirty_masks[2]) {
+    OFA_STAGE(STAGE_SNAPSHOT);
+    for (int s = 0; s < 2; ++s) {
+        uint32_t dirty = dirty_masks[s];
+        if (!levels_ready_) {
+            dirty = (1u << TOP_LEVELS) - 1;
+        }
+        const TopLevels& top = *tops[s];
+        for (; dirty != 0; dirty &= dirty - 1) {
+            int i = __builtin_ctz(dirty);
+            char* begin = level_text_[s][i];
+            char* p = begin;
+            if (i < top.count) {
+                p = level_price_to_chars(p, top.price[i]);
+            }
+            *p++ = ',';
+            p = int_to_chars(p, top.level[i].size);
+            *p++ = ',';
+            p = int_to_chars(p, top.level[i].count);
+            level_len_[s][i] = static_cast<uint8_t>(p - begin);
+        }
+    }
+    levels_ready_ = true;
+}
+
+static char* put(char* p, std::string_view s) {
+    std::memcpy(p, s.data(), s.size());
+    return p + s.size();
+}
+
+size_t MbpRowRenderer::max_row_size(const MboRecord& record) {
+    size_t need = 256 + 2 * TOP_LEVELS * LEVEL_TEXT_MAX;
+    for (const std::string_view& field : record.raw) {
+        need += 2 * field.size();
+    }
+    return need;
+}
+
+char* MbpRowRenderer::render(char* p, const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+    uint32_t dirty[2] = {book.bids.take_dirty(), book.asks.take_dirty()};
+    return render(p, record, book.bids.top(), book.asks.top(), dirty, rowIndex, is_trade, depth);
+}
+
+char* MbpRowRenderer::render(char* p, const MboRecord& record, const TopLevels& bids, const TopLevels& asks,
+                             const uint32_t dirty[2], int rowIndex, bool is_trade, int depth) {
+    OFA_STAGE(STAGE_FORMAT);
+    const TopLevels* tops[2] = {&bids, &asks};
+    render_levels(tops, dirty);
+
+    p = int_to_chars(p, rowIndex);
+    *p++ = ',';
+    p = put(p, record.text(MBO_TS_EVENT));
+    *p++ = ',';
+    p = put(p, record.text(MBO_TS_EVENT));
+    p = put(p, ",10,");
+    p = put(p, record.text(MBO_PUBLISHER_ID));
+    *p++ = ',';
+    p = put(p, record.text(MBO_INSTRUMENT_ID));
+    *p++ = ',';
+    p = put(p, is_trade ? std::string_view("T") : record.text(MBO_ACTION));
+    *p++ = ',';
+    p = put(p, record.text(MBO_SIDE));
+    *p++ = ',';
+    p = int_to_chars(p, depth);
+    *p++ = ',';
+    p = price_to_chars(p, record.price);
+    *p++ = ',';
+    p = put(p, record.text(MBO_SIZE));
+    *p++ = ',';
+    p = put(p, record.text(MBO_FLAGS));
+    *p++ = ',';
+    p = put(p, record.text(MBO_TS_IN_DELTA));
+    *p++ = ',';
+    p = put(p, record.text(MBO_SEQUENCE));
+
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        *p++ = ',';
+        p = put(p, std::string_view(level_text_[0][i], level_len_[0][i]));
+        *p++ = ',';
+        p = put(p, std::string_view(level_text_[1][i], level_len_[1][i]));
+    }
+
+    *p++ = ',';
+    p = put(p, record.text(MBO_SYMBOL));
+    *p++ = ',';
+    p = put(p, record.text(MBO_ORDER_ID));
+    *p++ = '\n';
+    return p;
+}
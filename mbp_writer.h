@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "mbo_reader.h"
+#include "ladder_book.h"
+#include "l3_book.h"
+
+static constexpr size_t DEFAULT_OUTPUT_BUFFER = 1 << 20;
+
+// Integer/price to ascii, return the end of the written text. price_to_chars
+// writes the shortest decimal form with at least one fractional digit ("14.0",
+// "13.575"), which is what remove_trailing_zeros() makes of the mbo price text.
+char* uint_to_chars(char* out, uint64_t value);
+char* int_to_chars(char* out, int64_t value);
+char* price_to_chars(char* out, int64_t price);
+// book level prices as the map book prints them, remove_trailing_zeros(
+// std::to_string(double)): rounded to 6 decimals, so 5.510000123 is "5.51"
+char* level_price_to_chars(char* out, int64_t price);
+// all 9 fractional digits, the way the mbo csv prints prices ("5.510000000")
+char* price_to_chars_fixed(char* out, int64_t price);
+// ns since epoch as "2025-07-17T08:05:03.360677248Z"
+char* timestamp_to_chars(char* out, int64_t ns);
+
+// Large reusable byte buffer written to a file descriptor in big blocks.
+// In async mode a background thread writes the full buffer while the caller
+// keeps filling a second one.
+class OutputBuffer {
+private:
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    size_t capacity_;
+    std::vector<char> buffers_[2];
+    int active_ = 0;
+    char* cur_;
+    char* end_;
+    bool failed_ = false;
+    uint64_t handed_off_ = 0;   // bytes passed to write_all or the writer thread, plus the open_at offset
+
+    bool async_ = false;
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int pending_index_ = 0;
+    size_t pending_size_ = 0; // bytes of buffers_[pending_index_] waiting for the writer
+    bool stopping_ = false;
+
+    void write_all(const char* data, size_t size);
+    void writer_loop();
+    void swap_buffers(size_t need);
+
+public:
+    explicit OutputBuffer(size_t capacity = DEFAULT_OUTPUT_BUFFER);
+    ~OutputBuffer();
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    bool open(const char* path);
+    // keeps the first offset bytes of an existing file and appends after them
+    bool open_at(const char* path, uint64_t offset);
+    void attach(int fd);
+    void start_async();
+    void flush();
+    // flush, then overwrite size bytes at offset (for headers patched at the end)
+    bool write_at(uint64_t offset, const void* data, size_t size);
+    // flush, then the number of bytes in the file
+    uint64_t offset();
+    // what offset() would return, without flushing
+    uint64_t tell() const { return handed_off_ + static_cast<uint64_t>(cur_ - buffers_[active_].data()); }
+    bool close();
+    bool failed() const { return failed_; }
+
+    // make room for n bytes and return where to write them; commit() the new end
+    char* reserve(size_t n) {
+        if (static_cast<size_t>(end_ - cur_) < n) {
+            swap_buffers(n);
+        }
+        return cur_;
+    }
+    void commit(char* new_cur) { cur_ = new_cur; }
+
+    void append(std::string_view s) {
+        char* p = reserve(s.size());
+        std::memcpy(p, s.data(), s.size());
+        commit(p + s.size());
+    }
+};
+
+// Renders MBP-10 csv rows into caller-provided memory. The text of each top
+// level is cached and only re-rendered when the book marks it dirty, so one
+// renderer belongs to one book.
+class MbpRowRenderer {
+private:
+    static constexpr size_t LEVEL_TEXT_MAX = 64;
+
+    char level_text_[2][TOP_LEVELS][LEVEL_TEXT_MAX];
+    uint8_t level_len_[2][TOP_LEVELS];
+    bool levels_ready_ = false;
+
+    void render_levels(const TopLevels* tops[2], const uint32_t dirty[2]);
+
+public:
+    // upper bound on the bytes render() writes for this record
+    static size_t max_row_size(const MboRecord& record);
+    char* render(char* p, const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth);
+    // from copies of the top levels and their dirty masks, for renderers that do not own the book
+    char* render(char* p, const MboRecord& record, const TopLevels& bids, const TopLevels& asks,
+                 const uint32_t dirty[2], int rowIndex, bool is_trade, int depth);
+    char* render(char* p, const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        return render(p, record, book.levels, rowIndex, is_trade, depth);
+    }
+};
+
+// MBP-10 csv rows written straight into an OutputBuffer.
+class MbpCsvWriter {
+private:
+    OutputBuffer& out_;
+    MbpRowRenderer renderer_;
+
+public:
+    explicit MbpCsvWriter(OutputBuffer& out) : out_(out) {}
+
+    void write_header();
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+        char* p = out_.reserve(MbpRowRenderer::max_row_size(record));
+        out_.commit(renderer_.render(p, record, book, rowIndex, is_trade, depth));
+    }
+    void write_row(const MboRecord& record, const L3Book& book, int rowIndex, bool is_trade, int depth) {
+        write_row(record, book.levels, rowIndex, is_trade, depth);
+    }
+};
@@ -0,0 +1,270 @@
+#include "multi_file.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include "dbn_format.h"
+#include "latency_histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <glob.h>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+
+namespace {
+
+// one worker's jobs, largest first; the owner and thieves both take the front
+class JobQueue {
+private:
+    std::mutex mutex_;
+    std::deque<size_t> jobs_;
+
+public:
+    void push(size_t job) { jobs_.push_back(job); }
+    bool peek(size_t& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.empty()) {
+            return false;
+        }
+        job = jobs_.front();
+        return true;
+    }
+    bool pop(size_t& job) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (jobs_.empty()) {
+            return false;
+        }
+        job = jobs_.front();
+        jobs_.pop_front();
+        return true;
+    }
+};
+
+const char* OUTPUT_SUFFIX = ".mbp.csv";
+
+bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+uint64_t file_size(const std::string& path) {
+    struct stat st;
+    return (::stat(path.c_str(), &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+std::string default_output(const std::string& input, const std::string& output_dir) {
+    size_t slash = input.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "" : input.substr(0, slash + 1);
+    std::string name = (slash == std::string::npos) ? input : input.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0) {
+        name.resize(dot);
+    }
+    if (!output_dir.empty()) {
+        dir = output_dir;
+        if (dir.back() != '/') dir += '/';
+    }
+    return dir + name + OUTPUT_SUFFIX;
+}
+
+template <typename Book, typename Reader>
+bool reconstruct_file(Reader& reader, FileJob& job) {
+    if constexpr (std::is_same<Book, OrderBook>::value) {
+        std::ofstream outFile(job.output);
+        if (!outFile.is_open()) {
+            return false;
+        }
+        write_mbp_header(outFile);
+        FormatterSink formatter(outFile);
+        CountingSink<FormatterSink> sink(formatter);
+        Reconstructor<Book, CountingSink<FormatterSink>> reconstructor(sink);
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+            job.records++;
+        }
+        job.rows = sink.rows;
+        outFile.close();
+        return !outFile.fail();
+    } else {
+        OutputBuffer out;
+        if (!out.open(job.output.c_str())) {
+            return false;
+        }
+        MbpCsvWriter writer(out);
+        writer.write_header();
+        CountingSink<MbpCsvWriter> sink(writer);
+        Reconstructor<Book, CountingSink<MbpCsvWriter>> reconstructor(sink);
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+            job.records++;
+        }
+        job.rows = sink.rows;
+        return out.close();
+    }
+}
+
+template <typename Book>
+bool run_job(FileJob& job) {
+    MappedFile input;
+    if (!input.open(job.input.c_str())) {
+        return false;
+    }
+    if (is_dbn_file(input.data(), input.size())) {
+        DbnFile file;
+        if (!file.open(input.data(), input.size()) || file.schema() != SCHEMA_MBO) {
+            return false;
+        }
+        MboBinaryReader reader(file, true);
+        return reconstruct_file<Book>(reader, job);
+    }
+    MboReader reader(input);
+    reader.skip_header();
+    return reconstruct_file<Book>(reader, job);
+}
+
+} // namespace
+
+bool collect_file_jobs(const std::string& spec, const FileJobOptions& options, std::vector<FileJob>& jobs,
+                       std::string& error) {
+    jobs.clear();
+    if (!spec.empty() && spec[0] == '@') {
+        std::ifstream manifest(spec.substr(1));
+        if (!manifest.is_open()) {
+            error = "cannot read manifest " + spec.substr(1);
+            return false;
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#') {
+                continue;
+            }
+            size_t end = line.find_first_of(" \t\r", begin);
+            FileJob job;
+            job.input = line.substr(begin, end - begin);
+            size_t out_begin = (end == std::string::npos) ? end : line.find_first_not_of(" \t\r", end);
+            if (out_begin != std::string::npos) {
+                size_t out_end = line.find_first_of(" \t\r", out_begin);
+                job.output = line.substr(out_begin, out_end - out_begin);
+            }
+            jobs.push_back(job);
+        }
+    } else {
+        glob_t matches;
+        if (::glob(spec.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                FileJob job;
+                job.input = matches.gl_pathv[i];
+                // an earlier run's output next to its input is not an input
+                if (ends_with(job.input, OUTPUT_SUFFIX)) {
+                    continue;
+                }
+                jobs.push_back(job);
+            }
+        }
+        ::globfree(&matches);
+    }
+    if (jobs.empty()) {
+        error = "no input files match " + spec;
+        return false;
+    }
+
+    std::set<std::string> inputs, outputs;
+    for (FileJob& job : jobs) {
+        if (job.output.empty()) {
+            job.output = default_output(job.input, options.output_dir);
+        }
+        job.bytes = file_size(job.input);
+        inputs.insert(job.input);
+    }
+    for (const FileJob& job : jobs) {
+        if (inputs.count(job.output) != 0 || !outputs.insert(job.output).second) {
+            error = "more than one job writes " + job.output;
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Book>
+bool run_file_jobs(std::vector<FileJob>& jobs, const FileJobOptions& options, FileJobStats* stats) {
+    uint64_t start = monotonic_ns();
+    int workers = options.workers > 0 ? options.workers : static_cast<int>(std::thread::hardware_concurrency());
+    workers = std::max(1, std::min(workers, static_cast<int>(jobs.size())));
+
+    // largest first, dealt round-robin so every worker starts on a big one
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&jobs](size_t a, size_t b) { return jobs[a].bytes > jobs[b].bytes; });
+    std::unique_ptr<JobQueue[]> queues(new JobQueue[workers]);
+    for (size_t i = 0; i < order.size(); ++i) {
+        queues[i % workers].push(order[i]);
+    }
+
+    std::atomic<uint64_t> steals{0};
+    auto work = [&](int self) {
+        while (true) {
+            size_t job = 0;
+            bool found = queues[self].pop(job);
+            // out of work: steal the largest job still queued, which is the
+            // front of one of the other queues; retry if another thief got it first
+            while (!found) {
+                int victim = -1;
+                uint64_t largest = 0;
+                for (int i = 1; i < workers; ++i) {
+                    int q = (self + i) % workers;
+                    size_t front = 0;
+                    if (queues[q].peek(front) && (victim < 0 || jobs[front].bytes > largest)) {
+                        victim = q;
+                        largest = jobs[front].bytes;
+                    }
+                }
+                if (victim < 0) {
+                    return;     // nothing is queued anywhere and no job adds more
+                }
+                found = queues[victim].pop(job);
+                if (found) steals.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint64_t job_start = monotonic_ns();
+            jobs[job].worker = self;
+            jobs[job].ok = run_job<Book>(jobs[job]);
+            jobs[job].seconds = static_cast<double>(monotonic_ns() - job_start) / 1e9;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int w = 1; w < workers; ++w) {
+        threads.emplace_back(work, w);
+    }
+    work(0);
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    bool ok = true;
+    FileJobStats totals;
+    for (const FileJob& job : jobs) {
+        totals.files++;
+        totals.failed += job.ok ? 0 : 1;
+        totals.bytes += job.bytes;
+        totals.records += job.records;
+        totals.rows += job.rows;
+        ok = ok && job.ok;
+    }
+    totals.steals = steals.load();
+    totals.seconds = static_cast<double>(monotonic_ns() - start) / 1e9;
+    if (stats != nullptr) {
+        *stats = totals;
+    }
+    return ok;
+}
+
+template bool run_file_jobs<OrderBook>(std::vector<FileJob>&, const FileJobOptions&, FileJobStats*);
+template bool run_file_jobs<LadderBook>(std::vector<FileJob>&, const FileJobOptions&, FileJobStats*);
+template bool run_file_jobs<L3Book>(std::vector<FileJob>&, const FileJobOptions&, FileJobStats*);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Many independent reconstructions in one process, e.g. a night's worth of
+// per-symbol, per-day mbo files. Each file is one job with its own output;
+// jobs are dealt largest-first onto per-worker queues and a worker that runs
+// out steals the largest job still queued elsewhere, so one huge file does
+// not leave the other cores idle once the small ones are done.
+
+struct FileJob {
+    std::string input;
+    std::string output;
+    uint64_t bytes = 0;
+    // filled in by run_file_jobs
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    double seconds = 0;
+    int worker = -1;
+    bool ok = false;
+};
+
+struct FileJobOptions {
+    int workers = 0;            // 0 = one per hardware thread
+    std::string output_dir;     // empty = next to each input
+};
+
+struct FileJobStats {
+    size_t files = 0;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    uint64_t steals = 0;
+    double seconds = 0;         // wall time of the whole batch
+};
+
+// "@PATH" reads a manifest (one input per line, optionally followed by its
+// output path; blank lines and # comments skipped), anything else is a glob,
+// whose *.mbp.csv matches are skipped so a rerun does not take in its own outputs.
+// Inputs without an output path get <output_dir or their own dir>/<stem>.mbp.csv.
+// Fails with a message in error on no inputs or two jobs writing one file.
+bool collect_file_jobs(const std::string& spec, const FileJobOptions& options, std::vector<FileJob>& jobs,
+                       std::string& error);
+
+// Runs every job (csv or binary mbo input, csv output) and fills in its
+// counters. False if any job failed; the others still run to the end.
+// Book is OrderBook (rendered by MBPFormatter), LadderBook or L3Book.
+template <typename Book>
+bool run_file_jobs(std::vector<FileJob>& jobs, const FileJobOptions& options, FileJobStats* stats = nullptr);
@@ -1,5 +1,9 @@
 #include "order_book.h"
+#include "simd_kernels.h"
+#include <array>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iomanip>
 
 const MboRow parse_line_to_mbo(const std::string& line) {
@@ -22,8 +26,12 @@ const MboRow parse_line_to_mbo(const std::string& line) {
 void process_header_line(std::ifstream& inFile, std::ofstream& outFile) {
     std::string line;
     std::getline(inFile, line); // skip the mbo header
+    write_mbp_header(outFile);
+}
 
+std::string mbp_header_line(int depth) {
     // header line
+    std::string header;
     std::vector<std::string> baseColumns = {
         "ts_recv", "ts_event", "rtype", "publisher_id",
         "instrument_id", "action", "side", "depth", "price", "size", 
@@ -31,19 +39,26 @@ void process_header_line(std::ifstream& inFile, std::ofstream& outFile) {
     };
     
     for (const auto& col : baseColumns) {
-        outFile << "," << col;
+        header += "," + col;
     }
     
-    for (int i = 0; i < 10; ++i) {
-        std::string suffix = "0" + std::to_string(i);
-        outFile << ",bid_px_" << suffix << ",bid_sz_" << suffix << ",bid_ct_" << suffix;
-        outFile << ",ask_px_" << suffix << ",ask_sz_" << suffix << ",ask_ct_" << suffix;
+    for (int i = 0; i < depth; ++i) {
+        std::string suffix = (i < 10 ? "0" : "") + std::to_string(i);
+        header += ",bid_px_" + suffix + ",bid_sz_" + suffix + ",bid_ct_" + suffix;
+        header += ",ask_px_" + suffix + ",ask_sz_" + suffix + ",ask_ct_" + suffix;
     }
     
-    outFile << ",symbol,order_id" << std::endl;
+    header += ",symbol,order_id\n";
+    return header;
 }
 
-void OrderBook::add(double price, int size, char side) {
+void write_mbp_header(std::ofstream& outFile, int depth) {
+    outFile << mbp_header_line(depth);
+    outFile.flush();
+}
+
+template <int Depth>
+void BasicOrderBook<Depth>::add(double price, int size, char side) {
     if (side == 'B') {
         auto& bucket = bids[price]; 
         bucket.first += size;
@@ -55,7 +70,8 @@ void OrderBook::add(double price, int size, char side) {
     }
 }
 
-void OrderBook::cancel(double price, int size, char side) {
+template <int Depth>
+void BasicOrderBook<Depth>::cancel(double price, int size, char side) {
     if (side == 'B') {
         auto& bucket = bids[price];
         bucket.first -= size;
@@ -70,15 +86,81 @@ void OrderBook::cancel(double price, int size, char side) {
     }
 }
 
-int OrderBook::calculate_depth(std::string price, char side) const {
+namespace {
+
+struct SnapshotLevel {
+    double price;
+    int32_t size;
+    int32_t count;
+};
+
+template <typename Map>
+void save_side(const Map& side, std::string& out) {
+    uint32_t n = static_cast<uint32_t>(side.size());
+    out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    for (const auto& bucket : side) {
+        SnapshotLevel level{bucket.first, bucket.second.first, bucket.second.second};
+        out.append(reinterpret_cast<const char*>(&level), sizeof(level));
+    }
+}
+
+template <typename Map>
+bool load_side(Map& side, const char*& p, const char* end) {
+    uint32_t n;
+    if (static_cast<size_t>(end - p) < sizeof(n)) {
+        return false;
+    }
+    std::memcpy(&n, p, sizeof(n));
+    p += sizeof(n);
+    if (static_cast<size_t>(end - p) / sizeof(SnapshotLevel) < n) {
+        return false;
+    }
+    side.clear();
+    for (uint32_t i = 0; i < n; ++i) {
+        SnapshotLevel level;
+        std::memcpy(&level, p, sizeof(level));
+        p += sizeof(level);
+        side.emplace_hint(side.end(), level.price, std::make_pair(level.size, level.count));
+    }
+    return true;
+}
+
+} // namespace
+
+template <int Depth>
+void BasicOrderBook<Depth>::save_snapshot(std::string& out) const {
+    save_side(bids, out);
+    save_side(asks, out);
+}
+
+template <int Depth>
+bool BasicOrderBook<Depth>::load_snapshot(const char* data, size_t size, size_t* used) {
+    const char* p = data;
+    if (!load_side(bids, p, data + size) || !load_side(asks, p, data + size)) {
+        bids.clear();
+        asks.clear();
+        return false;
+    }
+    if (used != nullptr) {
+        *used = static_cast<size_t>(p - data);
+    }
+    return true;
+}
+
+template <int Depth>
+int BasicOrderBook<Depth>::calculate_depth(std::string price, char side) const {
     if (price.empty()){
         return 0;
     }
-    double price_double = std::stod(price);
+    return calculate_depth(std::stod(price), side);
+}
+
+template <int Depth>
+int BasicOrderBook<Depth>::calculate_depth(double price_double, char side) const {
     if (side == 'B') {
         int depth = 0;
         for (const auto& bucket : bids) {
-            if (depth > 10) break;
+            if (depth > Depth) break;
             if (price_double >= bucket.first) {
                 return depth;
             }
@@ -88,7 +170,7 @@ int OrderBook::calculate_depth(std::string price, char side) const {
     } else { 
         int depth = 0;
         for (const auto& bucket : asks) {
-            if (depth > 10) break;
+            if (depth > Depth) break;
             if (price_double <= bucket.first) { 
                 return depth;
             }
@@ -100,13 +182,34 @@ int OrderBook::calculate_depth(std::string price, char side) const {
 
 
 // MBPFormatter class implementations
-std::string MBPFormatter::remove_trailing_zeros(const std::string& s) {
+template <int Depth>
+std::string BasicMBPFormatter<Depth>::remove_trailing_zeros(std::string_view s) {
     if (s.empty()) {
         return "";
     }
     size_t dot_pos = s.find('.');
-    if (dot_pos == std::string::npos) {
-        return s + ".0"; 
+    if (dot_pos == std::string_view::npos) {
+        return std::string(s) + ".0"; 
+    }
+    size_t last_not_zero = s.find_last_not_of('0');
+    if (last_not_zero == dot_pos) {
+        return std::string(s.substr(0, dot_pos + 2));
+    }
+    return std::string(s.substr(0, last_not_zero + 1));
+}
+
+// same text as remove_trailing_zeros, in the row arena
+template <int Depth>
+std::string_view BasicMBPFormatter<Depth>::trim_trailing_zeros(std::string_view s) {
+    if (s.empty()) {
+        return s;
+    }
+    size_t dot_pos = s.find('.');
+    if (dot_pos == std::string_view::npos) {
+        char* p = arena_.allocate_chars(s.size() + 2);
+        std::memcpy(p, s.data(), s.size());
+        std::memcpy(p + s.size(), ".0", 2);
+        return std::string_view(p, s.size() + 2);
     }
     size_t last_not_zero = s.find_last_not_of('0');
     if (last_not_zero == dot_pos) {
@@ -115,14 +218,15 @@ std::string MBPFormatter::remove_trailing_zeros(const std::string& s) {
     return s.substr(0, last_not_zero + 1);
 }
 
-std::vector<std::string> MBPFormatter::generate_top_10_snapshot(const OrderBook& book) {
-    std::vector<std::string> row(60);
+template <int Depth>
+typename BasicMBPFormatter<Depth>::Snapshot BasicMBPFormatter<Depth>::generate_top_10_snapshot(const BasicOrderBook<Depth>& book) {
+    Snapshot row;
     auto bid_iterator = book.bids.begin();
     auto ask_iterator = book.asks.begin();
     
-    for (int i = 0; i < 10; ++i) {
+    for (int i = 0; i < Depth; ++i) {
         int startIdx = i * 6;
-        if (i < book.bids.size()){
+        if (static_cast<size_t>(i) < book.bids.size()){
             row[startIdx] = remove_trailing_zeros(std::to_string(bid_iterator->first));
             row[startIdx + 1] = std::to_string(bid_iterator->second.first);
             row[startIdx + 2] = std::to_string(bid_iterator->second.second);
@@ -132,7 +236,7 @@ std::vector<std::string> MBPFormatter::generate_top_10_snapshot(const OrderBook&
             row[startIdx + 1] = "0";
             row[startIdx + 2] = "0";
         }
-        if (i < book.asks.size()){
+        if (static_cast<size_t>(i) < book.asks.size()){
             row[startIdx + 3] = remove_trailing_zeros(std::to_string(ask_iterator->first));
             row[startIdx + 4] = std::to_string(ask_iterator->second.first);
             row[startIdx + 5] = std::to_string(ask_iterator->second.second);
@@ -145,17 +249,103 @@ std::vector<std::string> MBPFormatter::generate_top_10_snapshot(const OrderBook&
     }
     return row;
 }
-  
 
-void MBPFormatter::generate_mbp_row(std::ofstream& outFile, const MboRow& mboRow, 
-                                   const OrderBook& book, int rowIndex, bool is_trade) {
-    std::vector<std::string> row(76);
-    std::vector<std::string> current_snapshot = generate_top_10_snapshot(book);
+
+template <int Depth>
+typename BasicMBPFormatter<Depth>::Snapshot BasicMBPFormatter<Depth>::generate_top_10_snapshot(const LadderBook& book) {
+    static_assert(Depth == TOP_LEVELS, "the ladder keeps TOP_LEVELS levels");
+    Snapshot row;
+    const TopLevels& bids = book.bids.top();
+    const TopLevels& asks = book.asks.top();
+    for (int i = 0; i < 10; ++i) {
+        int startIdx = i * 6;
+        if (i < bids.count) {
+            row[startIdx] = remove_trailing_zeros(std::to_string(price_to_double(bids.price[i])));
+        }
+        row[startIdx + 1] = std::to_string(bids.level[i].size);
+        row[startIdx + 2] = std::to_string(bids.level[i].count);
+        if (i < asks.count) {
+            row[startIdx + 3] = remove_trailing_zeros(std::to_string(price_to_double(asks.price[i])));
+        }
+        row[startIdx + 4] = std::to_string(asks.level[i].size);
+        row[startIdx + 5] = std::to_string(asks.level[i].count);
+    }
+    return row;
+}
+
+template <int Depth>
+void BasicMBPFormatter<Depth>::render_level(const TopLevels& top, int i, std::string& out) {
+    out.clear();
+    if (i < top.count) {
+        out += remove_trailing_zeros(std::to_string(price_to_double(top.price[i])));
+    }
+    out += ',';
+    out += std::to_string(top.level[i].size);
+    out += ',';
+    out += std::to_string(top.level[i].count);
+}
+
+// generate_top_10_snapshot's text without the snapshot strings: prices are
+// printed like std::to_string into the row arena, sizes and counts streamed
+template <int Depth>
+void BasicMBPFormatter<Depth>::append_snapshot(std::ofstream& outFile, const BasicOrderBook<Depth>& book) {
+    OFA_STAGE(STAGE_SNAPSHOT);
+    auto bid_iterator = book.bids.begin();
+    auto ask_iterator = book.asks.begin();
+    auto price_text = [this](double price) {
+        char* p = arena_.allocate_chars(32);
+        int n = std::snprintf(p, 32, "%f", price);
+        return trim_trailing_zeros(std::string_view(p, static_cast<size_t>(n)));
+    };
+    for (int i = 0; i < Depth; ++i) {
+        if (bid_iterator != book.bids.end()) {
+            outFile << ',' << price_text(bid_iterator->first) << ',' << bid_iterator->second.first
+                    << ',' << bid_iterator->second.second;
+            ++bid_iterator;
+        } else {
+            outFile << ",,0,0";
+        }
+        if (ask_iterator != book.asks.end()) {
+            outFile << ',' << price_text(ask_iterator->first) << ',' << ask_iterator->second.first
+                    << ',' << ask_iterator->second.second;
+            ++ask_iterator;
+        } else {
+            outFile << ",,0,0";
+        }
+    }
+}
+
+template <int Depth>
+void BasicMBPFormatter<Depth>::append_snapshot(std::ofstream& outFile, const LadderBook& book) {
+    OFA_STAGE(STAGE_SNAPSHOT);
+    static_assert(Depth == TOP_LEVELS, "the ladder keeps TOP_LEVELS levels");
+    const LadderSide* sides[2] = {&book.bids, &book.asks};
+    for (int s = 0; s < 2; ++s) {
+        uint32_t dirty = sides[s]->take_dirty();
+        if (!level_text_ready_) {
+            dirty = (1u << TOP_LEVELS) - 1;
+        }
+        for (; dirty != 0; dirty &= dirty - 1) {
+            int i = __builtin_ctz(dirty);
+            render_level(sides[s]->top(), i, level_text_[s][i]);
+        }
+    }
+    level_text_ready_ = true;
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        outFile << ',' << level_text_[0][i] << ',' << level_text_[1][i];
+    }
+}  
+
+template <int Depth>
+void BasicMBPFormatter<Depth>::generate_mbp_row(std::ofstream& outFile, const MboRow& mboRow, 
+                                   const BasicOrderBook<Depth>& book, int rowIndex, bool is_trade) {
+    std::array<std::string, ROW_FIELDS> row;
+    Snapshot current_snapshot = generate_top_10_snapshot(book);
 
     row[0] = std::to_string(rowIndex);
     row[1] = mboRow.ts_event;
     row[2] = mboRow.ts_event;
-    row[3] = "10";
+    row[3] = std::to_string(Depth);
     row[4] = mboRow.publisher_id;
     row[5] = mboRow.instrument_id;
     row[6] = (is_trade) ? "T" : mboRow.action;
@@ -173,17 +363,46 @@ void MBPFormatter::generate_mbp_row(std::ofstream& outFile, const MboRow& mboRow
         bookIndex++;
     }
 
-    row[74] = mboRow.symbol;
-    row[75] = mboRow.order_id;
+    row[ROW_FIELDS - 2] = mboRow.symbol;
+    row[ROW_FIELDS - 1] = mboRow.order_id;
 
     for (size_t i = 0; i < row.size(); ++i) {
         outFile << row[i] << (i == row.size() - 1 ? "\n" : ",");
     }
 }
 
-bool MBPFormatter::check_snapshot_changed(std::vector<std::string>& previous_snapshot, 
-                                         const OrderBook& book) {
-    std::vector<std::string> current_snapshot = generate_top_10_snapshot(book);
+// same row as above, but echo fields are written straight from the input buffer
+template <int Depth>
+template <typename AnyBook>
+void BasicMBPFormatter<Depth>::generate_mbp_row(std::ofstream& outFile, const MboRecord& record,
+                                   const AnyBook& book, int rowIndex, bool is_trade) {
+    OFA_STAGE(STAGE_FORMAT);
+    int depth = record_depth(book, record);
+
+    outFile << rowIndex << ','
+            << record.text(MBO_TS_EVENT) << ','
+            << record.text(MBO_TS_EVENT) << ','
+            << Depth << ','
+            << record.text(MBO_PUBLISHER_ID) << ','
+            << record.text(MBO_INSTRUMENT_ID) << ','
+            << (is_trade ? ACTION_TRADE : record.text(MBO_ACTION)) << ','
+            << record.text(MBO_SIDE) << ','
+            << depth << ','
+            << trim_trailing_zeros(record.text(MBO_PRICE)) << ','
+            << record.text(MBO_SIZE) << ','
+            << record.text(MBO_FLAGS) << ','
+            << record.text(MBO_TS_IN_DELTA) << ','
+            << record.text(MBO_SEQUENCE);
+
+    append_snapshot(outFile, book);
+    outFile << ',' << record.text(MBO_SYMBOL) << ',' << record.text(MBO_ORDER_ID) << '\n';
+    arena_.reset();
+}
+
+template <int Depth>
+bool BasicMBPFormatter<Depth>::check_snapshot_changed(Snapshot& previous_snapshot, 
+                                         const BasicOrderBook<Depth>& book) {
+    Snapshot current_snapshot = generate_top_10_snapshot(book);
     if (previous_snapshot == current_snapshot) {
         return false;
     } else {
@@ -192,7 +411,8 @@ bool MBPFormatter::check_snapshot_changed(std::vector<std::string>& previous_sna
     }
 }
 
-bool MBPFormatter::handle_tfc_cases(const MboRow& currentRow, OrderBook& orderBook, std::ofstream& outFile, MBPFormatter& formatter, int& cached_tfc_rows, int& rowIndex){
+template <int Depth>
+bool BasicMBPFormatter<Depth>::handle_tfc_cases(const MboRow& currentRow, BasicOrderBook<Depth>& orderBook, std::ofstream& outFile, BasicMBPFormatter& formatter, int& cached_tfc_rows, int& rowIndex){
     if (currentRow.action == ACTION_TRADE && currentRow.side == SIDE_NONE) {
         return true;
     }
@@ -212,8 +432,21 @@ bool MBPFormatter::handle_tfc_cases(const MboRow& currentRow, OrderBook& orderBo
     return false;
 }
 
+template <int Depth>
+bool BasicMBPFormatter<Depth>::check_snapshot_changed(TopLevels& previous_bids, TopLevels& previous_asks,
+                                         const LadderBook& book) {
+    static_assert(Depth == TOP_LEVELS, "the ladder keeps TOP_LEVELS levels");
+    if (top_levels_equal(previous_bids, book.bids.top()) && top_levels_equal(previous_asks, book.asks.top())) {
+        return false;
+    }
+    previous_bids = book.bids.top();
+    previous_asks = book.asks.top();
+    return true;
+}
+
 // a helper function to help me debug and check the order book
-void MBPFormatter::print_book(const OrderBook& book) const {
+template <int Depth>
+void BasicMBPFormatter<Depth>::print_book(const BasicOrderBook<Depth>& book) const {
     // print asks
     std::vector<std::pair<double, std::pair<int, int>>> temp_asks;
     for (const auto& ask_level : book.asks) {
@@ -226,8 +459,8 @@ void MBPFormatter::print_book(const OrderBook& book) const {
     } else {
         int count = 0;
         for (auto it = temp_asks.rbegin(); it != temp_asks.rend(); ++it) {
-            if (count == 10) {
-                std::cout << "  ******** End of Top 10 ********" << std::endl;
+            if (count == Depth) {
+                std::cout << "  ******** End of Top " << Depth << " ********" << std::endl;
             }
             std::cout << "  [" << count << "]\t"
                       << "Price: " << it->first
@@ -245,8 +478,8 @@ void MBPFormatter::print_book(const OrderBook& book) const {
     } else {
         int count = 0;
         for (const auto& bid_level : book.bids) {
-            if (count == 10) {
-                std::cout << "  ******** End of Top 10 ********" << std::endl;
+            if (count == Depth) {
+                std::cout << "  ******** End of Top " << Depth << " ********" << std::endl;
             }
             std::cout << "  [" << count << "]\t"
                       << "Price: " << bid_level.first
@@ -256,4 +489,27 @@ void MBPFormatter::print_book(const OrderBook& book) const {
         }
     }
     std::cout << "====================================" << std::endl;
-} 
\ No newline at end of file
+} 
+
+// MBP-10 serves every book; the other depths only exist for the map book
+template class BasicOrderBook<MAX_BOOK_DEPTH>;
+template class BasicMBPFormatter<MAX_BOOK_DEPTH>;
+template void MBPFormatter::generate_mbp_row<OrderBook>(std::ofstream&, const MboRecord&, const OrderBook&, int, bool);
+template void MBPFormatter::generate_mbp_row<LadderBook>(std::ofstream&, const MboRecord&, const LadderBook&, int, bool);
+template void MBPFormatter::generate_mbp_row<L3Book>(std::ofstream&, const MboRecord&, const L3Book&, int, bool);
+
+#define INSTANTIATE_MAP_DEPTH(D)                                                                                   \
+    template class BasicOrderBook<D>;                                                                              \
+    template BasicMBPFormatter<D>::Snapshot BasicMBPFormatter<D>::generate_top_10_snapshot(                      \
+        const BasicOrderBook<D>&);                                                                                 \
+    template void BasicMBPFormatter<D>::generate_mbp_row(std::ofstream&, const MboRow&, const BasicOrderBook<D>&, \
+                                                         int, bool);                                              \
+    template void BasicMBPFormatter<D>::generate_mbp_row<BasicOrderBook<D>>(std::ofstream&, const MboRecord&,     \
+                                                                            const BasicOrderBook<D>&, int, bool); \
+    template bool BasicMBPFormatter<D>::check_snapshot_changed(BasicMBPFormatter<D>::Snapshot&,                  \
+                                                               const BasicOrderBook<D>&);                         \
+    template void BasicMBPFormatter<D>::print_book(const BasicOrderBook<D>&) const;
+
+INSTANTIATE_MAP_DEPTH(1)
+INSTANTIATE_MAP_DEPTH(5)
+INSTANTIATE_MAP_DEPTH(20)
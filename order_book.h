@@ -5,14 +5,24 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <array>
 #include <map>
 #include <chrono>
+#include <string_view>
+#include "mbo_reader.h"
+#include "ladder_book.h"
+#include "l3_book.h"
+#include "pool_allocator.h"
+#include "instrumentation.h"
 
 static constexpr const char* ACTION_TRADE = "T";
 static constexpr const char* ACTION_ADD = "A"; 
 static constexpr const char* ACTION_CANCEL = "C";
 static constexpr const char* ACTION_FILL = "F";
 static constexpr const char* SIDE_NONE = "N";
+// levels published by the reference path; BasicOrderBook and BasicMBPFormatter
+// take the depth as a template argument (MBP-1, 5, 10 and 20 are built) and
+// OrderBook / MBPFormatter are the MBP-10 variants
 static constexpr int MAX_BOOK_DEPTH = 10;
 
 struct MboRow {
@@ -33,30 +43,118 @@ struct MboRow {
     std::string symbol;
 };
 
-class OrderBook {
+// price levels come out of one node pool per book, so adding and removing
+// levels stops touching the heap once the pool has grown to the book's size
+using LevelAllocator = PoolAllocator<std::pair<const double, std::pair<int, int>>>;
+using BidLevels = std::map<double, std::pair<int, int>, std::greater<double>, LevelAllocator>;
+using AskLevels = std::map<double, std::pair<int, int>, std::less<double>, LevelAllocator>;
+
+template <int Depth>
+class BasicOrderBook {
+    static_assert(Depth > 0, "a book publishes at least one level");
+
+private:
+    std::shared_ptr<NodePool> pool_ = std::make_shared<NodePool>();
+
 public:
-    std::map<double, std::pair<int, int>, std::greater<double>> bids; 
-    std::map<double, std::pair<int, int>> asks;
+    static constexpr int DEPTH = Depth;
+
+    BidLevels bids{LevelAllocator(pool_)};
+    AskLevels asks{LevelAllocator(pool_)};
+
+    const AllocationStats& allocation_stats() const { return pool_->stats(); }
 
     void add(double price, int size, char side);
     void cancel(double price, int size, char side);
     int calculate_depth(std::string price, char side) const;
+    int calculate_depth(double price, char side) const;
+
+    // flat copy of both sides: level count, then (price, size, count) per level, best first
+    void save_snapshot(std::string& out) const;
+    // replaces the book with a saved snapshot; false if the data is malformed.
+    // *used gets the number of bytes consumed.
+    bool load_snapshot(const char* data, size_t size, size_t* used = nullptr);
+};
+
+using OrderBook = BasicOrderBook<MAX_BOOK_DEPTH>;
+
+// the map book is keyed on doubles, the ladder on fixed-point integers
+template <int Depth>
+inline double book_price(const BasicOrderBook<Depth>&, int64_t price) { return price_to_double(price); }
+
+// levels a book publishes; rows are only written for records inside them
+template <typename Book>
+struct book_depth {
+    static constexpr int value = MAX_BOOK_DEPTH;
+};
+template <int Depth>
+struct book_depth<BasicOrderBook<Depth>> {
+    static constexpr int value = Depth;
 };
 
-class MBPFormatter {
+// aggregate books only track adds and cancels by price and size
+template <typename Book>
+void apply_record(Book& book, const MboRecord& record) {
+    if (record.action == 'A') {
+        book.add(book_price(book, record.price), record.size, record.side);
+    } else if (record.action == 'C') {
+        book.cancel(book_price(book, record.price), record.size, record.side);
+    }
+}
+
+// depth of the record's price level, 0 when the record carries no price
+template <typename Book>
+int record_depth(const Book& book, const MboRecord& record) {
+    OFA_STAGE(STAGE_DEPTH);
+    return record.has_price() ? book.calculate_depth(book_price(book, record.price), record.side) : 0;
+}
+
+template <int Depth>
+class BasicMBPFormatter {
 private:
-    std::string remove_trailing_zeros(const std::string& s);
+    using Book = BasicOrderBook<Depth>;
+    static constexpr int SNAPSHOT_FIELDS = 6 * Depth;           // px, sz, ct per side and level
+    static constexpr int ROW_FIELDS = 14 + SNAPSHOT_FIELDS + 2;
+
+    std::string remove_trailing_zeros(std::string_view s);
+    // per-row temporaries (trimmed prices, level text), reset after every row
+    MessageArena arena_;
+    std::string_view trim_trailing_zeros(std::string_view s);
+
+    // cached "px,sz,ct" text of each ladder top level, [0] bids and [1] asks;
+    // only levels the book marked dirty are re-rendered
+    std::string level_text_[2][TOP_LEVELS];
+    bool level_text_ready_ = false;
+    void render_level(const TopLevels& top, int i, std::string& out);
+    void append_snapshot(std::ofstream& outFile, const Book& book);
+    void append_snapshot(std::ofstream& outFile, const LadderBook& book);
+    void append_snapshot(std::ofstream& outFile, const L3Book& book) { append_snapshot(outFile, book.levels); }
 
 public:
-    std::vector<std::string> generate_top_10_snapshot(const OrderBook& book);
+    // px, sz, ct text per side and level, kept on the stack
+    using Snapshot = std::array<std::string, SNAPSHOT_FIELDS>;
+
+    Snapshot generate_top_10_snapshot(const Book& book);
+    Snapshot generate_top_10_snapshot(const LadderBook& book);
+    Snapshot generate_top_10_snapshot(const L3Book& book) { return generate_top_10_snapshot(book.levels); }
     void generate_mbp_row(std::ofstream& outFile, const MboRow& mboRow, 
-                         const OrderBook& book, int rowIndex, bool is_trade);
-    bool check_snapshot_changed(std::vector<std::string>& previous_snapshot, 
-                               const OrderBook& book);
-    bool handle_tfc_cases(const MboRow& currentRow, OrderBook& orderBook, std::ofstream& outFile, MBPFormatter& formatter, int& cached_tfc_rows, int& rowIndex);
-    void print_book(const OrderBook& book) const;
+                         const Book& book, int rowIndex, bool is_trade);
+    template <typename AnyBook>
+    void generate_mbp_row(std::ofstream& outFile, const MboRecord& record,
+                         const AnyBook& book, int rowIndex, bool is_trade);
+    bool check_snapshot_changed(Snapshot& previous_snapshot, 
+                               const Book& book);
+    bool check_snapshot_changed(TopLevels& previous_bids, TopLevels& previous_asks,
+                               const LadderBook& book);
+    bool handle_tfc_cases(const MboRow& currentRow, Book& orderBook, std::ofstream& outFile, BasicMBPFormatter& formatter, int& cached_tfc_rows, int& rowIndex);
+    void print_book(const Book& book) const;
+    const AllocationStats& allocation_stats() const { return arena_.stats(); }
 };
 
+using MBPFormatter = BasicMBPFormatter<MAX_BOOK_DEPTH>;
+
 // Utility functions
 const MboRow parse_line_to_mbo(const std::string& line);
-void process_header_line(std::ifstream& inFile, std::ofstream& outFile); 
\ No newline at end of file
+void process_header_line(std::ifstream& inFile, std::ofstream& outFile);
+void write_mbp_header(std::ofstream& outFile, int depth = MAX_BOOK_DEPTH);
+std::string mbp_header_line(int depth = MAX_BOOK_DEPTH); 
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "order_flow.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+
+// e = [P >= P'] q - [P <= P'] q' on the bid side, mirrored on the ask side;
+// a missing level sits at the worst possible price with size 0
+static int64_t level_ofi(const TopLevels& prev, const TopLevels& cur, int i, bool is_bid) {
+    int64_t empty = is_bid ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max();
+    int64_t p = (i < cur.count) ? cur.price[i] : empty;
+    int64_t pp = (i < prev.count) ? prev.price[i] : empty;
+    int64_t q = (i < cur.count) ? cur.level[i].size : 0;
+    int64_t qp = (i < prev.count) ? prev.level[i].size : 0;
+    if (is_bid) {
+        return (p >= pp ? q : 0) - (p <= pp ? qp : 0);
+    }
+    return (p >= pp ? qp : 0) - (p <= pp ? q : 0);
+}
+
+// size taken off the best queue: the decrease at an unchanged best price, or
+// all of it when the best level went away
+static int64_t best_depleted(const TopLevels& prev, const TopLevels& cur, bool is_bid) {
+    if (prev.count == 0) {
+        return 0;
+    }
+    if (cur.count == 0) {
+        return prev.level[0].size;
+    }
+    if (cur.price[0] == prev.price[0]) {
+        return std::max<int64_t>(0, prev.level[0].size - cur.level[0].size);
+    }
+    bool retreated = is_bid ? cur.price[0] < prev.price[0] : cur.price[0] > prev.price[0];
+    return retreated ? prev.level[0].size : 0;
+}
+
+const OrderFlowRow& OrderFlowAnalytics::update(const MboRecord& record, const LadderBook& book, bool is_trade) {
+    const TopLevels& bids = book.bids.top();
+    const TopLevels& asks = book.asks.top();
+    row_.ts_event = record.ts_event;
+    row_.sequence = record.sequence;
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        row_.ofi[i] = level_ofi(prev_bids_, bids, i, true) + level_ofi(prev_asks_, asks, i, false);
+    }
+    if (bids.count > 0 && asks.count > 0) {
+        double bid_sz = bids.level[0].size;
+        double ask_sz = asks.level[0].size;
+        row_.microprice = (price_to_double(bids.price[0]) * ask_sz + price_to_double(asks.price[0]) * bid_sz) /
+                          (bid_sz + ask_sz);
+    } else {
+        row_.microprice = NaN;
+    }
+
+    Contribution c = {};
+    c.ts_event = record.ts_event;
+    c.bid_depleted = best_depleted(prev_bids_, bids, true);
+    c.ask_depleted = best_depleted(prev_asks_, asks, false);
+    if (is_trade) {
+        c.trades = 1;
+        c.volume = record.size;
+        c.notional = price_to_double(record.price) * record.size;
+    } else if (record.action == 'C') {
+        c.cancels = 1;
+    }
+    prev_bids_ = bids;
+    prev_asks_ = asks;
+
+    // the window holds rows with ts_event in (now - window_ns, now]
+    while (!window_.empty() && window_.front().ts_event <= record.ts_event - window_ns_) {
+        const Contribution& old = window_.front();
+        sums_.bid_depleted -= old.bid_depleted;
+        sums_.ask_depleted -= old.ask_depleted;
+        sums_.volume -= old.volume;
+        sums_.notional -= old.notional;
+        sums_.trades -= old.trades;
+        sums_.cancels -= old.cancels;
+        window_.pop_front();
+    }
+    window_.push_back(c);
+    sums_.bid_depleted += c.bid_depleted;
+    sums_.ask_depleted += c.ask_depleted;
+    sums_.volume += c.volume;
+    sums_.notional += c.notional;
+    sums_.trades += c.trades;
+    sums_.cancels += c.cancels;
+    if (sums_.volume == 0) {
+        sums_.notional = 0;     // no drift left over once the last trade leaves
+    }
+
+    double seconds = static_cast<double>(window_ns_) / 1e9;
+    row_.bid_depletion = static_cast<double>(sums_.bid_depleted) / seconds;
+    row_.ask_depletion = static_cast<double>(sums_.ask_depleted) / seconds;
+    row_.trades = sums_.trades;
+    row_.cancels = sums_.cancels;
+    row_.trade_cancel_ratio = (sums_.cancels > 0) ? static_cast<double>(sums_.trades) / sums_.cancels : NaN;
+    row_.vwap = (sums_.volume > 0) ? sums_.notional / static_cast<double>(sums_.volume) : NaN;
+    return row_;
+}
+
+// column order of the side file, matching AnalyticsWriter::append
+static void column_names(std::vector<std::pair<std::string, uint8_t>>& out) {
+    out.emplace_back("ts_event", ANALYTICS_INT64);
+    out.emplace_back("sequence", ANALYTICS_INT64);
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        out.emplace_back((i < 10 ? "ofi_0" : "ofi_") + std::to_string(i), ANALYTICS_INT64);
+    }
+    out.emplace_back("microprice", ANALYTICS_DOUBLE);
+    out.emplace_back("bid_depletion", ANALYTICS_DOUBLE);
+    out.emplace_back("ask_depletion", ANALYTICS_DOUBLE);
+    out.emplace_back("trades", ANALYTICS_INT64);
+    out.emplace_back("cancels", ANALYTICS_INT64);
+    out.emplace_back("trade_cancel_ratio", ANALYTICS_DOUBLE);
+    out.emplace_back("vwap", ANALYTICS_DOUBLE);
+}
+
+static uint64_t bits_of(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+bool AnalyticsWriter::open(const char* path, int64_t window_ns) {
+    if (!out_.open(path)) {
+        return false;
+    }
+    std::vector<std::pair<std::string, uint8_t>> names;
+    column_names(names);
+    AnalyticsFileHeader header = {};
+    std::memcpy(header.magic, ANALYTICS_MAGIC, sizeof(header.magic));
+    header.version = ANALYTICS_VERSION;
+    header.column_count = static_cast<uint16_t>(names.size());
+    header.window_ns = window_ns;
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)));
+    for (const auto& name : names) {
+        AnalyticsColumnEntry entry = {};
+        std::strncpy(entry.name, name.first.c_str(), sizeof(entry.name) - 1);
+        entry.type = name.second;
+        out_.append(std::string_view(reinterpret_cast<const char*>(&entry), sizeof(entry)));
+    }
+    columns_.assign(names.size(), std::vector<uint64_t>());
+    for (auto& column : columns_) {
+        column.resize(ANALYTICS_BLOCK_ROWS);
+    }
+    return true;
+}
+
+void AnalyticsWriter::append(const OrderFlowRow& row) {
+    int c = 0;
+    columns_[c++][rows_] = static_cast<uint64_t>(row.ts_event);
+    columns_[c++][rows_] = static_cast<uint64_t>(row.sequence);
+    for (int i = 0; i < TOP_LEVELS; ++i) {
+        columns_[c++][rows_] = static_cast<uint64_t>(row.ofi[i]);
+    }
+    columns_[c++][rows_] = bits_of(row.microprice);
+    columns_[c++][rows_] = bits_of(row.bid_depletion);
+    columns_[c++][rows_] = bits_of(row.ask_depletion);
+    columns_[c++][rows_] = static_cast<uint64_t>(row.trades);
+    columns_[c++][rows_] = static_cast<uint64_t>(row.cancels);
+    columns_[c++][rows_] = bits_of(row.trade_cancel_ratio);
+    columns_[c++][rows_] = bits_of(row.vwap);
+    total_rows_++;
+    if (++rows_ == ANALYTICS_BLOCK_ROWS) {
+        flush_block();
+    }
+}
+
+void AnalyticsWriter::flush_block() {
+    if (rows_ == 0) {
+        return;
+    }
+    uint32_t head[2] = {rows_, 0};
+    out_.append(std::string_view(reinterpret_cast<const char*>(head), sizeof(head)));
+    for (const auto& column : columns_) {
+        out_.append(std::string_view(reinterpret_cast<const char*>(column.data()), rows_ * sizeof(uint64_t)));
+    }
+    rows_ = 0;
+}
+
+bool AnalyticsWriter::close() {
+    flush_block();
+    return out_.close();
+}
+
+double AnalyticsColumn::as_double(size_t row) const {
+    double v;
+    std::memcpy(&v, &bits[row], sizeof(v));
+    return v;
+}
+
+const AnalyticsColumn* AnalyticsTable::find(const std::string& name) const {
+    for (const AnalyticsColumn& column : columns) {
+        if (column.name == name) {
+            return &column;
+        }
+    }
+    return nullptr;
+}
+
+bool read_analytics(const char* data, size_t size, AnalyticsTable& table) {
+    AnalyticsFileHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, ANALYTICS_MAGIC, sizeof(header.magic)) != 0 || header.version != ANALYTICS_VERSION ||
+        header.column_count == 0) {
+        return false;
+    }
+    size_t pos = sizeof(header);
+    if (size - pos < header.column_count * sizeof(AnalyticsColumnEntry)) {
+        return false;
+    }
+    table = AnalyticsTable();
+    table.window_ns = header.window_ns;
+    for (uint16_t i = 0; i < header.column_count; ++i) {
+        AnalyticsColumnEntry entry;
+        std::memcpy(&entry, data + pos, sizeof(entry));
+        pos += sizeof(entry);
+        AnalyticsColumn column;
+        column.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+        column.type = entry.type;
+        table.columns.push_back(std::move(column));
+    }
+    while (pos < size) {
+        uint32_t head[2];
+        if (size - pos < sizeof(head)) {
+            return false;
+        }
+        std::memcpy(head, data + pos, sizeof(head));
+        pos += sizeof(head);
+        size_t bytes = static_cast<size_t>(head[0]) * sizeof(uint64_t);
+        if ((size - pos) / header.column_count < bytes) {
+            return false;
+        }
+        for (AnalyticsColumn& column : table.columns) {
+            size_t old = column.bits.size();
+            column.bits.resize(old + head[0]);
+            std::memcpy(column.bits.data() + old, data + pos, bytes);
+            pos += bytes;
+        }
+        table.rows += head[0];
+    }
+    return true;
+}
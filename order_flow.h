@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+#include "mbo_reader.h"
+#include "ladder_book.h"
+#include "l3_book.h"
+#include "mbp_writer.h"
+
+// Order flow measures for one mbp row, computed from the top levels before
+// and after the update that produced it.
+struct OrderFlowRow {
+    int64_t ts_event = 0;
+    int64_t sequence = 0;
+    int64_t ofi[TOP_LEVELS] = {};   // order flow imbalance of this update at each level (Cont et al.)
+    double microprice = 0;          // size weighted mid, NaN unless both sides have a level
+    double bid_depletion = 0;       // shares per second taken off the best bid queue over the window
+    double ask_depletion = 0;
+    int64_t trades = 0;             // trade rows in the window
+    int64_t cancels = 0;            // plain cancels in the window
+    double trade_cancel_ratio = 0;  // trades / cancels, NaN without cancels
+    double vwap = 0;                // over the window's trades, NaN without trades
+};
+
+// Streaming analytics over the rows of one book. Each update is O(TOP_LEVELS)
+// against the previous top levels plus amortized O(1) window upkeep: the
+// window is a queue of per-row contributions and running sums, and rows older
+// than window_ns (by ts_event) drop out as new ones arrive. Only rows the
+// reconstructor publishes are seen, so cancels deeper than the top 10 are not
+// counted.
+class OrderFlowAnalytics {
+private:
+    struct Contribution {
+        int64_t ts_event;
+        int64_t bid_depleted;
+        int64_t ask_depleted;
+        int64_t volume;
+        double notional;
+        int32_t trades;
+        int32_t cancels;
+    };
+
+    int64_t window_ns_;
+    std::deque<Contribution> window_;
+    Contribution sums_ = {};
+    TopLevels prev_bids_;
+    TopLevels prev_asks_;
+    OrderFlowRow row_;
+
+public:
+    explicit OrderFlowAnalytics(int64_t window_ns = 1000000000) : window_ns_(window_ns) {}
+
+    int64_t window_ns() const { return window_ns_; }
+    const OrderFlowRow& update(const MboRecord& record, const LadderBook& book, bool is_trade);
+    const OrderFlowRow& update(const MboRecord& record, const L3Book& book, bool is_trade) {
+        return update(record, book.levels, is_trade);
+    }
+};
+
+// Columnar side file. Layout: AnalyticsFileHeader, one AnalyticsColumnEntry
+// per column, then blocks of up to ANALYTICS_BLOCK_ROWS rows: a uint32 row
+// count, 4 bytes of padding, then each column's values back to back (8 bytes
+// each, int64 or double). All little endian, readable with numpy by offset.
+static constexpr char ANALYTICS_MAGIC[4] = {'O', 'F', 'A', 'C'};
+static constexpr uint16_t ANALYTICS_VERSION = 1;
+static constexpr uint32_t ANALYTICS_BLOCK_ROWS = 4096;
+
+enum AnalyticsType : uint8_t {
+    ANALYTICS_INT64 = 0,
+    ANALYTICS_DOUBLE = 1,
+};
+
+struct AnalyticsFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t column_count;
+    int64_t window_ns;
+};
+static_assert(sizeof(AnalyticsFileHeader) == 16, "AnalyticsFileHeader layout");
+
+struct AnalyticsColumnEntry {
+    char name[24];              // nul padded
+    uint8_t type;
+    uint8_t reserved[7];
+};
+static_assert(sizeof(AnalyticsColumnEntry) == 32, "AnalyticsColumnEntry layout");
+
+class AnalyticsWriter {
+private:
+    OutputBuffer out_;
+    std::vector<std::vector<uint64_t>> columns_;
+    uint32_t rows_ = 0;
+    uint64_t total_rows_ = 0;
+
+    void flush_block();
+
+public:
+    bool open(const char* path, int64_t window_ns);
+    void append(const OrderFlowRow& row);
+    bool close();
+    uint64_t rows() const { return total_rows_; }
+};
+
+struct AnalyticsColumn {
+    std::string name;
+    uint8_t type = ANALYTICS_INT64;
+    std::vector<uint64_t> bits;  // raw 8 byte values
+
+    int64_t as_int(size_t row) const { return static_cast<int64_t>(bits[row]); }
+    double as_double(size_t row) const;
+};
+
+// Whole file read back into columns, for tests and tools.
+struct AnalyticsTable {
+    int64_t window_ns = 0;
+    size_t rows = 0;
+    std::vector<AnalyticsColumn> columns;
+
+    const AnalyticsColumn* find(const std::string& name) const;
+};
+
+bool read_analytics(const char* data, size_t size, AnalyticsTable& table);
+
+// Sink decorator: runs the analytics on every row, appends the result to the
+// side file and passes the row on to the inner sink.
+template <typename Sink>
+struct AnalyticsSink {
+    Sink& inner;
+    OrderFlowAnalytics& analytics;
+    AnalyticsWriter& writer;
+
+    AnalyticsSink(Sink& s, OrderFlowAnalytics& a, AnalyticsWriter& w) : inner(s), analytics(a), writer(w) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        writer.append(analytics.update(record, book, is_trade));
+        inner.write_row(record, book, rowIndex, is_trade, depth);
+    }
+};
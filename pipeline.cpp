@@ -0,0 +1,159 @@
+#include "pipeline.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <cmath>
+#include <pthread.h>
+#include <sched.h>
+
+bool pin_current_thread(int cpu) {
+    if (cpu < 0) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+namespace {
+
+// parse -> book; the raw text still points into the mapped input
+struct ParsedRecord {
+    MboRecord record;
+    bool last = false;
+};
+
+// book -> writer: everything needed to render one row after the book moved on
+struct RowEvent {
+    MboRecord record;
+    TopLevels bids;
+    TopLevels asks;
+    uint32_t dirty[2] = {0, 0};
+    int row_index = 0;
+    int depth = 0;
+    bool is_trade = false;
+    bool last = false;
+};
+
+// the map book keeps no top levels of its own; copy the best 10 of each side,
+// with prices rounded like std::to_string in the reference formatter
+template <typename Map>
+void copy_top(const Map& side, TopLevels& top) {
+    top = TopLevels();
+    for (auto it = side.begin(); it != side.end() && top.count < TOP_LEVELS; ++it) {
+        top.price[top.count] = std::llround(it->first * 1e6) * (PRICE_SCALE / 1000000);
+        top.level[top.count].size = it->second.first;
+        top.level[top.count].count = it->second.second;
+        top.count++;
+    }
+}
+
+void snapshot_top(const OrderBook& book, RowEvent& event) {
+    copy_top(book.bids, event.bids);
+    copy_top(book.asks, event.asks);
+    event.dirty[0] = event.dirty[1] = (1u << TOP_LEVELS) - 1;
+}
+
+void snapshot_top(const LadderBook& book, RowEvent& event) {
+    event.bids = book.bids.top();
+    event.asks = book.asks.top();
+    event.dirty[0] = book.bids.take_dirty();
+    event.dirty[1] = book.asks.take_dirty();
+}
+
+void snapshot_top(const L3Book& book, RowEvent& event) {
+    snapshot_top(book.levels, event);
+}
+
+// book stage sink: hands a snapshot of every row to the writer
+struct RowEventSink {
+    SpscQueue<RowEvent>& out;
+    RowEvent event;
+    uint64_t rows = 0;
+
+    explicit RowEventSink(SpscQueue<RowEvent>& q) : out(q) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        event.record = record;
+        {
+            OFA_STAGE(STAGE_SNAPSHOT);
+            snapshot_top(book, event);
+        }
+        event.row_index = rowIndex;
+        event.depth = depth;
+        event.is_trade = is_trade;
+        out.push(event);
+        rows++;
+    }
+};
+
+} // namespace
+
+template <typename Book>
+bool run_pipeline(MboReader& reader, const PipelineOptions& options, PipelineStats* stats) {
+    PipelineStats local;
+    PipelineStats& st = (stats != nullptr) ? *stats : local;
+
+    OutputBuffer out;
+    if (!out.open(options.output_path.c_str())) {
+        return false;
+    }
+    SpscQueue<ParsedRecord> parsed(options.queue_capacity);
+    SpscQueue<RowEvent> rows(options.queue_capacity);
+    std::atomic<int> pin_failures{0};
+
+    std::thread book_thread([&] {
+        if (!pin_current_thread(options.cpus[1])) pin_failures++;
+        RowEventSink sink(rows);
+        Reconstructor<Book, RowEventSink> reconstructor(sink);
+        ParsedRecord item;
+        while (true) {
+            parsed.pop(item);
+            if (item.last) {
+                break;
+            }
+            reconstructor.process(item.record);
+        }
+        RowEvent end;
+        end.last = true;
+        rows.push(std::move(end));
+        st.rows = sink.rows;
+    });
+
+    std::thread writer_thread([&] {
+        if (!pin_current_thread(options.cpus[2])) pin_failures++;
+        MbpRowRenderer renderer;
+        out.append(mbp_header_line());
+        RowEvent event;
+        while (true) {
+            rows.pop(event);
+            if (event.last) {
+                break;
+            }
+            char* p = out.reserve(MbpRowRenderer::max_row_size(event.record));
+            out.commit(renderer.render(p, event.record, event.bids, event.asks, event.dirty,
+                                       event.row_index, event.is_trade, event.depth));
+        }
+    });
+
+    if (!pin_current_thread(options.cpus[0])) pin_failures++;
+    ParsedRecord item;
+    while (reader.next(item.record)) {
+        parsed.push(item);
+        st.records++;
+    }
+    item.last = true;
+    parsed.push(item);
+
+    book_thread.join();
+    writer_thread.join();
+    st.pin_failures = pin_failures;
+    return out.close();
+}
+
+template bool run_pipeline<OrderBook>(MboReader&, const PipelineOptions&, PipelineStats*);
+template bool run_pipeline<LadderBook>(MboReader&, const PipelineOptions&, PipelineStats*);
+template bool run_pipeline<L3Book>(MboReader&, const PipelineOptions&, PipelineStats*);
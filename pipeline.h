@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "mbo_reader.h"
+
+struct PipelineOptions {
+    int cpus[3] = {-1, -1, -1};         // core for the parse, book and write stage, -1 = not pinned
+    size_t queue_capacity = 1 << 12;
+    std::string output_path = "mbp_reconstruction.csv";
+};
+
+struct PipelineStats {
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    int pin_failures = 0;
+};
+
+// Three-stage reconstruction of a single stream: the calling thread parses,
+// a book thread applies records in order (T-F-C handling, depth filter) and
+// snapshots the top levels of every emitted row, and a writer thread renders
+// and writes the rows. Stages are connected by SPSC rings. The output is
+// byte-identical to the serial path. Book is OrderBook, LadderBook or L3Book.
+template <typename Book>
+bool run_pipeline(MboReader& reader, const PipelineOptions& options, PipelineStats* stats = nullptr);
+
+// pins the calling thread to one core; false if the core is not available
+bool pin_current_thread(int cpu);
@@ -0,0 +1,64 @@
+#include "pool_allocator.h"
+#include <algorithm>
+
+void* NodePool::allocate(size_t size) {
+    if (node_size_ == 0) {
+        node_size_ = std::max(size, sizeof(FreeNode));
+    }
+    if (size > node_size_) {
+        stats_.heap_allocations++;
+        stats_.heap_bytes += size;
+        return ::operator new(size);
+    }
+    stats_.allocations++;
+    if (free_ != nullptr) {
+        FreeNode* node = free_;
+        free_ = node->next;
+        return node;
+    }
+    if (cur_ == end_) {
+        size_t bytes = node_size_ * nodes_per_chunk_;
+        chunks_.emplace_back(new char[bytes]);
+        cur_ = chunks_.back().get();
+        end_ = cur_ + bytes;
+        stats_.heap_allocations++;
+        stats_.heap_bytes += bytes;
+    }
+    void* p = cur_;
+    cur_ += node_size_;
+    return p;
+}
+
+void NodePool::deallocate(void* p, size_t size) {
+    if (size > node_size_) {
+        ::operator delete(p);
+        return;
+    }
+    FreeNode* node = static_cast<FreeNode*>(p);
+    node->next = free_;
+    free_ = node;
+}
+
+void MessageArena::grow(size_t need) {
+    size_t size = std::max(block_size_, need);
+    blocks_.emplace_back(new char[size]);
+    cur_ = blocks_.back().get();
+    end_ = cur_ + size;
+    stats_.heap_allocations++;
+    stats_.heap_bytes += size;
+}
+
+void MessageArena::reset() {
+    peak_ = std::max(peak_, used_);
+    used_ = 0;
+    if (blocks_.size() > 1) {
+        // one block that fits the busiest message seen so far
+        blocks_.clear();
+        block_size_ = std::max(block_size_, peak_ * 2);
+        grow(block_size_);
+        return;
+    }
+    if (!blocks_.empty()) {
+        cur_ = blocks_.back().get();
+    }
+}
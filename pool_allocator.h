@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <vector>
+
+// What a pool or arena has done so far. heap_allocations counts trips to the
+// system allocator (new chunks, oversize requests); once a workload is warm it
+// should stop moving.
+struct AllocationStats {
+    uint64_t allocations = 0;       // requests served
+    uint64_t heap_allocations = 0;
+    uint64_t heap_bytes = 0;
+
+    void add(const AllocationStats& other) {
+        allocations += other.allocations;
+        heap_allocations += other.heap_allocations;
+        heap_bytes += other.heap_bytes;
+    }
+};
+
+// Fixed-size node pool. The node size is taken from the first request; nodes
+// are carved from chunks and recycled through a free list, and chunks only go
+// back to the heap with the pool. Larger requests are passed through to
+// operator new. Not thread-safe: one pool per book.
+class NodePool {
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    size_t node_size_ = 0;
+    size_t nodes_per_chunk_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    FreeNode* free_ = nullptr;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    AllocationStats stats_;
+
+public:
+    explicit NodePool(size_t nodes_per_chunk = 256) : nodes_per_chunk_(nodes_per_chunk) {}
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+    const AllocationStats& stats() const { return stats_; }
+};
+
+// std allocator over a shared NodePool, for node based containers (std::map).
+// Without a pool it is a plain heap allocator. Copies share the pool.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    std::shared_ptr<NodePool> pool;
+
+    PoolAllocator() = default;
+    explicit PoolAllocator(std::shared_ptr<NodePool> p) : pool(std::move(p)) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        if (pool && n == 1) {
+            return static_cast<T*>(pool->allocate(sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if (pool && n == 1) {
+            pool->deallocate(p, sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return pool == other.pool; }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return pool != other.pool; }
+};
+
+// Bump allocator for the temporaries of one message, released all at once
+// with reset(). reset() folds the blocks into one as large as the peak, so a
+// steady flow of messages stops allocating after the first few.
+class MessageArena {
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_size_;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    size_t used_ = 0;               // bytes handed out since the last reset
+    size_t peak_ = 0;
+    AllocationStats stats_;
+
+    void grow(size_t need);
+
+public:
+    explicit MessageArena(size_t block_size = 4096) : block_size_(block_size) {}
+    MessageArena(const MessageArena&) = delete;
+    MessageArena& operator=(const MessageArena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        size_t pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+        if (cur_ == nullptr || static_cast<size_t>(end_ - cur_) < size + pad) {
+            grow(size + align);
+            pad = (align - reinterpret_cast<uintptr_t>(cur_) % align) % align;
+        }
+        char* p = cur_ + pad;
+        cur_ = p + size;
+        used_ += size + pad;
+        stats_.allocations++;
+        return p;
+    }
+    char* allocate_chars(size_t size) { return static_cast<char*>(allocate(size, 1)); }
+    std::string_view copy(std::string_view s) {
+        char* p = allocate_chars(s.size());
+        std::copy(s.begin(), s.end(), p);
+        return std::string_view(p, s.size());
+    }
+
+    void reset();
+    const AllocationStats& stats() const { return stats_; }
+};
+
+// std allocator on top of a MessageArena; deallocate is a no-op until reset()
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    MessageArena* arena;
+
+    explicit ArenaAllocator(MessageArena& a) : arena(&a) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
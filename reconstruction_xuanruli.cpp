@@ -1,54 +1,801 @@
-#include "order_book.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include "engine.h"
+#include "dbn_format.h"
+#include "columnar_format.h"
+#include "delta_format.h"
+#include "stream.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "conflation.h"
+#include "order_flow.h"
+#include "instrumentation.h"
+#include "time_index.h"
+#include "multi_file.h"
+#include "verify.h"
+#include <algorithm>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <unistd.h>
+
+static const char* OUTPUT_PATH = "mbp_reconstruction.csv";
+static const char* BINARY_OUTPUT_PATH = "mbp_reconstruction.bin";
+static const char* COLUMNAR_OUTPUT_PATH = "mbp_reconstruction.mbpc";
+static const char* DELTA_OUTPUT_PATH = "mbp_reconstruction.mbpd";
+
+// Reader is MboReader (csv) or MboBinaryReader
+template <typename Book, typename Sink, typename Reader>
+void reconstruct(Reader& reader, Sink& sink) {
+    Reconstructor<Book, Sink> reconstructor(sink);
+    MboRecord currentRow;
+    while (reader.next(currentRow)) {
+        reconstructor.process(currentRow);
+    }
+}
+
+// reference path: std::map book rendered through MBPFormatter and std::ofstream,
+// publishing Depth levels; alloc gets the book pool and row arena counters
+template <int Depth, typename Reader>
+static bool run_reference(Reader& reader, AllocationStats* alloc = nullptr, uint64_t* records = nullptr) {
+    std::ofstream outFile(OUTPUT_PATH);
+    if (!outFile.is_open()) {
+        return false;
+    }
+    write_mbp_header(outFile, Depth);
+    BasicFormatterSink<Depth> sink(outFile);
+    Reconstructor<BasicOrderBook<Depth>, BasicFormatterSink<Depth>> reconstructor(sink);
+    MboRecord currentRow;
+    uint64_t count = 0;
+    while (reader.next(currentRow)) {
+        reconstructor.process(currentRow);
+        count++;
+    }
+    if (alloc != nullptr) {
+        *alloc = reconstructor.book.allocation_stats();
+        alloc->add(sink.formatter.allocation_stats());
+    }
+    if (records != nullptr) {
+        *records = count;
+    }
+    return true;
+}
+
+// the depths built for the map book, see INSTANTIATE_MAP_DEPTH
+template <typename Reader>
+static bool run_reference_depth(Reader& reader, int depth, AllocationStats* alloc, uint64_t* records) {
+    switch (depth) {
+    case 1: return run_reference<1>(reader, alloc, records);
+    case 5: return run_reference<5>(reader, alloc, records);
+    case 20: return run_reference<20>(reader, alloc, records);
+    default: return run_reference<MAX_BOOK_DEPTH>(reader, alloc, records);
+    }
+}
+
+struct AnalyticsOptions {
+    std::string path;                   // empty = no order flow side file
+    int64_t window_ns = 1000000000;
+};
+
+// runs the reconstructor from reader into sink, teeing every row through the
+// order flow analytics when a side file is asked for; finish gets the final book
+template <typename Book, typename Sink, typename Reader, typename Finish>
+static bool reconstruct_analyzed(Reader& reader, Sink& sink, const AnalyticsOptions& options, Finish finish) {
+    if (options.path.empty()) {
+        Reconstructor<Book, Sink> reconstructor(sink);
+        MboRecord currentRow;
+        while (reader.next(currentRow)) {
+            reconstructor.process(currentRow);
+        }
+        finish(reconstructor.book);
+        return true;
+    }
+    AnalyticsWriter writer;
+    if (!writer.open(options.path.c_str(), options.window_ns)) {
+        return false;
+    }
+    OrderFlowAnalytics analytics(options.window_ns);
+    AnalyticsSink<Sink> tap(sink, analytics, writer);
+    Reconstructor<Book, AnalyticsSink<Sink>> reconstructor(tap);
+    MboRecord currentRow;
+    while (reader.next(currentRow)) {
+        reconstructor.process(currentRow);
+    }
+    finish(reconstructor.book);
+    return writer.close();
+}
+
+template <typename Book, typename Reader>
+static bool run_fast(Reader& reader, bool async_write, const AnalyticsOptions& analytics) {
+    OutputBuffer out;
+    if (!out.open(OUTPUT_PATH)) {
+        return false;
+    }
+    if (async_write) {
+        out.start_async();
+    }
+    MbpCsvWriter writer(out);
+    writer.write_header();
+    bool ok = reconstruct_analyzed<Book>(reader, writer, analytics, [](const Book&) {});
+    return out.close() && ok;
+}
+
+template <typename Book, typename Reader>
+static bool run_conflated(Reader& reader, bool async_write, const ConflationOptions& options,
+                          const AnalyticsOptions& analytics) {
+    OutputBuffer out;
+    if (!out.open(OUTPUT_PATH)) {
+        return false;
+    }
+    if (async_write) {
+        out.start_async();
+    }
+    ConflatingCsvWriter writer(out, options);
+    writer.write_header();
+    bool ok = reconstruct_analyzed<Book>(reader, writer, analytics,
+                                         [&writer](const Book& book) { writer.finish(book); });
+    const ConflationStats& stats = writer.stats();
+    std::cout << "Conflated " << stats.updates << " updates into " << stats.rows << " rows" << std::endl;
+    return out.close() && ok;
+}
+
+template <typename Book, typename Reader>
+static bool run_binary_output(Reader& reader, bool async_write) {
+    OutputBuffer out;
+    if (!out.open(BINARY_OUTPUT_PATH)) {
+        return false;
+    }
+    if (async_write) {
+        out.start_async();
+    }
+    MbpBinaryWriter writer(out);
+    writer.write_header();
+    reconstruct<Book>(reader, writer);
+    return writer.finish();
+}
+
+template <typename Book, typename Reader>
+static bool run_columnar_output(Reader& reader, bool async_write) {
+    OutputBuffer out;
+    if (!out.open(COLUMNAR_OUTPUT_PATH)) {
+        return false;
+    }
+    if (async_write) {
+        out.start_async();
+    }
+    MbpColumnarWriter writer(out);
+    writer.write_header();
+    reconstruct<Book>(reader, writer);
+    bool ok = writer.finish();
+    const ColumnarStats& stats = writer.stats();
+    std::cout << "Columnar rows: " << stats.rows << ", batches: " << stats.batches << ", bytes: " << stats.bytes
+              << ", constant batch columns: " << stats.skipped_columns << std::endl;
+    return ok;
+}
+
+// the differential layout, with every field and level written again every refresh_rows rows
+struct DeltaOptions {
+    bool enabled = false;
+    uint32_t refresh_rows = DEFAULT_REFRESH_ROWS;
+};
+
+template <typename Book, typename Reader>
+static bool run_delta_output(Reader& reader, bool async_write, const DeltaOptions& options) {
+    OutputBuffer out;
+    if (!out.open(DELTA_OUTPUT_PATH)) {
+        return false;
+    }
+    if (async_write) {
+        out.start_async();
+    }
+    MbpDeltaWriter writer(out, options.refresh_rows);
+    writer.write_header();
+    reconstruct<Book>(reader, writer);
+    bool ok = writer.finish();
+    const DeltaStats& stats = writer.stats();
+    std::cout << "Delta rows: " << stats.rows << ", refreshes: " << stats.refreshes << ", levels: " << stats.levels
+              << ", bytes: " << stats.bytes << std::endl;
+    return ok;
+}
+
+template <typename Reader>
+static bool run_single(Reader& reader, const std::string& book_type, bool async_write, bool binary_output,
+                       bool alloc_stats = false, int depth = MAX_BOOK_DEPTH,
+                       const ConflationOptions& conflation = ConflationOptions(),
+                       const AnalyticsOptions& analytics = AnalyticsOptions(), bool columnar_output = false,
+                       const DeltaOptions& delta = DeltaOptions()) {
+    if (delta.enabled) {
+        return (book_type == "l3") ? run_delta_output<L3Book>(reader, async_write, delta)
+                                   : run_delta_output<LadderBook>(reader, async_write, delta);
+    }
+    if (columnar_output) {
+        return (book_type == "l3") ? run_columnar_output<L3Book>(reader, async_write)
+                                   : run_columnar_output<LadderBook>(reader, async_write);
+    }
+    if (conflation.enabled()) {
+        return (book_type == "l3") ? run_conflated<L3Book>(reader, async_write, conflation, analytics)
+                                   : run_conflated<LadderBook>(reader, async_write, conflation, analytics);
+    }
+    if (binary_output) {
+        return (book_type == "l3") ? run_binary_output<L3Book>(reader, async_write)
+                                   : run_binary_output<LadderBook>(reader, async_write);
+    }
+    if (book_type == "map") {
+        AllocationStats alloc;
+        uint64_t records = 0;
+        bool ok = run_reference_depth(reader, depth, &alloc, &records);
+        if (alloc_stats && records > 0) {
+            std::cout << "Allocations: " << alloc.allocations << " pooled, " << alloc.heap_allocations
+                      << " from the heap (" << static_cast<double>(alloc.heap_allocations) / records
+                      << " per message)" << std::endl;
+        }
+        return ok;
+    }
+    return (book_type == "l3") ? run_fast<L3Book>(reader, async_write, analytics)
+                               : run_fast<LadderBook>(reader, async_write, analytics);
+}
+
+struct SnapshotOptions {
+    std::string path = "mbp_reconstruction.snap";
+    uint64_t every = 0;         // records between snapshots, 0 = never
+    std::string resume_path;    // empty = start from the top of the file
+};
+
+// single-threaded csv run that snapshots the book and stream position every
+// options.every records and can resume from such a snapshot; the output is
+// cut back to where the snapshot was taken and continued from there. With
+// index.path set it also writes the time index for mbp_query; tell() gives
+// the output offset for snapshots (flushed), mark() the same without flushing.
+template <typename Book, typename Sink, typename Tell, typename Mark>
+static bool replay_checkpointed(const MappedFile& input, const char* from, Sink& sink, Tell tell, Mark mark,
+                                Book* restored, StreamPosition position, const SnapshotOptions& options,
+                                const TimeIndexOptions& index) {
+    Reconstructor<Book, Sink> reconstructor(sink);
+    if (restored != nullptr) {
+        reconstructor.book = std::move(*restored);
+        reconstructor.resume(position.cached_tfc_rows, position.row_index);
+    }
+    TimeIndexWriter index_writer;
+    bool indexed = !index.path.empty();
+    int64_t latest = INT64_MIN;
+    if (indexed) {
+        if (!index_writer.open(index, snapshot_kind<Book>())) {
+            std::cerr << "Error writing index " << index.path << std::endl;
+            return false;
+        }
+        position.input_offset = static_cast<uint64_t>(from - input.data());
+        position.output_offset = mark();
+        index_writer.add(reconstructor.book, latest, position);
+    }
+    MboReader reader(from, input.data() + input.size());
+    MboRecord record;
+    while (reader.next(record)) {
+        reconstructor.process(record);
+        note_applied(position, record);
+        latest = std::max(latest, record.ts_event);
+        bool snapshot_due = options.every > 0 && position.records % options.every == 0;
+        bool index_due = indexed && position.records % index.index_every == 0;
+        if (snapshot_due || index_due) {
+            position.cached_tfc_rows = reconstructor.cached_tfc_rows();
+            position.row_index = reconstructor.row_index();
+            position.input_offset = static_cast<uint64_t>(reader.position() - input.data());
+        }
+        if (index_due) {
+            position.output_offset = mark();
+            index_writer.add(reconstructor.book, latest, position);
+        }
+        if (snapshot_due) {
+            position.output_offset = tell();
+            if (!save_snapshot_file(options.path, reconstructor.book, position)) {
+                std::cerr << "Error writing snapshot " << options.path << std::endl;
+                return false;
+            }
+        }
+    }
+    if (indexed && !index_writer.finish()) {
+        std::cerr << "Error writing index " << index.path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template <typename Book>
+static bool run_checkpointed(const MappedFile& input, const SnapshotOptions& options, const TimeIndexOptions& index) {
+    MboReader header(input);
+    header.skip_header();
+    const char* from = header.position();
+    Book book;
+    StreamPosition position;
+    bool resuming = !options.resume_path.empty();
+    if (resuming) {
+        if (!load_snapshot_file(options.resume_path, book, position)) {
+            std::cerr << "Error reading snapshot " << options.resume_path << std::endl;
+            return false;
+        }
+        from = find_resume_point(input.data(), from, input.data() + input.size(), position);
+        if (from == nullptr) {
+            std::cerr << "input does not continue the snapshot (last sequence " << position.last_sequence
+                      << ", " << position.records_at_last_sequence << " record(s) applied)" << std::endl;
+            return false;
+        }
+    }
+    Book* restored = resuming ? &book : nullptr;
+
+    // the map book keeps going through the reference formatter
+    if constexpr (std::is_same<Book, OrderBook>::value) {
+        if (resuming && ::truncate(OUTPUT_PATH, static_cast<off_t>(position.output_offset)) != 0) {
+            return false;
+        }
+        std::ofstream outFile(OUTPUT_PATH, resuming ? std::ios::app : std::ios::trunc);
+        if (!outFile.is_open()) {
+            return false;
+        }
+        if (!resuming) {
+            write_mbp_header(outFile);
+        }
+        FormatterSink sink(outFile);
+        auto tell = [&outFile]() {
+            outFile.flush();
+            return static_cast<uint64_t>(outFile.tellp());
+        };
+        auto mark = [&outFile]() { return static_cast<uint64_t>(outFile.tellp()); };
+        return replay_checkpointed(input, from, sink, tell, mark, restored, position, options, index);
+    } else {
+        OutputBuffer out;
+        if (resuming ? !out.open_at(OUTPUT_PATH, position.output_offset) : !out.open(OUTPUT_PATH)) {
+            return false;
+        }
+        MbpCsvWriter writer(out);
+        if (!resuming) {
+            writer.write_header();
+        }
+        auto tell = [&out]() { return out.offset(); };
+        auto mark = [&out]() { return out.tell(); };
+        bool ok = replay_checkpointed(input, from, writer, tell, mark, restored, position, options, index);
+        return out.close() && ok;
+    }
+}
+
+// live mode: argv[1] names an endpoint instead of a file, rows go out as they are made
+static bool run_live(const std::string& input, const std::string& output, const std::string& book_type) {
+    Endpoint in_endpoint, out_endpoint;
+    if (!parse_endpoint(input, in_endpoint) || !parse_endpoint(output, out_endpoint)) {
+        std::cerr << "bad endpoint" << std::endl;
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int in_fd = open_stream_input(in_endpoint);
+    int out_fd = (in_fd < 0) ? -1 : open_stream_output(out_endpoint);
+    if (in_fd < 0 || out_fd < 0) {
+        std::cerr << "Error opening stream: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    StreamOptions options;
+    StreamStats stats;
+    bool ok = (book_type == "l3") ? run_stream<L3Book>(in_fd, out_fd, options, &stats)
+                                  : run_stream<LadderBook>(in_fd, out_fd, options, &stats);
+    if (in_fd != STDIN_FILENO) ::close(in_fd);
+    if (out_fd != STDOUT_FILENO) ::close(out_fd);
+    std::cerr << "Streamed records: " << stats.records << ", rows: " << stats.rows
+              << ", backpressure stalls: " << stats.stalls << std::endl;
+    if (stats.latency.count() > 0) {
+        std::cerr << "Tick-to-MBP latency (ns): ";
+        stats.latency.print(std::cerr);
+        std::cerr << std::endl;
+    }
+    return ok;
+}
 
 int main(int argc, char* argv[]) {
     // Start timing
     auto start_time = std::chrono::high_resolution_clock::now();
-    
+
     if (argc < 2) {
         std::cerr << "not enough arguments"<< std::endl;
         return 1;
     }
 
-    std::ofstream outFile("mbp_reconstruction.csv");
-    std::ifstream inFile(argv[1]);
-    
-    if (!inFile.is_open() || !outFile.is_open()) {
-        std::cerr << "Error opening files!" << std::endl;
+    // --book=ladder (default), --book=l3 for the per-order book,
+    // or --book=map for the reference std::map book
+    // --async-write flushes the output from a background thread
+    // --threads=N shards instruments over N workers, --split-output writes one csv per instrument
+    // --output-format=bin writes binary mbp-10 records (dbn_format.h) to mbp_reconstruction.bin;
+    // --output-format=columnar writes record batches of encoded columns (columnar_format.h) to
+    // mbp_reconstruction.mbpc; --output-format=delta writes only the fields and levels each row changed
+    // (delta_format.h) to mbp_reconstruction.mbpd, with every field and level again every
+    // --refresh-every=N rows (default 1000); binary mbo input is detected from the file itself
+    // --stream reads argv[1] as a live endpoint (-, FIFO path, tcp:PORT, unix:PATH) and
+    // publishes rows to --output=ENDPOINT (default stdout) as they are produced
+    // --pipeline runs parse, book and write as three threads, --pin=P,B,W puts them on those cores
+    // --snapshot-every=N saves the book and stream position to --snapshot=PATH every N records,
+    // --resume=PATH continues an interrupted run from such a snapshot
+    // --index=PATH writes a time index for mbp_query: an entry every --index-every=N records
+    // (default 1000) and a book checkpoint every --index-checkpoint-every=K entries (default 16)
+    // --depth=1|5|10|20 publishes MBP-1/5/10/20 rows from the map book (compile-time variants)
+    // --conflate-us=N writes at most one row per N microseconds of ts_event, --conflate-every=K one per
+    // K updates, --conflate-on-change only when the top 10 changed; rows gain a "conflated" count
+    // --analytics=PATH writes order flow measures per row to a columnar side file (order_flow.h),
+    // over rolling windows of --analytics-window-ms=N (default 1000)
+    // --metrics=PATH writes per-stage cycle counts, action and row counters and book high-water marks
+    // as json to PATH ("-" = stderr) at exit and on every SIGUSR1 (instrumentation.h; make INSTRUMENT=1)
+    // --alloc-stats prints the map book's pool and arena counters per message
+    // --batch=N splits the file into N chunks rendered in parallel from checkpointed books
+    // argv[1] as @MANIFEST or a glob ('data/*.csv') reconstructs every file into its own csv on
+    // --workers=N threads (default one per core), largest file first, into --jobs-out=DIR if given
+    // --verify[=PATH] streams the csv output against a reference (default mbp.csv) after the run and
+    // reports the first divergent row and column with the book there; --verify-skip-deep drops the
+    // reference's depth >= 10 rows, which are not published here, --verify-rows=N stops after N
+    // equal rows and --verify-ignore=COL[,COL...] lets those reference columns differ
+    std::string book_type = "ladder";
+    SnapshotOptions snapshot_options;
+    TimeIndexOptions index_options;
+    bool batch = false;
+    BatchOptions batch_options;
+    batch_options.output_path = OUTPUT_PATH;
+    bool pipelined = false;
+    PipelineOptions pipeline_options;
+    pipeline_options.output_path = OUTPUT_PATH;
+    bool live = false;
+    std::string live_output = "-";
+    bool async_write = false;
+    bool alloc_stats = false;
+    int depth = MAX_BOOK_DEPTH;
+    ConflationOptions conflation;
+    AnalyticsOptions analytics;
+    std::string metrics_path;
+    bool binary_output = false;
+    bool columnar_output = false;   // a binary output in the columnar layout
+    DeltaOptions delta;             // a binary output in the differential layout
+    bool use_engine = false;
+    EngineOptions engine_options;
+    engine_options.output_path = OUTPUT_PATH;
+    std::string input = argv[1];
+    bool multi_file = !input.empty() && (input[0] == '@' || input.find_first_of("*?[") != std::string::npos);
+    FileJobOptions file_job_options;
+    std::string verify_reference;   // empty = no verification
+    VerifyOptions verify_options;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--book=", 7) == 0) {
+            book_type = argv[i] + 7;
+        } else if (std::strncmp(argv[i], "--depth=", 8) == 0) {
+            depth = std::atoi(argv[i] + 8);
+        } else if (std::strncmp(argv[i], "--conflate-us=", 14) == 0) {
+            conflation.interval_ns = std::atoll(argv[i] + 14) * 1000;
+        } else if (std::strncmp(argv[i], "--conflate-every=", 17) == 0) {
+            conflation.every = std::strtoull(argv[i] + 17, nullptr, 10);
+        } else if (std::strcmp(argv[i], "--conflate-on-change") == 0) {
+            conflation.on_change = true;
+        } else if (std::strncmp(argv[i], "--analytics=", 12) == 0) {
+            analytics.path = argv[i] + 12;
+        } else if (std::strncmp(argv[i], "--analytics-window-ms=", 22) == 0) {
+            analytics.window_ns = std::atoll(argv[i] + 22) * 1000000;
+        } else if (std::strncmp(argv[i], "--metrics=", 10) == 0) {
+            metrics_path = argv[i] + 10;
+        } else if (std::strcmp(argv[i], "--alloc-stats") == 0) {
+            alloc_stats = true;
+        } else if (std::strcmp(argv[i], "--async-write") == 0) {
+            async_write = true;
+        } else if (std::strncmp(argv[i], "--threads=", 10) == 0) {
+            engine_options.threads = std::atoi(argv[i] + 10);
+            use_engine = true;
+        } else if (std::strncmp(argv[i], "--snapshot-every=", 17) == 0) {
+            snapshot_options.every = std::strtoull(argv[i] + 17, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--snapshot=", 11) == 0) {
+            snapshot_options.path = argv[i] + 11;
+        } else if (std::strncmp(argv[i], "--resume=", 9) == 0) {
+            snapshot_options.resume_path = argv[i] + 9;
+        } else if (std::strncmp(argv[i], "--index=", 8) == 0) {
+            index_options.path = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--index-every=", 14) == 0) {
+            index_options.index_every = std::strtoull(argv[i] + 14, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--index-checkpoint-every=", 25) == 0) {
+            index_options.checkpoint_every = std::strtoull(argv[i] + 25, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--batch=", 8) == 0) {
+            batch_options.chunks = std::atoi(argv[i] + 8);
+            batch = true;
+        } else if (std::strncmp(argv[i], "--workers=", 10) == 0) {
+            file_job_options.workers = std::atoi(argv[i] + 10);
+        } else if (std::strncmp(argv[i], "--jobs-out=", 11) == 0) {
+            file_job_options.output_dir = argv[i] + 11;
+        } else if (std::strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = true;
+        } else if (std::strncmp(argv[i], "--pin=", 6) == 0) {
+            const char* p = argv[i] + 6;
+            for (int stage = 0; stage < 3 && *p != '\0'; ++stage) {
+                pipeline_options.cpus[stage] = std::atoi(p);
+                p = std::strchr(p, ',');
+                if (p == nullptr) break;
+                p++;
+            }
+            pipelined = true;
+        } else if (std::strcmp(argv[i], "--stream") == 0) {
+            live = true;
+        } else if (std::strncmp(argv[i], "--output=", 9) == 0) {
+            live_output = argv[i] + 9;
+        } else if (std::strcmp(argv[i], "--output-format=bin") == 0) {
+            binary_output = true;
+            columnar_output = false;
+            delta.enabled = false;
+        } else if (std::strcmp(argv[i], "--output-format=columnar") == 0) {
+            binary_output = true;
+            columnar_output = true;
+            delta.enabled = false;
+        } else if (std::strcmp(argv[i], "--output-format=delta") == 0) {
+            binary_output = true;
+            columnar_output = false;
+            delta.enabled = true;
+        } else if (std::strncmp(argv[i], "--refresh-every=", 16) == 0) {
+            delta.refresh_rows = static_cast<uint32_t>(std::strtoul(argv[i] + 16, nullptr, 10));
+        } else if (std::strcmp(argv[i], "--output-format=csv") == 0) {
+            binary_output = false;
+            columnar_output = false;
+            delta.enabled = false;
+        } else if (std::strcmp(argv[i], "--verify") == 0) {
+            verify_reference = "mbp.csv";
+        } else if (std::strncmp(argv[i], "--verify=", 9) == 0) {
+            verify_reference = argv[i] + 9;
+        } else if (std::strcmp(argv[i], "--verify-skip-deep") == 0) {
+            verify_options.skip_deep = true;
+        } else if (std::strncmp(argv[i], "--verify-rows=", 14) == 0) {
+            verify_options.max_rows = std::strtoull(argv[i] + 14, nullptr, 10);
+        } else if (std::strncmp(argv[i], "--verify-ignore=", 16) == 0) {
+            std::string columns = argv[i] + 16;
+            for (size_t begin = 0, end; begin <= columns.size(); begin = end + 1) {
+                end = std::min(columns.find(',', begin), columns.size());
+                if (end > begin) {
+                    verify_options.ignore_columns.push_back(columns.substr(begin, end - begin));
+                }
+            }
+        } else if (std::strcmp(argv[i], "--split-output") == 0) {
+            engine_options.split_output = true;
+            use_engine = true;
+        } else {
+            std::cerr << "unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    if (book_type != "map" && book_type != "ladder" && book_type != "l3") {
+        std::cerr << "unknown book type: " << book_type << std::endl;
+        return 1;
+    }
+    bool checkpointed = snapshot_options.every > 0 || !snapshot_options.resume_path.empty() ||
+                        !index_options.path.empty();
+    if (depth != 1 && depth != 5 && depth != MAX_BOOK_DEPTH && depth != 20) {
+        std::cerr << "depth must be 1, 5, 10 or 20" << std::endl;
+        return 1;
+    }
+    if (depth != MAX_BOOK_DEPTH && (book_type != "map" || use_engine || binary_output || live || pipelined ||
+                                    batch || checkpointed)) {
+        std::cerr << "--depth other than 10 needs --book=map on a plain single-threaded run" << std::endl;
+        return 1;
+    }
+    if (conflation.enabled() && (book_type == "map" || use_engine || binary_output || live || pipelined || batch ||
+                                 checkpointed)) {
+        std::cerr << "conflated output runs the ladder or l3 book on a plain single-threaded csv run" << std::endl;
+        return 1;
+    }
+    if (analytics.window_ns <= 0) {
+        std::cerr << "analytics window must be positive" << std::endl;
+        return 1;
+    }
+    if (!analytics.path.empty() && (book_type == "map" || use_engine || binary_output || live || pipelined ||
+                                    batch || checkpointed)) {
+        std::cerr << "--analytics runs the ladder or l3 book on a plain single-threaded csv run" << std::endl;
+        return 1;
+    }
+    if (!metrics_path.empty() && !OFA_INSTRUMENTATION) {
+        std::cerr << "--metrics needs a build with the probes compiled in (make INSTRUMENT=1)" << std::endl;
+        return 1;
+    }
+    if (use_engine && book_type == "map") {
+        std::cerr << "--threads and --split-output run the ladder or l3 book" << std::endl;
+        return 1;
+    }
+    if (binary_output && (book_type == "map" || use_engine)) {
+        std::cerr << "binary output needs --book=ladder or --book=l3 without --threads" << std::endl;
+        return 1;
+    }
+
+    if (pipelined && (use_engine || binary_output || live)) {
+        std::cerr << "--pipeline reads a csv file into a csv file on its own" << std::endl;
+        return 1;
+    }
+
+    if (!index_options.path.empty() && !snapshot_options.resume_path.empty()) {
+        std::cerr << "--index covers a whole run, not one continued with --resume" << std::endl;
+        return 1;
+    }
+    if (index_options.index_every == 0) {
+        std::cerr << "--index-every must be positive" << std::endl;
+        return 1;
+    }
+    if (checkpointed && (use_engine || binary_output || live || pipelined || batch || async_write)) {
+        std::cerr << "snapshots, --resume and --index work on a plain single-threaded csv run" << std::endl;
+        return 1;
+    }
+
+    if (batch && (book_type == "l3" || use_engine || binary_output || live || pipelined)) {
+        std::cerr << "--batch runs the map or ladder book from a csv file into a csv file on its own" << std::endl;
+        return 1;
+    }
+
+    if (multi_file && (use_engine || binary_output || live || pipelined || batch || checkpointed || async_write ||
+                       alloc_stats || depth != MAX_BOOK_DEPTH || conflation.enabled() || !analytics.path.empty())) {
+        std::cerr << "a manifest or glob runs one plain csv reconstruction per file (--book, --workers, --jobs-out)"
+                  << std::endl;
         return 1;
     }
 
-    OrderBook orderBook;
-    MBPFormatter formatter;
-    process_header_line(inFile, outFile);
-    int cached_tfc_rows = 0;
-    int rowIndex = 0;
-    std::string line;
-    while (std::getline(inFile, line)) {
-        MboRow currentRow = parse_line_to_mbo(line);
-        
-        // handle T-F-C cases
-        if (formatter.handle_tfc_cases(currentRow, orderBook, outFile, formatter, cached_tfc_rows, rowIndex)) {
-            continue;
+    if (!verify_reference.empty() && (engine_options.split_output || binary_output || live || multi_file)) {
+        std::cerr << "--verify checks the single csv output of a file run" << std::endl;
+        return 1;
+    }
+    // conflated rows and other depths have a different row set or column count than any reference
+    if (!verify_reference.empty() && (conflation.enabled() || depth != MAX_BOOK_DEPTH)) {
+        std::cerr << "--verify checks full MBP-10 output, not --conflate-* or --depth runs" << std::endl;
+        return 1;
+    }
+
+    // before any worker thread starts, so they all leave SIGUSR1 to the dump thread
+    if (!metrics_path.empty() && !start_metrics_signal_thread(metrics_path)) {
+        std::cerr << "could not watch for SIGUSR1" << std::endl;
+        return 1;
+    }
+    // written whichever way main returns from here on
+    struct MetricsAtExit {
+        const std::string& path;
+        ~MetricsAtExit() {
+            if (!path.empty() && !write_metrics_file(path)) {
+                std::cerr << "Error writing " << path << std::endl;
+            }
         }
-        
-        // handle add and cancel cases
-        if (currentRow.action == ACTION_ADD) {
-            orderBook.add(std::stod(currentRow.price), std::stoi(currentRow.size), currentRow.side[0]);
+    } metrics_at_exit{metrics_path};
+
+    if (live) {
+        if (book_type == "map" || use_engine || binary_output) {
+            std::cerr << "--stream runs the ladder or l3 book on one thread with csv output" << std::endl;
+            return 1;
+        }
+        if (!run_live(argv[1], live_output, book_type)) {
+            std::cerr << "Stream failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (multi_file) {
+        std::vector<FileJob> jobs;
+        std::string error;
+        if (!collect_file_jobs(input, file_job_options, jobs, error)) {
+            std::cerr << error << std::endl;
+            return 1;
         }
-        if (currentRow.action == ACTION_CANCEL){
-            orderBook.cancel(std::stod(currentRow.price), std::stoi(currentRow.size), currentRow.side[0]);
+        FileJobStats stats;
+        bool ok = (book_type == "map") ? run_file_jobs<OrderBook>(jobs, file_job_options, &stats)
+                  : (book_type == "l3") ? run_file_jobs<L3Book>(jobs, file_job_options, &stats)
+                                        : run_file_jobs<LadderBook>(jobs, file_job_options, &stats);
+        for (const FileJob& job : jobs) {
+            if (!job.ok) {
+                std::cerr << "Error reconstructing " << job.input << " into " << job.output << std::endl;
+            }
         }
+        std::cout << "Files: " << stats.files << " (" << stats.failed << " failed), records: " << stats.records
+                  << ", rows: " << stats.rows << ", steals: " << stats.steals << std::endl;
+        std::cout << "Throughput: " << static_cast<double>(stats.bytes) / 1e6 / stats.seconds << " MB/s, "
+                  << static_cast<uint64_t>(static_cast<double>(stats.records) / stats.seconds) << " records/s"
+                  << std::endl;
+        auto end_time = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+        std::cout << "Execution time: " << duration.count() << " ms" << std::endl;
+        return ok ? 0 : 1;
+    }
 
-        // only generate mbp row if the depth is less than 10
-        if (orderBook.calculate_depth(currentRow.price, currentRow.side[0]) < MAX_BOOK_DEPTH){
-            formatter.generate_mbp_row(outFile, currentRow, orderBook, rowIndex, false);
-            rowIndex++;
-        }  
+    MappedFile inFile;
+    if (!inFile.open(argv[1])) {
+        std::cerr << "Error opening files!" << std::endl;
+        return 1;
     }
-    
+
+    bool ok = false;
+    bool csv_input = !is_dbn_file(inFile.data(), inFile.size());
+    if (!csv_input) {
+        DbnFile binFile;
+        if (!binFile.open(inFile.data(), inFile.size()) || binFile.schema() != SCHEMA_MBO) {
+            std::cerr << "not a binary mbo file: " << argv[1] << std::endl;
+            return 1;
+        }
+        if (use_engine || batch || checkpointed) {
+            std::cerr << "--threads, --split-output, --batch, snapshots and --index read csv input only" << std::endl;
+            return 1;
+        }
+        // csv output echoes text columns, so have the reader render them
+        MboBinaryReader reader(binFile, !binary_output);
+        ok = run_single(reader, book_type, async_write, binary_output, alloc_stats, depth, conflation, analytics,
+                            columnar_output, delta);
+    } else if (checkpointed) {
+        if (book_type == "map") {
+            ok = run_checkpointed<OrderBook>(inFile, snapshot_options, index_options);
+        } else if (book_type == "l3") {
+            ok = run_checkpointed<L3Book>(inFile, snapshot_options, index_options);
+        } else {
+            ok = run_checkpointed<LadderBook>(inFile, snapshot_options, index_options);
+        }
+    } else if (batch) {
+        BatchStats stats;
+        ok = (book_type == "map") ? run_batch<OrderBook>(inFile, batch_options, &stats)
+                                  : run_batch<LadderBook>(inFile, batch_options, &stats);
+        std::cout << "Chunks: " << stats.chunks << ", records: " << stats.records
+                  << ", rows: " << stats.rows << std::endl;
+    } else {
+        MboReader reader(inFile);
+        reader.skip_header();
+        if (pipelined) {
+            PipelineStats stats;
+            if (book_type == "map") {
+                ok = run_pipeline<OrderBook>(reader, pipeline_options, &stats);
+            } else if (book_type == "l3") {
+                ok = run_pipeline<L3Book>(reader, pipeline_options, &stats);
+            } else {
+                ok = run_pipeline<LadderBook>(reader, pipeline_options, &stats);
+            }
+            if (stats.pin_failures > 0) {
+                std::cerr << "warning: could not pin " << stats.pin_failures << " stage(s)" << std::endl;
+            }
+        } else if (use_engine) {
+            EngineStats stats;
+            ok = (book_type == "l3") ? run_engine<L3Book>(reader, engine_options, &stats)
+                                     : run_engine<LadderBook>(reader, engine_options, &stats);
+            std::cout << "Instruments: " << stats.instruments << ", records: " << stats.records
+                      << ", rows: " << stats.rows << std::endl;
+        } else {
+            ok = run_single(reader, book_type, async_write, binary_output, alloc_stats, depth, conflation, analytics,
+                            columnar_output, delta);
+        }
+    }
+    if (!ok) {
+        const char* path = delta.enabled            ? DELTA_OUTPUT_PATH
+                           : columnar_output        ? COLUMNAR_OUTPUT_PATH
+                           : binary_output          ? BINARY_OUTPUT_PATH
+                                                    : OUTPUT_PATH;
+        std::cerr << "Error writing " << path << std::endl;
+        return 1;
+    }
+
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     std::cout << "Execution time: " << duration.count() << " ms" << std::endl;
-    
+
+    if (!verify_reference.empty()) {
+        VerifyResult result;
+        std::string error;
+        if (!verify_mbp_csv(OUTPUT_PATH, verify_reference, verify_options, result, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        if (result.diverged) {
+            std::cout << "Verify: " << OUTPUT_PATH << " diverges from " << verify_reference << " at "
+                      << describe_divergence(result.first) << std::endl;
+            if (csv_input) {
+                print_divergence_book(input, result.first, book_type);
+            }
+            return 1;
+        }
+        std::cout << "Verify: " << result.rows << " rows match " << verify_reference;
+        if (verify_options.max_rows > 0 && result.rows == verify_options.max_rows) {
+            std::cout << " (first " << result.rows << " rows checked)";
+        }
+        for (size_t c = 0; c < verify_options.ignore_columns.size(); ++c) {
+            std::cout << (c == 0 ? " (ignoring " : ", ") << verify_options.ignore_columns[c]
+                      << (c + 1 == verify_options.ignore_columns.size() ? ")" : "");
+        }
+        if (result.skipped > 0) {
+            std::cout << " (" << result.skipped << " deep reference rows skipped)";
+        }
+        std::cout << std::endl;
+    }
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "order_book.h"
+#include "l3_book.h"
+#include "instrumentation.h"
+
+// book size high-water marks for the instrumentation
+template <typename Book>
+void note_book_size(const Book& book) {
+    OFA_BOOK_SIZE(book.bids.size(), book.asks.size(), 0);
+}
+
+inline void note_book_size(const L3Book& book) {
+    OFA_BOOK_SIZE(book.levels.bids.size(), book.levels.asks.size(), book.order_count());
+}
+
+// Writes rows through the reference MBPFormatter into an ofstream.
+template <int Depth = MAX_BOOK_DEPTH>
+struct BasicFormatterSink {
+    BasicMBPFormatter<Depth> formatter;
+    std::ofstream& outFile;
+
+    explicit BasicFormatterSink(std::ofstream& out) : outFile(out) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int /*depth*/) {
+        formatter.generate_mbp_row(outFile, record, book, rowIndex, is_trade);
+    }
+};
+
+using FormatterSink = BasicFormatterSink<>;
+
+// Drops every row; used where only the book and row numbering matter.
+struct NullSink {
+    template <typename Book>
+    void write_row(const MboRecord&, const Book&, int, bool, int) {}
+};
+
+// Passes rows on to another sink and counts them.
+template <typename Sink>
+struct CountingSink {
+    Sink& inner;
+    uint64_t rows = 0;
+
+    explicit CountingSink(Sink& s) : inner(s) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        inner.write_row(record, book, rowIndex, is_trade, depth);
+        rows++;
+    }
+};
+
+// Turns a stream of mbo records into mbp-10 rows for one book. This is the
+// main loop of the reconstructor (T-F-C handling, book update, top-10 filter)
+// with the output side left to the Sink, which gets
+// write_row(record, book, rowIndex, is_trade, depth) for every emitted row.
+template <typename Book, typename Sink>
+class Reconstructor {
+private:
+    Sink& sink_;
+    int cached_tfc_rows_ = 0;
+    int row_index_ = 0;
+
+    void apply(const MboRecord& record) {
+        {
+            OFA_STAGE(STAGE_BOOK);
+            apply_record(book, record);
+        }
+#if OFA_INSTRUMENTATION
+        note_book_size(book);
+#endif
+    }
+
+public:
+    Book book;
+
+    explicit Reconstructor(Sink& sink) : sink_(sink) {}
+    Reconstructor(Sink& sink, Book&& initial) : sink_(sink), book(std::move(initial)) {}
+
+    void process(const MboRecord& record) {
+        OFA_ACTION(record.action);
+        {
+            // handle T-F-C cases, same rules as MBPFormatter::handle_tfc_cases
+            OFA_STAGE(STAGE_TFC);
+            if (record.action == 'T' && record.side == 'N') {
+                OFA_ROW(ROW_IGNORED);
+                return;
+            }
+            if (record.action == 'T' || record.action == 'F') {
+                cached_tfc_rows_++;
+                OFA_ROW(ROW_TFC_PENDING);
+                return;
+            }
+            if (cached_tfc_rows_ == 2 && record.action == 'C') {
+                apply(record);
+                cached_tfc_rows_ = 0;
+                sink_.write_row(record, book, row_index_, true, record_depth(book, record));
+                OFA_ROW(ROW_TRADE);
+                return;
+            }
+        }
+
+        // handle add and cancel cases (plus modify and clear on the L3 book)
+        apply(record);
+
+        // only generate mbp row if the depth is within the book's published levels
+        int depth = record_depth(book, record);
+        if (depth < book_depth<Book>::value) {
+            sink_.write_row(record, book, row_index_, false, depth);
+            row_index_++;
+            OFA_ROW(ROW_EMITTED);
+        } else {
+            OFA_ROW(ROW_SUPPRESSED);
+        }
+    }
+
+    int row_index() const { return row_index_; }
+    int cached_tfc_rows() const { return cached_tfc_rows_; }
+
+    // picks up mid-stream from a checkpoint taken with the two getters above
+    void resume(int cached_tfc_rows, int row_index) {
+        cached_tfc_rows_ = cached_tfc_rows;
+        row_index_ = row_index;
+    }
+};
@@ -0,0 +1,144 @@
+#include "simd_kernels.h"
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86 1
+#endif
+
+namespace {
+
+// prices, sizes and counts sit back to back in TopLevels: compare them as one block
+constexpr size_t TOP_BLOCK_BYTES = offsetof(TopLevels, count);
+static_assert(TOP_BLOCK_BYTES == TOP_LEVELS * 16, "TopLevels layout");
+
+int count_better_scalar(const int64_t* prices, int n, int64_t price, bool is_bid) {
+    int depth = 0;
+    while (depth < n && (is_bid ? prices[depth] > price : prices[depth] < price)) {
+        depth++;
+    }
+    return depth;
+}
+
+bool top_equal_scalar(const TopLevels& a, const TopLevels& b) {
+    return a == b;
+}
+
+#ifdef SIMD_KERNELS_X86
+
+// the top is sorted best first, so the better entries are a prefix and the
+// answer is the popcount of the compare mask over the first n entries
+__attribute__((target("sse4.2")))
+int count_better_sse42(const int64_t* prices, int n, int64_t price, bool is_bid) {
+    __m128i p = _mm_set1_epi64x(price);
+    uint32_t mask = 0;
+    for (int i = 0; i < TOP_LEVELS; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prices + i));
+        __m128i gt = is_bid ? _mm_cmpgt_epi64(v, p) : _mm_cmpgt_epi64(p, v);
+        mask |= static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(gt))) << i;
+    }
+    return __builtin_popcount(mask & ((1u << n) - 1));
+}
+
+__attribute__((target("sse4.2")))
+bool top_equal_sse42(const TopLevels& a, const TopLevels& b) {
+    if (a.count != b.count) {
+        return false;
+    }
+    const char* pa = reinterpret_cast<const char*>(&a);
+    const char* pb = reinterpret_cast<const char*>(&b);
+    __m128i diff = _mm_setzero_si128();
+    for (size_t i = 0; i < TOP_BLOCK_BYTES; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + i));
+        diff = _mm_or_si128(diff, _mm_xor_si128(va, vb));
+    }
+    return _mm_testz_si128(diff, diff);
+}
+
+__attribute__((target("avx2")))
+int count_better_avx2(const int64_t* prices, int n, int64_t price, bool is_bid) {
+    __m256i p = _mm256_set1_epi64x(price);
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + 4));
+    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prices + 8));
+    __m256i g0 = is_bid ? _mm256_cmpgt_epi64(v0, p) : _mm256_cmpgt_epi64(p, v0);
+    __m256i g1 = is_bid ? _mm256_cmpgt_epi64(v1, p) : _mm256_cmpgt_epi64(p, v1);
+    __m128i p2 = _mm256_castsi256_si128(p);
+    __m128i g2 = is_bid ? _mm_cmpgt_epi64(v2, p2) : _mm_cmpgt_epi64(p2, v2);
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(g0))) |
+                    static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(g1))) << 4 |
+                    static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(g2))) << 8;
+    return __builtin_popcount(mask & ((1u << n) - 1));
+}
+
+__attribute__((target("avx2")))
+bool top_equal_avx2(const TopLevels& a, const TopLevels& b) {
+    if (a.count != b.count) {
+        return false;
+    }
+    const char* pa = reinterpret_cast<const char*>(&a);
+    const char* pb = reinterpret_cast<const char*>(&b);
+    __m256i diff = _mm256_setzero_si256();
+    for (size_t i = 0; i < TOP_BLOCK_BYTES; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pa + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb + i));
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(va, vb));
+    }
+    return _mm256_testz_si256(diff, diff);
+}
+
+#endif
+
+struct Kernels {
+    int (*count_better)(const int64_t*, int, int64_t, bool);
+    bool (*top_equal)(const TopLevels&, const TopLevels&);
+};
+
+Kernels kernels_for(SimdLevel level) {
+#ifdef SIMD_KERNELS_X86
+    if (level == SIMD_AVX2) return {count_better_avx2, top_equal_avx2};
+    if (level == SIMD_SSE42) return {count_better_sse42, top_equal_sse42};
+#endif
+    (void)level;
+    return {count_better_scalar, top_equal_scalar};
+}
+
+SimdLevel detect_simd_level() {
+#ifdef SIMD_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SIMD_SSE42;
+#endif
+    return SIMD_SCALAR;
+}
+
+const SimdLevel supported = detect_simd_level();
+SimdLevel active = supported;
+Kernels kernels = kernels_for(supported);
+
+} // namespace
+
+SimdLevel simd_level() { return active; }
+SimdLevel supported_simd_level() { return supported; }
+
+void set_simd_level(SimdLevel level) {
+    active = (level > supported) ? supported : level;
+    kernels = kernels_for(active);
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SIMD_AVX2: return "avx2";
+    case SIMD_SSE42: return "sse4.2";
+    default: return "scalar";
+    }
+}
+
+int count_better_prices(const int64_t* prices, int n, int64_t price, bool is_bid) {
+    return kernels.count_better(prices, n, price, is_bid);
+}
+
+bool top_levels_equal(const TopLevels& a, const TopLevels& b) {
+    return kernels.top_equal(a, b);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include "ladder_book.h"
+
+// Small vector kernels over TopLevels, picked at startup from what the CPU
+// supports (AVX2, then SSE4.2, then plain C++). set_simd_level() forces a lower
+// level, for tests and benchmarks; it never goes above what is supported.
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE42 = 1,
+    SIMD_AVX2 = 2,
+};
+
+SimdLevel simd_level();
+SimdLevel supported_simd_level();
+void set_simd_level(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+// number of the first n entries of a sorted top price array that are strictly
+// better than price (higher for bids, lower for asks)
+int count_better_prices(const int64_t* prices, int n, int64_t price, bool is_bid);
+
+// slot-by-slot equality of two tops (prices, sizes, counts and level count)
+bool top_levels_equal(const TopLevels& a, const TopLevels& b);
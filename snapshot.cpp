@@ -0,0 +1,130 @@
+#include "snapshot.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+struct SnapshotHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t book;
+    StreamPosition position;    // 40 bytes
+    uint64_t book_size;
+    uint64_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout");
+
+} // namespace
+
+template <typename Book>
+bool save_snapshot_file(const std::string& path, const Book& book, const StreamPosition& position) {
+    std::string data(sizeof(SnapshotHeader), '\0');
+    book.save_snapshot(data);
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.book = snapshot_kind<Book>();
+    header.position = position;
+    header.book_size = data.size() - sizeof(SnapshotHeader);
+    std::memcpy(&data[0], &header, sizeof(header));
+
+    std::string tmp = path + ".tmp";
+    FILE* file = std::fopen(tmp.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = (std::fclose(file) == 0) && ok;
+    return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+template <typename Book>
+bool load_snapshot_file(const std::string& path, Book& book, StreamPosition& position) {
+    MappedFile file;
+    if (!file.open(path.c_str()) || file.size() < sizeof(SnapshotHeader)) {
+        return false;
+    }
+    SnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.book != snapshot_kind<Book>() ||
+        header.book_size != file.size() - sizeof(SnapshotHeader)) {
+        return false;
+    }
+    size_t used = 0;
+    if (!book.load_snapshot(file.data() + sizeof(header), header.book_size, &used) || used != header.book_size) {
+        return false;
+    }
+    position = header.position;
+    return true;
+}
+
+void note_applied(StreamPosition& position, const MboRecord& record) {
+    if (position.records > 0 && record.sequence == position.last_sequence) {
+        position.records_at_last_sequence++;
+    } else {
+        position.last_sequence = record.sequence;
+        position.records_at_last_sequence = 1;
+    }
+    position.records++;
+}
+
+const char* find_resume_point(const char* input, const char* body, const char* end, const StreamPosition& position) {
+    if (position.records == 0) {
+        return body;
+    }
+    // fast path: the offset is a line start and the last applied records sit right before it
+    const char* at = input + position.input_offset;
+    if (at > body && at <= end && at[-1] == '\n') {
+        const char* eol = at - 1;
+        uint32_t seen = 0;
+        while (seen < position.records_at_last_sequence && eol >= body) {
+            const char* begin = eol;
+            while (begin > body && begin[-1] != '\n') begin--;
+            MboReader reader(begin, eol + 1);
+            MboRecord record;
+            if (!reader.next(record) || record.sequence != position.last_sequence) {
+                break;
+            }
+            seen++;
+            eol = begin - 1;
+        }
+        MboReader reader(at, end);
+        MboRecord record;
+        if (seen == position.records_at_last_sequence &&
+            (!reader.next(record) || record.sequence >= position.last_sequence)) {
+            return at;
+        }
+    }
+
+    // scan: skip everything before last_sequence, then as many of its records as were applied
+    MboReader reader(body, end);
+    MboRecord record;
+    const char* line = reader.position();
+    uint32_t seen = 0;
+    bool first = true;
+    while (reader.next(record)) {
+        if (record.sequence > position.last_sequence) {
+            if (first) {
+                return nullptr; // the input starts after the snapshot, records are missing
+            }
+            break;
+        }
+        first = false;
+        if (record.sequence == position.last_sequence) {
+            if (seen == position.records_at_last_sequence) {
+                break;
+            }
+            seen++;
+        }
+        line = reader.position();
+    }
+    return (seen == position.records_at_last_sequence) ? line : nullptr;
+}
+
+template bool save_snapshot_file<OrderBook>(const std::string&, const OrderBook&, const StreamPosition&);
+template bool save_snapshot_file<LadderBook>(const std::string&, const LadderBook&, const StreamPosition&);
+template bool save_snapshot_file<L3Book>(const std::string&, const L3Book&, const StreamPosition&);
+template bool load_snapshot_file<OrderBook>(const std::string&, OrderBook&, StreamPosition&);
+template bool load_snapshot_file<LadderBook>(const std::string&, LadderBook&, StreamPosition&);
+template bool load_snapshot_file<L3Book>(const std::string&, L3Book&, StreamPosition&);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "order_book.h"
+
+static constexpr char SNAPSHOT_MAGIC[4] = {'O', 'F', 'A', 'S'};
+static constexpr uint16_t SNAPSHOT_VERSION = 1;
+
+enum SnapshotBook : uint16_t {
+    SNAPSHOT_MAP = 1,
+    SNAPSHOT_LADDER = 2,
+    SNAPSHOT_L3 = 3,
+};
+
+template <typename Book> constexpr uint16_t snapshot_kind();
+template <> constexpr uint16_t snapshot_kind<OrderBook>() { return SNAPSHOT_MAP; }
+template <> constexpr uint16_t snapshot_kind<LadderBook>() { return SNAPSHOT_LADDER; }
+template <> constexpr uint16_t snapshot_kind<L3Book>() { return SNAPSHOT_L3; }
+
+// Where a run stands after some number of input records: the reconstructor
+// counters, the last applied sequence number and the input/output offsets.
+// Records sharing a sequence number (a T-F-C group) are counted so a resume
+// can start in the middle of one.
+struct StreamPosition {
+    int32_t cached_tfc_rows = 0;
+    int32_t row_index = 0;
+    uint32_t last_sequence = 0;
+    uint32_t records_at_last_sequence = 0; // applied records carrying last_sequence
+    uint64_t records = 0;
+    uint64_t input_offset = 0;             // byte offset of the next record in the input file
+    uint64_t output_offset = 0;            // bytes of output written so far
+};
+
+// File layout: 64 byte header (magic, version, book kind, StreamPosition,
+// book size), then the book's save_snapshot bytes. Written to PATH.tmp and
+// renamed, so a crash mid-write leaves the previous snapshot intact.
+// Book is OrderBook, LadderBook or L3Book.
+template <typename Book>
+bool save_snapshot_file(const std::string& path, const Book& book, const StreamPosition& position);
+template <typename Book>
+bool load_snapshot_file(const std::string& path, Book& book, StreamPosition& position);
+
+void note_applied(StreamPosition& position, const MboRecord& record);
+
+// Where to continue in the csv body [body, end) of input: the stored offset
+// when the records around it still match, otherwise found by sequence number.
+// nullptr when the input does not continue the snapshot (it starts after
+// last_sequence, or holds fewer records of it than were applied).
+const char* find_resume_point(const char* input, const char* body, const char* end, const StreamPosition& position);
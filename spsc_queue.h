@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer ring buffer. Each side
+// caches the other side's index so the shared atomics are only read when the
+// queue looks full (producer) or empty (consumer).
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0}; // next slot to pop, written by the consumer
+    alignas(64) size_t cached_tail_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0}; // next slot to push, written by the producer
+    alignas(64) size_t cached_head_ = 0;
+
+public:
+    explicit SpscQueue(size_t capacity = 1024) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool try_push(T&& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size()) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size()) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_push(const T& value) {
+        T copy = value;
+        return try_push(std::move(copy));
+    }
+
+    bool try_pop(T& out) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+        out = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // blocking variants, spin then yield while full/empty
+    void push(T&& value) {
+        for (int spins = 0; !try_push(std::move(value)); ++spins) {
+            if (spins > 64) std::this_thread::yield();
+        }
+    }
+
+    void push(const T& value) {
+        T copy = value;
+        push(std::move(copy));
+    }
+
+    void pop(T& out) {
+        for (int spins = 0; !try_pop(out); ++spins) {
+            if (spins > 64) std::this_thread::yield();
+        }
+    }
+
+    size_t capacity() const { return slots_.size(); }
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+};
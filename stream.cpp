@@ -0,0 +1,410 @@
+#include "stream.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+bool parse_endpoint(const std::string& spec, Endpoint& out) {
+    out = Endpoint();
+    if (spec.empty()) {
+        return false;
+    }
+    if (spec == "-") {
+        out.kind = Endpoint::STDIO;
+        return true;
+    }
+    if (spec.compare(0, 4, "tcp:") == 0) {
+        out.kind = Endpoint::TCP;
+        std::string rest = spec.substr(4);
+        size_t colon = rest.rfind(':');
+        if (colon != std::string::npos) {
+            out.host = rest.substr(0, colon);
+            rest = rest.substr(colon + 1);
+        }
+        out.port = static_cast<int>(parse_uint(rest));
+        return out.port > 0 && out.port < 65536;
+    }
+    if (spec.compare(0, 5, "unix:") == 0) {
+        out.kind = Endpoint::UNIX;
+        out.path = spec.substr(5);
+        return !out.path.empty() && out.path.size() < sizeof(sockaddr_un().sun_path);
+    }
+    out.kind = Endpoint::PATH;
+    out.path = spec;
+    return true;
+}
+
+static int make_socket_address(const Endpoint& endpoint, sockaddr_storage& addr, socklen_t& len) {
+    std::memset(&addr, 0, sizeof(addr));
+    if (endpoint.kind == Endpoint::TCP) {
+        sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&addr);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<uint16_t>(endpoint.port));
+        if (inet_pton(AF_INET, endpoint.host.c_str(), &in->sin_addr) != 1) {
+            return -1;
+        }
+        len = sizeof(sockaddr_in);
+        return AF_INET;
+    }
+    sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+    un->sun_family = AF_UNIX;
+    std::memcpy(un->sun_path, endpoint.path.c_str(), endpoint.path.size() + 1);
+    len = sizeof(sockaddr_un);
+    return AF_UNIX;
+}
+
+int open_stream_input(const Endpoint& endpoint) {
+    if (endpoint.kind == Endpoint::STDIO) {
+        return STDIN_FILENO;
+    }
+    if (endpoint.kind == Endpoint::PATH) {
+        // blocks until a FIFO has a writer, so the first read is not an early EOF
+        return ::open(endpoint.path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    sockaddr_storage addr;
+    socklen_t len;
+    int family = make_socket_address(endpoint, addr, len);
+    if (family < 0) {
+        return -1;
+    }
+    int listener = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return -1;
+    }
+    if (family == AF_INET) {
+        int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    } else {
+        unlink(endpoint.path.c_str());
+    }
+    int fd = -1;
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), len) == 0 && listen(listener, 1) == 0) {
+        do {
+            fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+    }
+    ::close(listener);
+    if (family == AF_UNIX) {
+        unlink(endpoint.path.c_str());
+    }
+    return fd;
+}
+
+int open_stream_output(const Endpoint& endpoint) {
+    if (endpoint.kind == Endpoint::STDIO) {
+        return STDOUT_FILENO;
+    }
+    if (endpoint.kind == Endpoint::PATH) {
+        return ::open(endpoint.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+
+    sockaddr_storage addr;
+    socklen_t len;
+    int family = make_socket_address(endpoint, addr, len);
+    if (family < 0) {
+        return -1;
+    }
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool set_nonblocking(int fd, bool enabled) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+}
+
+namespace {
+
+// Output bytes not yet accepted by the fd. Grows past its capacity only to fit
+// a single row, the caller keeps it near output_limit.
+class PendingOutput {
+private:
+    std::vector<char> buffer_;
+    size_t head_ = 0;
+    size_t tail_ = 0;
+    int fd_;
+
+public:
+    PendingOutput(int fd, size_t capacity) : buffer_(capacity), fd_(fd) {}
+
+    size_t pending() const { return tail_ - head_; }
+
+    char* reserve(size_t n) {
+        if (buffer_.size() - tail_ < n) {
+            std::memmove(buffer_.data(), buffer_.data() + head_, pending());
+            tail_ -= head_;
+            head_ = 0;
+            if (buffer_.size() - tail_ < n) {
+                buffer_.resize(tail_ + n);
+            }
+        }
+        return buffer_.data() + tail_;
+    }
+    void commit(char* new_tail) { tail_ = static_cast<size_t>(new_tail - buffer_.data()); }
+
+    // write whatever the fd takes without blocking; false on a write error
+    bool drain(uint64_t* written) {
+        while (head_ < tail_) {
+            ssize_t n = ::write(fd_, buffer_.data() + head_, tail_ - head_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return false;
+            }
+            head_ += static_cast<size_t>(n);
+            *written += static_cast<uint64_t>(n);
+        }
+        if (head_ == tail_) {
+            head_ = tail_ = 0;
+        }
+        return true;
+    }
+};
+
+struct StreamSink {
+    PendingOutput& out;
+    MbpRowRenderer renderer;
+    uint64_t rows = 0;
+
+    explicit StreamSink(PendingOutput& o) : out(o) {}
+
+    template <typename Book>
+    void write_row(const MboRecord& record, const Book& book, int rowIndex, bool is_trade, int depth) {
+        char* p = out.reserve(MbpRowRenderer::max_row_size(record));
+        out.commit(renderer.render(p, record, book, rowIndex, is_trade, depth));
+        rows++;
+    }
+};
+
+// epoll registration that remembers what is currently asked for
+class Poller {
+private:
+    int epfd_;
+    int fds_[2];
+    uint32_t events_[2] = {0, 0};
+    bool added_[2] = {false, false};
+
+public:
+    bool pollable[2] = {false, false};
+
+    Poller(int in_fd, int out_fd) : epfd_(epoll_create1(EPOLL_CLOEXEC)), fds_{in_fd, out_fd} {
+        for (int i = 0; i < 2; ++i) {
+            // regular files are always ready and epoll refuses them with EPERM
+            epoll_event ev = {};
+            ev.data.u32 = static_cast<uint32_t>(i);
+            pollable[i] = epfd_ >= 0 && epoll_ctl(epfd_, EPOLL_CTL_ADD, fds_[i], &ev) == 0;
+            if (pollable[i]) {
+                epoll_ctl(epfd_, EPOLL_CTL_DEL, fds_[i], nullptr);
+            }
+        }
+    }
+    ~Poller() {
+        if (epfd_ >= 0) {
+            ::close(epfd_);
+        }
+    }
+
+    // events == 0 removes the fd, so a hung-up input does not keep waking us
+    void want(int i, uint32_t events) {
+        if (!pollable[i] || (added_[i] && events_[i] == events) || (!added_[i] && events == 0)) {
+            return;
+        }
+        epoll_event ev = {};
+        ev.events = events;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        if (events == 0) {
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, fds_[i], nullptr);
+            added_[i] = false;
+        } else {
+            epoll_ctl(epfd_, added_[i] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fds_[i], &ev);
+            added_[i] = true;
+        }
+        events_[i] = events;
+    }
+
+    // returns a bitmask of ready fds (1 = input, 2 = output), -1 on error
+    int wait() {
+        epoll_event events[2];
+        int n;
+        do {
+            n = epoll_wait(epfd_, events, 2, -1);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            return -1;
+        }
+        int ready = 0;
+        for (int i = 0; i < n; ++i) {
+            ready |= 1 << events[i].data.u32;
+        }
+        return ready;
+    }
+};
+
+bool is_header_line(const char* line, const char* eol) {
+    static const char HEADER[] = "ts_recv,";
+    size_t n = sizeof(HEADER) - 1;
+    return static_cast<size_t>(eol - line) >= n && std::memcmp(line, HEADER, n) == 0;
+}
+
+// mbo_replay appends its send time (monotonic ns) as a 16th column, which the
+// csv parser ignores; 0 if the line has none
+uint64_t send_stamp(const MboRecord& record, const char* eol) {
+    std::string_view symbol = record.text(MBO_SYMBOL);
+    const char* p = symbol.data() + symbol.size();
+    if (symbol.data() == nullptr || p >= eol || *p != ',') {
+        return 0;
+    }
+    return parse_uint(std::string_view(p + 1, static_cast<size_t>(eol - p - 1)));
+}
+
+} // namespace
+
+template <typename Book>
+bool run_stream(int in_fd, int out_fd, const StreamOptions& options, StreamStats* stats) {
+    StreamStats local;
+    StreamStats& st = (stats != nullptr) ? *stats : local;
+
+    PendingOutput out(out_fd, options.output_limit + (1 << 16));
+    StreamSink sink(out);
+    Reconstructor<Book, StreamSink> reconstructor(sink);
+
+    Poller poller(in_fd, out_fd);
+    int saved_flags[2] = {fcntl(in_fd, F_GETFL), fcntl(out_fd, F_GETFL)};
+    if (poller.pollable[0]) set_nonblocking(in_fd, true);
+    if (poller.pollable[1]) set_nonblocking(out_fd, true);
+
+    std::vector<char> input(options.input_buffer);
+    size_t input_len = 0;
+    bool eof = false;
+    bool stalled = false;
+    bool ok = true;
+    // send stamps of records whose rows are not written yet, with the output
+    // offset their last row ends at; bounded by the rows in the pending output
+    std::deque<std::pair<uint64_t, uint64_t>> stamps;
+
+    std::string header = mbp_header_line();
+    out.commit(std::copy(header.begin(), header.end(), out.reserve(header.size())));
+
+    while (ok) {
+        // turn every complete line into rows while the output has room
+        const char* begin = input.data();
+        const char* end = begin + input_len;
+        const char* cur = begin;
+        MboRecord record;
+        while (cur < end && out.pending() < options.output_limit) {
+            const char* eol = find_newline(cur, end);
+            if (eol == end && !eof) {
+                break; // partial line, wait for the rest
+            }
+            const char* line = cur;
+            cur = (eol < end) ? eol + 1 : end;
+            if (eol == line || (eol - line == 1 && *line == '\r') || is_header_line(line, eol)) {
+                continue;
+            }
+            parse_mbo_record(line, eol, record);
+            uint64_t rows_before = sink.rows;
+            reconstructor.process(record);
+            st.records++;
+            uint64_t stamp = send_stamp(record, eol);
+            if (stamp != 0 && sink.rows != rows_before) {
+                stamps.emplace_back(stamp, st.bytes_out + out.pending());
+            }
+        }
+        input_len = static_cast<size_t>(end - cur);
+        std::memmove(input.data(), cur, input_len);
+
+        // publish right away
+        if (!out.drain(&st.bytes_out)) {
+            ok = false;
+            break;
+        }
+        // tick-to-mbp: from the producer's send stamp until the write that took the row's last byte
+        if (!stamps.empty() && stamps.front().second <= st.bytes_out) {
+            uint64_t now = monotonic_ns();
+            while (!stamps.empty() && stamps.front().second <= st.bytes_out) {
+                uint64_t stamp = stamps.front().first;
+                st.latency.record(now > stamp ? now - stamp : 0);
+                stamps.pop_front();
+            }
+        }
+        if (eof && input_len == 0 && out.pending() == 0) {
+            break;
+        }
+        if (input_len == input.size()) {
+            ok = false; // a line longer than the whole input buffer
+            break;
+        }
+
+        bool output_full = out.pending() >= options.output_limit;
+        if (output_full && !stalled) {
+            st.stalls++;
+        }
+        stalled = output_full;
+        bool want_read = !eof && !output_full;
+
+        if (want_read && !poller.pollable[0]) {
+            ssize_t n = ::read(in_fd, input.data() + input_len, input.size() - input_len);
+            if (n < 0 && errno != EINTR) {
+                ok = false;
+            } else if (n == 0) {
+                eof = true;
+            } else if (n > 0) {
+                input_len += static_cast<size_t>(n);
+                st.bytes_in += static_cast<uint64_t>(n);
+            }
+            continue;
+        }
+        if (!output_full && input_len > 0 &&
+            (eof || find_newline(input.data(), input.data() + input_len) < input.data() + input_len)) {
+            continue; // lines left over from a full output can go now
+        }
+
+        poller.want(0, want_read ? EPOLLIN : 0);
+        poller.want(1, out.pending() > 0 ? EPOLLOUT : 0);
+        int ready = poller.wait();
+        if (ready < 0) {
+            ok = false;
+            break;
+        }
+        if (ready & 1) {
+            ssize_t n = ::read(in_fd, input.data() + input_len, input.size() - input_len);
+            if (n > 0) {
+                input_len += static_cast<size_t>(n);
+                st.bytes_in += static_cast<uint64_t>(n);
+            } else if (n == 0) {
+                eof = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                ok = false;
+            }
+        }
+    }
+
+    st.rows = sink.rows;
+    if (saved_flags[0] >= 0) fcntl(in_fd, F_SETFL, saved_flags[0]);
+    if (saved_flags[1] >= 0) fcntl(out_fd, F_SETFL, saved_flags[1]);
+    return ok;
+}
+
+template bool run_stream<LadderBook>(int, int, const StreamOptions&, StreamStats*);
+template bool run_stream<L3Book>(int, int, const StreamOptions&, StreamStats*);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include "latency_histogram.h"
+
+// Where a stream comes from or goes to:
+//   "-"                 stdin / stdout
+//   "tcp:PORT"          tcp on 127.0.0.1 (also "tcp:HOST:PORT")
+//   "unix:PATH"         unix domain stream socket
+//   anything else       a path (regular file or FIFO)
+struct Endpoint {
+    enum Kind { STDIO, PATH, TCP, UNIX } kind = STDIO;
+    std::string host = "127.0.0.1";
+    int port = 0;
+    std::string path;
+};
+
+bool parse_endpoint(const std::string& spec, Endpoint& out);
+
+// Reconstructor side: opens the input, listening and accepting one
+// connection for sockets. Returns the fd or -1.
+int open_stream_input(const Endpoint& endpoint);
+// Opens an output for writing, connecting for sockets. Returns the fd or -1.
+int open_stream_output(const Endpoint& endpoint);
+
+bool set_nonblocking(int fd, bool enabled);
+
+struct StreamOptions {
+    size_t input_buffer = 1 << 16;      // longest line we accept
+    size_t output_limit = 1 << 20;      // pending output bytes before we stop reading input
+};
+
+struct StreamStats {
+    uint64_t records = 0;
+    uint64_t rows = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t stalls = 0;                // times input reading paused on a full output buffer
+    LatencyHistogram latency;           // tick-to-mbp ns for stamped records that produced a row
+};
+
+// Reads mbo csv lines from in_fd as they arrive and writes each mbp-10 row to
+// out_fd as soon as it is produced, from a single epoll loop. Rows wait in a
+// bounded buffer when out_fd is slow; once output_limit bytes are pending the
+// input is no longer read, so backpressure reaches the producer through the
+// pipe/socket. Regular files (which epoll does not take) are read and written
+// directly. Lines stamped by mbo_replay have their tick-to-mbp latency
+// recorded in stats->latency. Book is LadderBook or L3Book.
+template <typename Book>
+bool run_stream(int in_fd, int out_fd, const StreamOptions& options, StreamStats* stats = nullptr);
@@ -1,6 +1,50 @@
 #include "order_book.h"
+#include "reconstructor.h"
+#include "mbp_writer.h"
+#include "engine.h"
+#include "dbn_format.h"
+#include "stream.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "simd_kernels.h"
+#include "conflation.h"
+#include "order_flow.h"
+#include "columnar_format.h"
+#include "instrumentation.h"
+#include "time_index.h"
+#include "multi_file.h"
+#include "delta_format.h"
+#include "verify.h"
 #include <iostream>
 #include <cassert>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+
+// every heap allocation in the test binary, to check the steady state allocates nothing
+static std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// kept out of line, gcc otherwise pairs the inlined free() with operator new and warns
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { std::free(p); }
 
 void test_calculate_depth_basic() {
     OrderBook book;
@@ -159,6 +203,1592 @@ void test_mbo_parsing() {
     assert(row.symbol == "AAPL");
 }
 
+void test_mbo_record_parsing() {
+    std::string test_line = "1609459200000000000,1609459200000000000,10,1,123,A,B,12.50,100,1,order123,128,0,1001,AAPL";
+    MboRecord rec;
+    parse_mbo_record(test_line.data(), test_line.data() + test_line.size(), rec);
+
+    assert(rec.ts_recv == 1609459200000000000LL);
+    assert(rec.action == 'A');
+    assert(rec.side == 'B');
+    assert(rec.price == 12500000000LL);
+    assert(rec.size == 100);
+    assert(rec.flags == 128);
+    assert(rec.sequence == 1001);
+    assert(rec.publisher_id == 1);
+    assert(rec.instrument_id == 123);
+    assert(rec.text(MBO_ORDER_ID) == "order123");
+    assert(rec.text(MBO_SYMBOL) == "AAPL");
+
+    std::string csv =
+        "ts_recv,ts_event,rtype,publisher_id,instrument_id,action,side,price,size,channel_id,order_id,flags,ts_in_delta,sequence,symbol\n"
+        "2025-07-17T07:05:09.035793433Z,2025-07-17T07:05:09.035627674Z,160,2,1108,R,N,,0,0,0,8,0,0,ARL\r\n"
+        "2025-07-17T08:05:03.360842448Z,2025-07-17T08:05:03.360677248Z,160,2,1108,A,B,5.510000000,100,0,817593,130,165200,851012,ARL";
+    MboReader reader(csv.data(), csv.data() + csv.size());
+    assert(reader.skip_header());
+
+    assert(reader.next(rec));
+    assert(rec.action == 'R');
+    assert(!rec.has_price());
+    assert(rec.ts_event == 1752735909035627674LL);
+    assert(rec.text(MBO_SYMBOL) == "ARL");
+
+    assert(reader.next(rec));
+    assert(rec.price == 5510000000LL);
+    assert(price_to_double(rec.price) == std::stod("5.510000000"));
+    assert(rec.order_id == 817593);
+    assert(rec.ts_recv - rec.ts_event == 165200);
+    assert(rec.text(MBO_TS_EVENT) == "2025-07-17T08:05:03.360677248Z");
+    assert(!reader.next(rec));
+}
+
+void test_ladder_book_basic() {
+    LadderBook book(64);
+    book.add(12500000000LL, 100, 'B');
+    book.add(12000000000LL, 200, 'B');
+    book.add(13000000000LL, 150, 'A');
+    book.add(13575000000LL, 300, 'A'); // off the 0.01 grid, forces a finer tick
+    book.add(99000000000LL, 10, 'A');  // far from the touch, lands in overflow
+
+    assert(book.bids.best_price() == 12500000000LL);
+    assert(book.asks.best_price() == 13000000000LL);
+    assert(book.asks.tick() == 5000000LL);
+    assert(book.asks.size() == 3);
+    assert(book.asks.find(99000000000LL)->size == 10);
+
+    assert(book.calculate_depth(12200000000LL, 'B') == 1);
+    assert(book.calculate_depth(13600000000LL, 'A') == 2);
+    assert(book.calculate_depth(99500000000LL, 'A') == 3);
+
+    book.cancel(13000000000LL, 150, 'A');
+    book.cancel(13575000000LL, 300, 'A');
+    assert(book.asks.best_price() == 99000000000LL);
+
+    book.add(14000000000LL, 5, 'A'); // better than the window, re-centers
+    assert(book.asks.best_price() == 14000000000LL);
+    assert(book.calculate_depth(99000000000LL, 'A') == 1);
+
+    book.clear();
+    assert(book.bids.empty() && book.asks.empty());
+    assert(book.bids.best_price() == UNDEF_PRICE);
+}
+
+// random add/cancel flow on both books, every snapshot and depth must match
+void test_ladder_matches_map_book() {
+    OrderBook map_book;
+    LadderBook ladder_book(128);
+    MBPFormatter formatter;
+    uint64_t state = 12345;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    };
+
+    for (int i = 0; i < 20000; i++) {
+        char side = (next() & 1) ? 'B' : 'A';
+        int64_t center = (side == 'B') ? 1300 : 1310;
+        int64_t offset = static_cast<int64_t>(next() % 400);
+        int64_t cents = (side == 'B') ? center - offset : center + offset;
+        int64_t price = cents * 10000000LL + ((next() % 50 == 0) ? 5000000LL : 0);
+        int32_t size = static_cast<int32_t>(next() % 300) + 1;
+
+        if (next() % 5 < 3) {
+            map_book.add(price_to_double(price), size, side);
+            ladder_book.add(price, size, side);
+        } else {
+            map_book.cancel(price_to_double(price), size, side);
+            ladder_book.cancel(price, size, side);
+        }
+
+        assert(map_book.bids.size() == ladder_book.bids.size());
+        assert(map_book.asks.size() == ladder_book.asks.size());
+        assert(formatter.generate_top_10_snapshot(map_book) == formatter.generate_top_10_snapshot(ladder_book));
+        int64_t probe = static_cast<int64_t>(1200 + next() % 220) * 10000000LL;
+        assert(map_book.calculate_depth(price_to_double(probe), side) == ladder_book.calculate_depth(probe, side));
+    }
+}
+
+// the in-place top must always equal a fresh walk, and every level that
+// changed since the previous step must be flagged dirty
+void test_incremental_top_levels() {
+    LadderBook book(64);
+    TopLevels previous[2];
+    uint64_t state = 2024;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    };
+
+    for (int step = 0; step < 20000; step++) {
+        char side = (next() & 1) ? 'B' : 'A';
+        int64_t cents = (side == 'B') ? 1300 - (next() % 40) : 1301 + (next() % 40);
+        int64_t price = cents * 10000000LL;
+        int32_t size = static_cast<int32_t>(next() % 3 + 1) * 100;
+        if (next() % 5 < 3) {
+            book.add(price, size, side);
+        } else {
+            book.cancel(price, size, side);
+        }
+        if (step % 5000 == 4999) {
+            book.clear();
+        }
+
+        const LadderSide* sides[2] = {&book.bids, &book.asks};
+        for (int s = 0; s < 2; ++s) {
+            TopLevels walked;
+            sides[s]->for_each_level(TOP_LEVELS, [&](int64_t px, const PriceLevel& level) {
+                walked.price[walked.count] = px;
+                walked.level[walked.count] = level;
+                walked.count++;
+            });
+            const TopLevels& top = sides[s]->top();
+            assert(top == walked);
+
+            uint32_t dirty = sides[s]->take_dirty();
+            for (int i = 0; i < TOP_LEVELS; ++i) {
+                bool changed = top.price[i] != previous[s].price[i] ||
+                               top.level[i].size != previous[s].level[i].size ||
+                               top.level[i].count != previous[s].level[i].count;
+                assert(!changed || (dirty >> i) & 1);
+            }
+            previous[s] = top;
+        }
+    }
+
+    MBPFormatter formatter;
+    TopLevels last_bids, last_asks;
+    book.add(1300000000LL, 100, 'A');
+    assert(formatter.check_snapshot_changed(last_bids, last_asks, book));
+    assert(!formatter.check_snapshot_changed(last_bids, last_asks, book));
+    book.add(1000000000LL, 1, 'B');
+    book.cancel(1000000000LL, 1, 'B');
+    assert(!formatter.check_snapshot_changed(last_bids, last_asks, book));
+}
+
+void test_flat_hash_table() {
+    FlatHashTable<uint32_t> table(4);
+    std::map<uint64_t, uint32_t> reference;
+    uint64_t state = 99;
+    for (uint32_t i = 0; i < 50000; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t key = (state >> 40) % 2000;
+        if (state & 1) {
+            table.insert(key, i);
+            reference.insert({key, i});
+        } else {
+            assert(table.erase(key) == (reference.erase(key) == 1));
+        }
+        assert(table.size() == reference.size());
+    }
+    for (const auto& entry : reference) {
+        assert(*table.find(entry.first) == entry.second);
+    }
+
+    // instrument ids on a stride of 8 must still spread over 4 engine workers
+    int per_worker[4] = {};
+    for (uint32_t id = 1000; id < 1000 + 8 * 400; id += 8) {
+        MboRecord record;
+        record.publisher_id = 2;
+        record.instrument_id = id;
+        per_worker[mix_key(instrument_key(record)) % 4]++;
+    }
+    for (int count : per_worker) {
+        assert(count > 60);
+    }
+}
+
+void test_l3_book() {
+    L3Book book(4);
+    book.add(1, 12500000000LL, 100, 'B');
+    book.add(2, 12500000000LL, 50, 'B');
+    book.add(3, 12500000000LL, 30, 'B');
+    book.add(4, 13000000000LL, 200, 'A');
+    assert(!book.add(4, 13000000000LL, 200, 'A'));
+    assert(book.order_count() == 4);
+    assert(book.levels.bids.find(12500000000LL)->size == 180);
+    assert(book.levels.bids.find(12500000000LL)->count == 3);
+    assert(book.size_ahead(3) == 150);
+
+    // partial cancel keeps the order and its queue position
+    book.cancel(1, 40);
+    assert(book.find(1)->size == 60);
+    assert(book.levels.bids.find(12500000000LL)->count == 3);
+    assert(book.size_ahead(2) == 60);
+
+    // size decrease keeps priority, size increase goes to the back
+    book.modify(2, 12500000000LL, 20);
+    assert(book.size_ahead(2) == 60);
+    book.modify(1, 12500000000LL, 70);
+    assert(book.size_ahead(1) == 50);
+    assert(book.levels.bids.find(12500000000LL)->size == 120);
+
+    // price change moves the order to another level
+    book.modify(3, 12600000000LL, 30);
+    assert(book.levels.bids.best_price() == 12600000000LL);
+    assert(book.levels.bids.find(12500000000LL)->count == 2);
+    assert(book.calculate_depth(12500000000LL, 'B') == 1);
+
+    book.cancel(4, 200);
+    assert(book.levels.asks.empty());
+    assert(book.find(4) == nullptr);
+    assert(!book.cancel(4, 1));
+
+    MboRecord clear;
+    clear.action = 'R';
+    apply_record(book, clear);
+    assert(book.order_count() == 0);
+    assert(book.levels.bids.empty());
+}
+
+// with only full cancels the L3 aggregates must equal the ladder book
+void test_l3_matches_ladder_book() {
+    L3Book l3_book(16);
+    LadderBook ladder_book;
+    std::vector<std::pair<uint64_t, std::pair<int64_t, int32_t>>> live;
+    std::vector<char> sides;
+    uint64_t state = 7;
+    auto next = [&state]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<uint32_t>(state >> 33);
+    };
+
+    for (uint64_t id = 1; id < 20000; id++) {
+        if (live.empty() || next() % 2 == 0) {
+            char side = (next() & 1) ? 'B' : 'A';
+            int64_t price = static_cast<int64_t>((side == 'B' ? 1200 : 1300) + next() % 100) * 10000000LL;
+            int32_t size = static_cast<int32_t>(next() % 500) + 1;
+            l3_book.add(id, price, size, side);
+            ladder_book.add(price, size, side);
+            live.push_back({id, {price, size}});
+            sides.push_back(side);
+        } else {
+            size_t pick = next() % live.size();
+            l3_book.cancel(live[pick].first, live[pick].second.second);
+            ladder_book.cancel(live[pick].second.first, live[pick].second.second, sides[pick]);
+            live[pick] = live.back();
+            live.pop_back();
+            sides[pick] = sides.back();
+            sides.pop_back();
+        }
+        assert(l3_book.order_count() == live.size());
+        assert(l3_book.levels.bids.size() == ladder_book.bids.size());
+        assert(l3_book.levels.asks.best_price() == ladder_book.asks.best_price());
+    }
+    MBPFormatter formatter;
+    assert(formatter.generate_top_10_snapshot(l3_book) == formatter.generate_top_10_snapshot(ladder_book));
+}
+
+void test_number_formatting() {
+    char buf[64];
+    assert(std::string(buf, uint_to_chars(buf, 0)) == "0");
+    assert(std::string(buf, uint_to_chars(buf, 1234567890123ULL)) == "1234567890123");
+    assert(std::string(buf, int_to_chars(buf, -42)) == "-42");
+    assert(std::string(buf, price_to_chars(buf, 14000000000LL)) == "14.0");
+    assert(std::string(buf, price_to_chars(buf, 13575000000LL)) == "13.575");
+    assert(std::string(buf, price_to_chars(buf, 10000LL)) == "0.00001");
+    assert(std::string(buf, price_to_chars(buf, -2500000000LL)) == "-2.5");
+    assert(std::string(buf, price_to_chars(buf, UNDEF_PRICE)) == "");
+
+    OrderBook book;
+    MBPFormatter formatter;
+    for (int64_t cents = 1; cents < 200000; cents += 7) {
+        int64_t price = cents * 10000000LL + (cents % 3) * 5000000LL;
+        book.add(price_to_double(price), 1, 'B');
+        std::string expected = formatter.generate_top_10_snapshot(book)[0];
+        assert(std::string(buf, price_to_chars(buf, price)) == expected);
+        assert(std::string(buf, level_price_to_chars(buf, price)) == expected);
+        book.cancel(price_to_double(price), 1, 'B');
+    }
+    // 7-9 decimals: levels round like std::to_string, the record price does not
+    assert(std::string(buf, level_price_to_chars(buf, 5510000123LL)) == "5.51");
+    assert(std::string(buf, price_to_chars(buf, 5510000123LL)) == "5.510000123");
+    for (int64_t cents = 1; cents < 200000; cents += 7) {
+        int64_t price = cents * 10000000LL + (cents % 1000) * 1000 + cents % 997;
+        book.add(price_to_double(price), 1, 'B');
+        std::string expected = formatter.generate_top_10_snapshot(book)[0];
+        assert(std::string(buf, level_price_to_chars(buf, price)) == expected);
+        book.cancel(price_to_double(price), 1, 'B');
+    }
+}
+
+static std::string read_file(const char* path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// feeds every record of an mbo csv to reconstructor; returns the record count
+template <typename R>
+static uint64_t feed_all(const MappedFile& input, R& reconstructor) {
+    MboReader reader(input);
+    reader.skip_header();
+    MboRecord record;
+    uint64_t records = 0;
+    while (reader.next(record)) {
+        reconstructor.process(record);
+        records++;
+    }
+    return records;
+}
+
+// a plain single-threaded csv run over input into path, returned as text:
+// the map book through the reference formatter, the others through MbpCsvWriter
+template <typename Book>
+static std::string reconstruct_csv(const MappedFile& input, const char* path = "test_output.txt",
+                                   uint64_t* records = nullptr) {
+    uint64_t count = 0;
+    if constexpr (std::is_same<Book, OrderBook>::value) {
+        std::ofstream outFile(path);
+        write_mbp_header(outFile);
+        FormatterSink sink(outFile);
+        Reconstructor<Book, FormatterSink> reconstructor(sink);
+        count = feed_all(input, reconstructor);
+    } else {
+        OutputBuffer out;
+        assert(out.open(path));
+        MbpCsvWriter writer(out);
+        writer.write_header();
+        Reconstructor<Book, MbpCsvWriter> reconstructor(writer);
+        count = feed_all(input, reconstructor);
+        assert(out.close());
+    }
+    if (records != nullptr) {
+        *records = count;
+    }
+    return read_file(path);
+}
+
+// the buffered writer must produce exactly the reference formatter output
+void test_csv_writer_matches_formatter() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    MboRecord record;
+
+    std::string reference = reconstruct_csv<OrderBook>(input);
+
+    bool async_modes[2] = {false, true};
+    for (bool async : async_modes) {
+        OutputBuffer out(4096);
+        assert(out.open("test_output.txt"));
+        if (async) {
+            out.start_async();
+        }
+        MbpCsvWriter writer(out);
+        writer.write_header();
+        Reconstructor<LadderBook, MbpCsvWriter> reconstructor(writer);
+        MboReader reader(input);
+        reader.skip_header();
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+        assert(out.close());
+        assert(read_file("test_output.txt") == reference);
+    }
+    std::remove("test_output.txt");
+}
+
+// prices with 7-9 decimals: the ladder book must print its levels the way the
+// map book does (rounded to 6 decimals) and keep the record price as given
+void test_sub_micro_prices() {
+    std::ifstream in("mbo.csv");
+    std::ofstream out("test_input.csv");
+    std::string line;
+    std::getline(in, line);
+    out << line << "\n";
+    while (std::getline(in, line)) {
+        // every price of an order moves together, so the books stay the same
+        size_t begin = 0;
+        for (int i = 0; i < MBO_PRICE; ++i) {
+            begin = line.find(',', begin) + 1;
+        }
+        size_t end = line.find(',', begin);
+        if (end - begin > 9) {
+            line.replace(end - 3, 3, line[end - 6] == '5' ? "500" : "123");
+        }
+        out << line << "\n";
+    }
+    out.close();
+
+    MappedFile input;
+    assert(input.open("test_input.csv"));
+    std::string map_text = reconstruct_csv<OrderBook>(input);
+    assert(map_text.find(",5.51,") != std::string::npos);
+    assert(reconstruct_csv<LadderBook>(input) == map_text);
+    std::remove("test_input.csv");
+    std::remove("test_output.txt");
+}
+
+// appends rendered rows to a string, used as the single-threaded expectation
+struct StringSink {
+    MbpRowRenderer renderer;
+    std::string& out;
+    explicit StringSink(std::string& o) : out(o) {}
+    void write_row(const MboRecord& record, const LadderBook& book, int rowIndex, bool is_trade, int depth) {
+        char buf[4096];
+        out.append(buf, renderer.render(buf, record, book, rowIndex, is_trade, depth));
+    }
+};
+
+// three instruments interleaved line by line; the sharded engine must produce
+// every instrument's rows in input order, same as running them one by one
+void test_multi_instrument_engine() {
+    std::ifstream in("mbo.csv");
+    std::string line, header, csv;
+    std::getline(in, header);
+    csv = header + "\n";
+    const char* ids[3] = {"1108", "2001", "3002"};
+    while (std::getline(in, line)) {
+        for (const char* id : ids) {
+            std::string copy = line;
+            size_t pos = copy.find(",1108,");
+            copy.replace(pos + 1, 4, id);
+            csv += copy + "\n";
+        }
+    }
+
+    std::string expected = mbp_header_line();
+    {
+        std::vector<std::unique_ptr<StringSink>> sinks;
+        std::vector<std::unique_ptr<Reconstructor<LadderBook, StringSink>>> books;
+        for (int i = 0; i < 3; ++i) {
+            sinks.emplace_back(new StringSink(expected));
+            books.emplace_back(new Reconstructor<LadderBook, StringSink>(*sinks.back()));
+        }
+        MboReader reader(csv.data(), csv.data() + csv.size());
+        reader.skip_header();
+        MboRecord record;
+        for (int i = 0; reader.next(record); i = (i + 1) % 3) {
+            books[i]->process(record);
+        }
+    }
+
+    for (int threads = 1; threads <= 4; ++threads) {
+        EngineOptions options;
+        options.threads = threads;
+        options.output_path = "test_output.txt";
+        options.queue_capacity = 64;
+        EngineStats stats;
+        MboReader reader(csv.data(), csv.data() + csv.size());
+        reader.skip_header();
+        assert(run_engine<LadderBook>(reader, options, &stats));
+        assert(stats.instruments == 3);
+        assert(read_file("test_output.txt") == expected);
+    }
+    std::remove("test_output.txt");
+}
+
+// split output for more instruments than the process may open files: every
+// instrument gets the same records, so every file must equal one plain run
+void test_split_output_fd_limit() {
+    std::ifstream in("mbo.csv");
+    std::string line, header, single, csv;
+    std::getline(in, header);
+    single = csv = header + "\n";
+    const int instruments = 150;
+    for (int n = 0; n < 200 && std::getline(in, line); ++n) {
+        single += line + "\n";
+        for (int id = 0; id < instruments; ++id) {
+            std::string copy = line;
+            size_t pos = copy.find(",1108,");
+            copy.replace(pos + 1, 4, std::to_string(5000 + id * 8));
+            csv += copy + "\n";
+        }
+    }
+    std::string expected = mbp_header_line();
+    {
+        StringSink sink(expected);
+        Reconstructor<LadderBook, StringSink> reconstructor(sink);
+        MboReader reader(single.data(), single.data() + single.size());
+        reader.skip_header();
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+    }
+
+    rlimit saved;
+    assert(getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    rlimit lowered = saved;
+    lowered.rlim_cur = 64;
+    assert(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+    for (int threads : {1, 3}) {
+        EngineOptions options;
+        options.threads = threads;
+        options.split_output = true;
+        options.output_path = "test_output.csv";
+        EngineStats stats;
+        MboReader reader(csv.data(), csv.data() + csv.size());
+        reader.skip_header();
+        assert(run_engine<LadderBook>(reader, options, &stats));
+        assert(stats.instruments == instruments);
+        for (int id = 0; id < instruments; ++id) {
+            std::string instrument = std::to_string(5000 + id * 8);
+            std::string path = "test_output_2_" + instrument + ".csv";
+            std::string text = read_file(path.c_str());
+            for (size_t pos = 0; (pos = text.find(",2," + instrument + ",", pos)) != std::string::npos;) {
+                text.replace(pos + 3, instrument.size(), "1108");
+            }
+            assert(text == expected);
+            std::remove(path.c_str());
+        }
+    }
+    assert(setrlimit(RLIMIT_NOFILE, &saved) == 0);
+}
+
+// mbo csv -> binary -> MboRecord must give back the same text, and the
+// binary mbp output must render to the same csv as MbpCsvWriter
+void test_binary_format() {
+    char buf[64];
+    const char* ts = "2025-07-17T08:05:03.360677248Z";
+    assert(std::string(buf, timestamp_to_chars(buf, parse_timestamp(ts))) == ts);
+    assert(std::string(buf, timestamp_to_chars(buf, 0)) == "1970-01-01T00:00:00.000000000Z");
+    assert(std::string(buf, price_to_chars_fixed(buf, 5510000000LL)) == "5.510000000");
+    assert(std::string(buf, price_to_chars_fixed(buf, UNDEF_PRICE)) == "");
+
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    {
+        OutputBuffer out(4096);
+        assert(out.open("test_output.bin"));
+        DbnFileWriter writer(out, SCHEMA_MBO);
+        writer.begin();
+        MboReader reader(input);
+        reader.skip_header();
+        MboRecord record;
+        MboBinaryRecord packed;
+        while (reader.next(record)) {
+            writer.note_symbol(record.publisher_id, record.instrument_id, record.text(MBO_SYMBOL));
+            to_binary(record, packed);
+            writer.append(&packed);
+        }
+        assert(writer.finish());
+    }
+
+    MappedFile binary;
+    assert(binary.open("test_output.bin"));
+    DbnFile file;
+    assert(file.open(binary.data(), binary.size()));
+    assert(file.schema() == SCHEMA_MBO);
+    assert(file.symbol_count() == 1);
+    assert(file.symbol(2, 1108) == "ARL");
+
+    MboReader reader(input);
+    reader.skip_header();
+    MboBinaryReader binary_reader(file, true);
+    MboRecord expected, actual;
+    uint64_t count = 0;
+    while (reader.next(expected)) {
+        assert(binary_reader.next(actual));
+        for (int i = 0; i < MBO_FIELD_COUNT; ++i) {
+            assert(actual.raw[i] == expected.raw[i]);
+        }
+        assert(actual.price == expected.price && actual.ts_recv == expected.ts_recv);
+        count++;
+    }
+    assert(!binary_reader.next(actual));
+    assert(count == file.record_count());
+
+    // reconstruct from the binary input in both output formats
+    std::string csv;
+    {
+        OutputBuffer out(4096);
+        assert(out.open("test_output.txt"));
+        MbpCsvWriter writer(out);
+        writer.write_header();
+        Reconstructor<LadderBook, MbpCsvWriter> reconstructor(writer);
+        MboBinaryReader text_reader(file, true);
+        while (text_reader.next(actual)) {
+            reconstructor.process(actual);
+        }
+        assert(out.close());
+        csv = read_file("test_output.txt");
+    }
+    {
+        OutputBuffer out(4096);
+        assert(out.open("test_output.txt"));
+        MbpBinaryWriter writer(out);
+        writer.write_header();
+        Reconstructor<LadderBook, MbpBinaryWriter> reconstructor(writer);
+        MboBinaryReader typed_reader(file, false);
+        while (typed_reader.next(actual)) {
+            reconstructor.process(actual);
+        }
+        assert(writer.finish());
+    }
+    MappedFile mbp;
+    assert(mbp.open("test_output.txt"));
+    DbnFile mbp_file;
+    assert(mbp_file.open(mbp.data(), mbp.size()));
+    assert(mbp_file.schema() == SCHEMA_MBP10);
+    std::string rendered = mbp_header_line();
+    std::vector<char> row(MBP_ROW_TEXT_MAX);
+    for (uint64_t i = 0; i < mbp_file.record_count(); ++i) {
+        const Mbp10BinaryRecord& rec = mbp_file.mbp_records()[i];
+        std::string_view symbol = mbp_file.symbol(rec.hd.publisher_id, rec.hd.instrument_id);
+        rendered.append(row.data(), render_mbp_csv_row(row.data(), rec, symbol));
+
+        // and each rendered row parses back to the same record (ts_recv aside)
+        const char* line = row.data();
+        Mbp10BinaryRecord parsed;
+        std::string_view parsed_symbol;
+        assert(parse_mbp_csv_row(line, render_mbp_csv_row(row.data(), rec, symbol) - 1, parsed, parsed_symbol));
+        assert(parsed_symbol == symbol);
+        parsed.ts_recv = rec.ts_recv;
+        assert(std::memcmp(&parsed, &rec, sizeof(rec)) == 0);
+    }
+    assert(rendered == csv);
+    std::remove("test_output.txt");
+    std::remove("test_output.bin");
+}
+
+// mbo fed through a pipe in odd-sized pieces, rows read back slowly from a
+// second pipe: the output must match the batch path and the small output
+// limit must have paused the input at least once
+void test_stream_pipe() {
+    std::string csv = read_file("mbo.csv");
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string expected = reconstruct_csv<LadderBook>(input);
+
+    int in_pipe[2], out_pipe[2];
+    assert(pipe(in_pipe) == 0 && pipe(out_pipe) == 0);
+    std::thread producer([&] {
+        for (size_t pos = 0; pos < csv.size();) {
+            size_t n = std::min<size_t>(777, csv.size() - pos);
+            ssize_t written = ::write(in_pipe[1], csv.data() + pos, n);
+            assert(written > 0);
+            pos += static_cast<size_t>(written);
+        }
+        ::close(in_pipe[1]);
+    });
+    std::string actual;
+    std::thread consumer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        char buf[4096];
+        ssize_t n;
+        while ((n = ::read(out_pipe[0], buf, sizeof(buf))) > 0) {
+            actual.append(buf, static_cast<size_t>(n));
+        }
+    });
+
+    StreamOptions options;
+    options.input_buffer = 1024;
+    options.output_limit = 4096;
+    StreamStats stats;
+    assert(run_stream<LadderBook>(in_pipe[0], out_pipe[1], options, &stats));
+    ::close(out_pipe[1]);
+    producer.join();
+    consumer.join();
+    ::close(in_pipe[0]);
+    ::close(out_pipe[0]);
+
+    assert(actual == expected);
+    assert(stats.records == 5886);
+    assert(stats.bytes_in == csv.size());
+    assert(stats.bytes_out == expected.size());
+    assert(stats.stalls > 0);
+
+    Endpoint endpoint;
+    assert(parse_endpoint("tcp:9000", endpoint) && endpoint.kind == Endpoint::TCP && endpoint.port == 9000);
+    assert(parse_endpoint("tcp:0.0.0.0:9001", endpoint) && endpoint.host == "0.0.0.0" && endpoint.port == 9001);
+    assert(parse_endpoint("unix:/tmp/mbo.sock", endpoint) && endpoint.kind == Endpoint::UNIX);
+    assert(parse_endpoint("-", endpoint) && endpoint.kind == Endpoint::STDIO);
+    assert(parse_endpoint("mbo.fifo", endpoint) && endpoint.kind == Endpoint::PATH);
+    assert(!parse_endpoint("tcp:", endpoint));
+}
+
+void test_latency_histogram() {
+    LatencyHistogram histogram;
+    assert(histogram.percentile(50) == 0 && histogram.max() == 0);
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        histogram.record(v);
+    }
+    assert(histogram.count() == 100000);
+    assert(histogram.min() == 1 && histogram.max() == 100000);
+    // within one bucket (1/64) above the exact value
+    auto close_to = [](uint64_t got, uint64_t want) { return got >= want && got <= want + want / 64; };
+    assert(close_to(histogram.percentile(50), 50000));
+    assert(close_to(histogram.percentile(99), 99000));
+    assert(close_to(histogram.percentile(99.9), 99900));
+    assert(histogram.percentile(100) == 100000);
+
+    // small values are exact
+    LatencyHistogram small;
+    small.record(3);
+    small.record(5);
+    small.record(100);
+    assert(small.percentile(50) == 5 && small.percentile(1) == 3);
+    small.merge(histogram);
+    assert(small.count() == 100003 && small.min() == 1);
+
+    // stamped lines (as mbo_replay sends them) through the stream loop
+    std::string csv = read_file("mbo.csv");
+    std::string stamped;
+    size_t pos = 0;
+    for (int line = 0; line < 60 && pos < csv.size(); ++line) {
+        size_t eol = csv.find('\n', pos);
+        stamped.append(csv, pos, eol - pos);
+        if (line > 0) {
+            stamped += "," + std::to_string(monotonic_ns());
+        }
+        stamped += '\n';
+        pos = eol + 1;
+    }
+    int in_pipe[2];
+    assert(pipe(in_pipe) == 0);
+    assert(::write(in_pipe[1], stamped.data(), stamped.size()) == static_cast<ssize_t>(stamped.size()));
+    ::close(in_pipe[1]);
+    int null_fd = ::open("/dev/null", O_WRONLY);
+    StreamStats stats;
+    assert(run_stream<LadderBook>(in_pipe[0], null_fd, StreamOptions(), &stats));
+    ::close(in_pipe[0]);
+    ::close(null_fd);
+    assert(stats.records == 59);
+    assert(stats.rows > 0 && stats.latency.count() == stats.rows);
+}
+
+// the three-stage pipeline must write exactly what the serial path writes, for
+// every book and with a small ring so the stages block on each other
+void test_pipeline() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string ladder_expected = reconstruct_csv<LadderBook>(input);
+
+    PipelineOptions options;
+    options.queue_capacity = 16;
+    options.output_path = "test_output.txt";
+    PipelineStats stats;
+    {
+        MboReader reader(input);
+        reader.skip_header();
+        assert(run_pipeline<LadderBook>(reader, options, &stats));
+        assert(read_file("test_output.txt") == ladder_expected);
+        assert(stats.records > 0 && stats.rows > 0 && stats.pin_failures == 0);
+    }
+
+    // the l3 book resolves some orders differently, compare with its own serial output
+    std::string l3_expected = reconstruct_csv<L3Book>(input);
+    {
+        MboReader reader(input);
+        reader.skip_header();
+        assert(run_pipeline<L3Book>(reader, options));
+        assert(read_file("test_output.txt") == l3_expected);
+    }
+
+    // the map book is compared against the reference formatter
+    std::string map_expected = reconstruct_csv<OrderBook>(input);
+    {
+        MboReader reader(input);
+        reader.skip_header();
+        assert(run_pipeline<OrderBook>(reader, options));
+        assert(read_file("test_output.txt") == map_expected);
+    }
+    std::remove("test_output.txt");
+}
+
+// snapshots restore the same levels, and chunked batch output (checkpointed
+// books, global row indices) equals the serial run for any chunk count
+void test_batch_reconstruction() {
+    OrderBook book;
+    book.add(12.5, 100, 'B');
+    book.add(12.0, 200, 'B');
+    book.add(13.0, 50, 'A');
+    book.cancel(12.0, 200, 'B');
+    book.add(12.25, 70, 'B');
+    std::string data;
+    book.save_snapshot(data);
+    OrderBook restored;
+    restored.add(99.0, 1, 'A');
+    size_t used = 0;
+    assert(restored.load_snapshot(data.data(), data.size(), &used) && used == data.size());
+    assert(restored.bids == book.bids && restored.asks == book.asks);
+    assert(!restored.load_snapshot(data.data(), data.size() - 1));
+
+    LadderBook ladder;
+    ladder.add(parse_price("12.5"), 100, 'B');
+    ladder.add(parse_price("12.25"), 70, 'B');
+    ladder.add(parse_price("13.0"), 50, 'A');
+    ladder.add(parse_price("250.0"), 5, 'A');
+    data.clear();
+    ladder.save_snapshot(data);
+    LadderBook ladder_restored;
+    assert(ladder_restored.load_snapshot(data.data(), data.size()));
+    assert(ladder_restored.bids.top() == ladder.bids.top() && ladder_restored.asks.top() == ladder.asks.top());
+    assert(ladder_restored.asks.size() == 2);
+
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string expected = reconstruct_csv<OrderBook>(input);
+
+    BatchOptions options;
+    options.output_path = "test_output.txt";
+    int chunk_counts[3] = {1, 3, 16};
+    for (int chunks : chunk_counts) {
+        options.chunks = chunks;
+        BatchStats stats;
+        assert(run_batch<OrderBook>(input, options, &stats));
+        assert(read_file("test_output.txt") == expected);
+        assert(stats.chunks == chunks && stats.records > 0 && stats.rows > 0);
+        assert(run_batch<LadderBook>(input, options));
+        assert(read_file("test_output.txt") == expected);
+    }
+    std::remove("test_output.txt");
+}
+
+// stop after some records, snapshot to disk, resume in a fresh book: the rows
+// written before and after the restart add up to the uninterrupted run
+void test_snapshot_resume() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    MboReader header(input);
+    header.skip_header();
+    const char* body = header.position();
+    const char* end = input.data() + input.size();
+
+    std::string expected;
+    {
+        StringSink sink(expected);
+        Reconstructor<LadderBook, StringSink> reconstructor(sink);
+        MboReader reader(body, end);
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+    }
+
+    uint64_t stops[3] = {1, 1000, 4321};
+    for (uint64_t stop : stops) {
+        std::string actual;
+        StreamPosition position;
+        {
+            StringSink sink(actual);
+            Reconstructor<LadderBook, StringSink> reconstructor(sink);
+            MboReader reader(body, end);
+            MboRecord record;
+            while (position.records < stop && reader.next(record)) {
+                reconstructor.process(record);
+                note_applied(position, record);
+            }
+            position.cached_tfc_rows = reconstructor.cached_tfc_rows();
+            position.row_index = reconstructor.row_index();
+            position.input_offset = static_cast<uint64_t>(reader.position() - input.data());
+            assert(save_snapshot_file("test_output.snap", reconstructor.book, position));
+        }
+        OrderBook wrong_kind;
+        StreamPosition loaded;
+        assert(!load_snapshot_file("test_output.snap", wrong_kind, loaded));
+        LadderBook book;
+        assert(load_snapshot_file("test_output.snap", book, loaded));
+        assert(loaded.records == stop && loaded.row_index == position.row_index);
+
+        // found from the stored offset, and by sequence number when it is off
+        const char* from = find_resume_point(input.data(), body, end, loaded);
+        assert(from == input.data() + position.input_offset);
+        loaded.input_offset = 0;
+        assert(find_resume_point(input.data(), body, end, loaded) == from);
+
+        StringSink sink(actual);
+        Reconstructor<LadderBook, StringSink> reconstructor(sink);
+        reconstructor.book = std::move(book);
+        reconstructor.resume(loaded.cached_tfc_rows, loaded.row_index);
+        MboReader reader(from, end);
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+        }
+        assert(actual == expected);
+    }
+
+    // an input that starts after the snapshot is missing records
+    StreamPosition position;
+    position.records = 10;
+    position.last_sequence = 1;
+    position.records_at_last_sequence = 1;
+    assert(find_resume_point(input.data(), body, end, position) == nullptr);
+
+    // the l3 book keeps its queues across a snapshot
+    L3Book l3;
+    l3.add(1, 100, 10, 'B');
+    l3.add(2, 100, 20, 'B');
+    l3.add(3, 100, 30, 'B');
+    l3.add(4, 105, 5, 'A');
+    l3.cancel(2, 20);
+    assert(save_snapshot_file("test_output.snap", l3, position));
+    L3Book l3_restored;
+    assert(load_snapshot_file("test_output.snap", l3_restored, position));
+    assert(l3_restored.order_count() == 3 && l3_restored.size_ahead(3) == 10);
+    assert(l3_restored.levels.bids.top() == l3.levels.bids.top());
+    std::remove("test_output.snap");
+}
+
+// book levels come from the pool and row temporaries from the arena, so once
+// warm the reference path makes no heap allocations at all
+void test_allocation_steady_state() {
+    NodePool pool(4);
+    std::vector<void*> nodes;
+    for (int i = 0; i < 10; ++i) nodes.push_back(pool.allocate(48));
+    assert(pool.stats().heap_allocations == 3);
+    for (void* p : nodes) pool.deallocate(p, 48);
+    for (int i = 0; i < 10; ++i) pool.allocate(48);
+    assert(pool.stats().heap_allocations == 3 && pool.stats().allocations == 20);
+
+    MessageArena arena(64);
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 10; ++i) {
+            char* p = arena.allocate_chars(40);
+            p[39] = 'x';
+        }
+        arena.reset();
+    }
+    uint64_t warm = arena.stats().heap_allocations;
+    for (int i = 0; i < 10; ++i) arena.allocate_chars(40);
+    arena.reset();
+    assert(arena.stats().heap_allocations == warm);
+
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::ofstream outFile("test_output.txt");
+    FormatterSink sink(outFile);
+    Reconstructor<OrderBook, FormatterSink> reconstructor(sink);
+    std::vector<MboRecord> records;
+    MboReader reader(input);
+    reader.skip_header();
+    MboRecord record;
+    while (reader.next(record)) {
+        records.push_back(record);
+    }
+    // warm up, then the same flow again on top of the warm book
+    for (const MboRecord& r : records) reconstructor.process(r);
+    uint64_t before = heap_allocations.load();
+    for (const MboRecord& r : records) reconstructor.process(r);
+    uint64_t per_flow = heap_allocations.load() - before;
+    assert(per_flow == 0);
+    assert(reconstructor.book.allocation_stats().allocations > 0);
+    outFile.close();
+    std::remove("test_output.txt");
+}
+
+// every kernel level the cpu has must agree with the scalar code, and ladder
+// depth through the kernels must still match the map book past the top 10
+void test_simd_kernels() {
+    std::mt19937_64 rng(7);
+    for (int level = SIMD_SCALAR; level <= supported_simd_level(); ++level) {
+        set_simd_level(static_cast<SimdLevel>(level));
+        assert(simd_level() == level);
+        for (int round = 0; round < 2000; ++round) {
+            LadderBook book;
+            OrderBook reference;
+            int levels = static_cast<int>(rng() % 14);
+            for (int i = 0; i < levels; ++i) {
+                int64_t bid = parse_price("10.00") - static_cast<int64_t>(rng() % 30) * (PRICE_SCALE / 100);
+                int64_t ask = parse_price("10.50") + static_cast<int64_t>(rng() % 30) * (PRICE_SCALE / 100);
+                book.add(bid, 10, 'B');
+                book.add(ask, 10, 'A');
+                reference.add(price_to_double(bid), 10, 'B');
+                reference.add(price_to_double(ask), 10, 'A');
+            }
+            int64_t probe = parse_price("9.60") + static_cast<int64_t>(rng() % 120) * (PRICE_SCALE / 100);
+            char side = (rng() & 1) ? 'B' : 'A';
+            assert(book.calculate_depth(probe, side) == reference.calculate_depth(price_to_double(probe), side));
+
+            TopLevels copy = book.bids.top();
+            assert(top_levels_equal(copy, book.bids.top()));
+            if (copy.count > 0) {
+                copy.level[rng() % copy.count].count++;
+                assert(!top_levels_equal(copy, book.bids.top()));
+            }
+            TopLevels shorter = book.asks.top();
+            shorter.count = 0;
+            assert(top_levels_equal(shorter, book.asks.top()) == (book.asks.top().count == 0));
+        }
+    }
+    set_simd_level(SIMD_AVX2);
+    assert(simd_level() == supported_simd_level());
+}
+
+static std::vector<std::string> split_csv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        fields.push_back(field);
+    }
+    if (!line.empty() && line.back() == ',') {
+        fields.push_back("");
+    }
+    return fields;
+}
+
+template <int Depth>
+static std::vector<std::vector<std::string>> reconstruct_rows_at_depth(const MappedFile& input) {
+    {
+        std::ofstream outFile("test_output.txt");
+        write_mbp_header(outFile, Depth);
+        BasicFormatterSink<Depth> sink(outFile);
+        Reconstructor<BasicOrderBook<Depth>, BasicFormatterSink<Depth>> reconstructor(sink);
+        feed_all(input, reconstructor);
+    }
+    std::ifstream in("test_output.txt");
+    std::vector<std::vector<std::string>> rows;
+    std::string line;
+    while (std::getline(in, line)) {
+        rows.push_back(split_csv(line));
+    }
+    return rows;
+}
+
+// an MBP-N row is the MBP-20 row of a record within depth N, cut to N levels
+void test_book_depth_variants() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    auto rows20 = reconstruct_rows_at_depth<20>(input);
+    auto rows5 = reconstruct_rows_at_depth<5>(input);
+    auto rows1 = reconstruct_rows_at_depth<1>(input);
+    assert(rows20[0].size() == 14 + 6 * 20 + 2 && rows20[0][14 + 6 * 19] == "bid_px_19");
+    assert(rows5[0].size() == 14 + 6 * 5 + 2 && rows1[0].size() == 14 + 6 + 2);
+
+    auto check = [&rows20](const std::vector<std::vector<std::string>>& rows, int depth) {
+        size_t next = 1;
+        for (size_t i = 1; i < rows20.size(); ++i) {
+            const auto& wide = rows20[i];
+            // trade rows are written at whatever depth the fill sits
+            bool is_trade = wide[6] == "T";
+            if (!is_trade && std::stoi(wide[8]) >= depth) {
+                continue;
+            }
+            assert(next < rows.size());
+            const auto& narrow = rows[next++];
+            assert(narrow.size() == static_cast<size_t>(14 + 6 * depth + 2));
+            assert(narrow[3] == std::to_string(depth));
+            for (int f = 1; f < 14; ++f) {
+                if (f != 3 && f != 8) assert(narrow[f] == wide[f]);
+            }
+            for (int f = 0; f < 6 * depth; ++f) {
+                assert(narrow[14 + f] == wide[14 + f]);
+            }
+            assert(narrow[14 + 6 * depth] == wide[14 + 6 * 20]);
+        }
+        assert(next == rows.size());
+    };
+    check(rows5, 5);
+    check(rows1, 1);
+    std::remove("test_output.txt");
+}
+
+// every conflated row is the unconflated row of its last update plus the
+// count of updates it stands for, and the counts add up to all updates
+void test_conflated_output() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string full = reconstruct_csv<LadderBook>(input);
+    std::vector<std::string> full_rows;
+    {
+        std::stringstream ss(full);
+        std::string line;
+        std::getline(ss, line);
+        while (std::getline(ss, line)) {
+            full_rows.push_back(line);
+        }
+    }
+
+    ConflationOptions cases[4];
+    cases[0].every = 1;
+    cases[1].every = 7;
+    cases[2].interval_ns = 1000000;
+    cases[3].interval_ns = 1000;
+    cases[3].every = 2;
+    cases[3].on_change = true;
+    for (const ConflationOptions& options : cases) {
+        ConflationStats stats;
+        {
+            OutputBuffer out;
+            assert(out.open("test_output.txt"));
+            ConflatingCsvWriter writer(out, options);
+            writer.write_header();
+            Reconstructor<LadderBook, ConflatingCsvWriter> reconstructor(writer);
+            feed_all(input, reconstructor);
+            writer.finish(reconstructor.book);
+            stats = writer.stats();
+            assert(out.close());
+        }
+        std::ifstream in("test_output.txt");
+        std::string line;
+        std::getline(in, line);
+        assert(line.size() > 10 && line.compare(line.size() - 10, 10, ",conflated") == 0);
+        uint64_t seen = 0, rows = 0;
+        while (std::getline(in, line)) {
+            size_t comma = line.rfind(',');
+            uint64_t count = std::stoull(line.substr(comma + 1));
+            assert(count >= 1);
+            if (options.every > 0 && seen + count < full_rows.size()) {
+                assert(count >= options.every);
+            }
+            seen += count;
+            assert(line.substr(0, comma) == full_rows[seen - 1]);
+            rows++;
+        }
+        assert(seen == full_rows.size() && stats.updates == seen && stats.rows == rows);
+        if (options.every == 1) {
+            assert(rows == full_rows.size());
+        } else {
+            assert(rows < full_rows.size());
+        }
+    }
+    std::remove("test_output.txt");
+}
+
+// hand-checked values on a small book, then the side file read back from a
+// run over mbo.csv
+void test_order_flow_analytics() {
+    LadderBook book;
+    OrderFlowAnalytics analytics(1000000000);
+    auto step = [&](int64_t ts, char action, char side, const char* price, int32_t size, bool is_trade) {
+        MboRecord record;
+        record.ts_event = ts;
+        record.action = action;
+        record.side = side;
+        record.price = parse_price(price);
+        record.size = size;
+        apply_record(book, record);
+        return analytics.update(record, book, is_trade);
+    };
+
+    OrderFlowRow row = step(0, 'A', 'B', "10.00", 100, false);
+    assert(row.ofi[0] == 100 && std::isnan(row.microprice) && std::isnan(row.vwap));
+    row = step(1000000, 'A', 'A', "10.02", 300, false);
+    assert(row.ofi[0] == -300 && std::fabs(row.microprice - 10.005) < 1e-9);
+    row = step(2000000, 'C', 'B', "10.00", 40, false);
+    assert(row.ofi[0] == -40 && row.bid_depletion == 40 && row.cancels == 1 && row.trades == 0);
+    assert(row.trade_cancel_ratio == 0.0);
+    row = step(3000000, 'C', 'A', "10.02", 100, true);
+    assert(row.ofi[0] == 100 && row.ask_depletion == 100 && row.trades == 1 && row.cancels == 1);
+    assert(row.trade_cancel_ratio == 1.0 && std::fabs(row.vwap - 10.02) < 1e-9);
+    // everything above has left the 1 s window; the old best bid moves to level 1
+    row = step(1500000000, 'A', 'B', "10.01", 10, false);
+    assert(row.ofi[0] == 10 && row.ofi[1] == 60 && row.trades == 0 && row.cancels == 0);
+    assert(row.bid_depletion == 0 && std::isnan(row.vwap));
+
+    // one analytics row per mbp row, across more than one block
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    AnalyticsWriter writer;
+    assert(writer.open("test_output.bin", 250000000));
+    size_t mbp_rows = 0;
+    {
+        std::string csv;
+        StringSink sink(csv);
+        OrderFlowAnalytics flow(250000000);
+        AnalyticsSink<StringSink> tap(sink, flow, writer);
+        for (int pass = 0; pass < 2; ++pass) {
+            Reconstructor<LadderBook, AnalyticsSink<StringSink>> reconstructor(tap);
+            feed_all(input, reconstructor);
+        }
+        mbp_rows = static_cast<size_t>(std::count(csv.begin(), csv.end(), '\n'));
+    }
+    assert(writer.close() && writer.rows() == mbp_rows && mbp_rows > ANALYTICS_BLOCK_ROWS);
+
+    MappedFile side;
+    assert(side.open("test_output.bin"));
+    AnalyticsTable table;
+    assert(read_analytics(side.data(), side.size(), table));
+    assert(table.rows == mbp_rows && table.window_ns == 250000000 && table.columns.size() == 19);
+    const AnalyticsColumn* ts = table.find("ts_event");
+    const AnalyticsColumn* micro = table.find("microprice");
+    assert(ts != nullptr && micro != nullptr && table.find("ofi_09") != nullptr);
+    assert(micro->type == ANALYTICS_DOUBLE && ts->type == ANALYTICS_INT64);
+    for (size_t i = 1; i < table.rows / 2; ++i) {
+        assert(ts->as_int(i) >= ts->as_int(i - 1));
+        assert(ts->as_int(i) == ts->as_int(i + table.rows / 2));
+    }
+    assert(!read_analytics(side.data(), 10, table));
+    std::remove("test_output.bin");
+}
+
+// columnar file decodes back to the same csv rows, batch by batch or one
+// column at a time
+void test_columnar_format() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string expected;
+    ColumnarStats stats;
+    {
+        StringSink sink(expected);
+        OutputBuffer out;
+        assert(out.open("test_output.bin"));
+        MbpColumnarWriter writer(out, 1000);
+        writer.write_header();
+        Reconstructor<LadderBook, StringSink> reference(sink);
+        Reconstructor<LadderBook, MbpColumnarWriter> reconstructor(writer);
+        MboReader reader(input);
+        reader.skip_header();
+        MboRecord record;
+        while (reader.next(record)) {
+            reference.process(record);
+            reconstructor.process(record);
+        }
+        assert(writer.finish());
+        stats = writer.stats();
+    }
+    assert(stats.batches == 4 && stats.rows == 3664 && stats.skipped_columns > 0);
+    assert(stats.bytes * 5 < expected.size());
+
+    std::string text = read_file("test_output.bin");
+    MbpColumnarReader reader;
+    assert(reader.open(text.data(), text.size()));
+    std::string decoded;
+    std::vector<Mbp10BinaryRecord> rows;
+    std::vector<uint32_t> symbols;
+    std::vector<int64_t> prices;
+    bool sparse_levels = false;
+    while (reader.next_batch()) {
+        assert(reader.decode_rows(rows, symbols));
+        assert(reader.decode_column(COL_PRICE, prices) && prices.size() == rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            assert(prices[i] == rows[i].price);
+            char buf[MBP_ROW_TEXT_MAX + 64];
+            decoded.append(buf, render_mbp_csv_row(buf, rows[i], reader.symbols()[symbols[i]]));
+        }
+        sparse_levels = sparse_levels || reader.encoding(COL_LEVELS + 6 * 9) == ENCODING_SPARSE ||
+                        reader.encoding(COL_LEVELS + 6 * 9) == ENCODING_CONST;
+    }
+    assert(!reader.failed() && decoded == expected && sparse_levels);
+
+    // a cut-off batch is reported, not decoded
+    assert(reader.open(text.data(), text.size() - 5));
+    int batches = 0;
+    while (reader.next_batch()) {
+        batches++;
+    }
+    assert(batches == 3 && reader.failed());
+    std::remove("test_output.bin");
+}
+
+// the counters of one ladder run line up with what the run produced
+void test_instrumentation() {
+#if OFA_INSTRUMENTATION
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    reset_metrics();
+    uint64_t records = 0;
+    std::string text = reconstruct_csv<LadderBook>(input, "test_output.txt", &records);
+    uint64_t rows = static_cast<uint64_t>(std::count(text.begin(), text.end(), '\n')) - 1;
+
+    const ThreadMetrics& m = thread_metrics();
+    uint64_t actions = 0, outcomes = 0;
+    for (const auto& counter : m.actions) actions += counter.get();
+    for (const auto& counter : m.rows) outcomes += counter.get();
+    assert(actions == records && outcomes == records);
+    assert(m.rows[ROW_EMITTED].get() + m.rows[ROW_TRADE].get() == rows);
+    assert(m.stage_calls[STAGE_PARSE].get() == records + 1);
+    assert(m.stage_calls[STAGE_BOOK].get() == rows + m.rows[ROW_SUPPRESSED].get());
+    assert(m.stage_calls[STAGE_SNAPSHOT].get() == rows && m.stage_calls[STAGE_FORMAT].get() == rows);
+    assert(m.stage_calls[STAGE_WRITE].get() >= 1 && m.stage_cycles[STAGE_FORMAT].get() > 0);
+    assert(m.max_bid_levels.get() > 0 && m.max_ask_levels.get() > 0);
+
+    std::stringstream json;
+    write_metrics_json(json);
+    assert(json.str().find("\"snapshot\": {\"calls\": " + std::to_string(rows)) != std::string::npos);
+    assert(json.str().find("\"tfc_pending\"") != std::string::npos);
+
+    // an inner stage's cycles are not counted again in the outer one
+    reset_metrics();
+    {
+        OFA_STAGE(STAGE_FORMAT);
+        OFA_STAGE(STAGE_WRITE);
+        volatile uint64_t spin = 0;
+        for (int i = 0; i < 100000; ++i) spin = spin + i;
+    }
+    assert(m.stage_calls[STAGE_FORMAT].get() == 1 && m.stage_calls[STAGE_WRITE].get() == 1);
+    assert(m.stage_cycles[STAGE_FORMAT].get() < m.stage_cycles[STAGE_WRITE].get());
+    std::remove("test_output.txt");
+#endif
+}
+
+// an index built alongside a csv run must give the same book as a replay
+// from the top at any time, and the same rows as a linear scan of the output
+void test_time_index() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    TimeIndexOptions options;
+    options.path = "test_output.idx";
+    options.index_every = 50;
+    options.checkpoint_every = 3;
+    std::vector<int64_t> times;
+    {
+        OutputBuffer out;
+        assert(out.open("test_output.txt"));
+        MbpCsvWriter writer(out);
+        writer.write_header();
+        Reconstructor<LadderBook, MbpCsvWriter> reconstructor(writer);
+        TimeIndexWriter index;
+        assert(index.open(options, snapshot_kind<LadderBook>()));
+        MboReader reader(input);
+        reader.skip_header();
+        StreamPosition position;
+        position.input_offset = static_cast<uint64_t>(reader.position() - input.data());
+        position.output_offset = out.tell();
+        int64_t latest = INT64_MIN;
+        index.add(reconstructor.book, latest, position);
+        MboRecord record;
+        while (reader.next(record)) {
+            reconstructor.process(record);
+            note_applied(position, record);
+            latest = std::max(latest, record.ts_event);
+            times.push_back(record.ts_event);
+            if (position.records % options.index_every == 0) {
+                position.cached_tfc_rows = reconstructor.cached_tfc_rows();
+                position.row_index = reconstructor.row_index();
+                position.input_offset = static_cast<uint64_t>(reader.position() - input.data());
+                position.output_offset = out.tell();
+                index.add(reconstructor.book, latest, position);
+            }
+        }
+        assert(index.finish());
+        assert(out.close());
+    }
+    TimeIndex index;
+    assert(index.open("test_output.idx"));
+    assert(index.book_kind() == SNAPSHOT_LADDER);
+    assert(index.size() == 1 + times.size() / options.index_every);
+    MappedFile mbp;
+    assert(mbp.open("test_output.txt"));
+
+    std::vector<int64_t> probes = {times.front() - 1, times.front(), times.back(), times.back() + 1};
+    for (size_t i = 1; i < times.size(); i += 397) {
+        probes.push_back(times[i]);
+        probes.push_back(times[i] + 1);
+    }
+    for (int64_t ts : probes) {
+        // reference: everything up to the first record past ts, from the top
+        NullSink sink;
+        Reconstructor<LadderBook, NullSink> reference(sink);
+        MboReader reader(input);
+        reader.skip_header();
+        MboRecord record;
+        while (reader.next(record) && record.ts_event <= ts) {
+            reference.process(record);
+        }
+        LadderBook book;
+        StreamPosition position;
+        assert(book_at(index, input, ts, book, &position));
+        std::string expected, got;
+        reference.book.save_snapshot(expected);
+        book.save_snapshot(got);
+        assert(got == expected);
+        assert(position.row_index == reference.row_index());
+
+        int64_t to = ts + 2000000000;
+        std::vector<std::string> scanned, queried;
+        std::stringstream ss(std::string(mbp.data(), mbp.size()));
+        std::string line;
+        std::getline(ss, line);
+        while (std::getline(ss, line)) {
+            int64_t row_ts = parse_timestamp(split_csv(line)[2]);
+            if (row_ts >= ts && row_ts <= to) {
+                scanned.push_back(line);
+            }
+        }
+        assert(rows_between(index, mbp, ts, to, [&](std::string_view row) { queried.emplace_back(row); }));
+        assert(queried == scanned);
+    }
+
+    int64_t ts = 0;
+    assert(parse_query_time("2025-07-17T10:31:07.5Z", 0, ts) && ts == parse_timestamp("2025-07-17T10:31:07.500000000Z"));
+    assert(parse_query_time("10:31:07.5", times.front(), ts) && ts == parse_timestamp("2025-07-17T10:31:07.500000000Z"));
+    assert(parse_query_time("10:31", times.front(), ts) && ts == parse_timestamp("2025-07-17T10:31:00.000000000Z"));
+    assert(parse_query_time("1752748267000000000", 0, ts) && ts == 1752748267000000000LL);
+    assert(!parse_query_time("10:3x", 0, ts));
+    std::remove("test_output.txt");
+    std::remove("test_output.idx");
+}
+
+// jobs of uneven size on fewer workers than files: every output must match
+// a serial run of its input, whichever worker ended up with it
+void test_file_jobs() {
+    std::string full = read_file("mbo.csv");
+    size_t line_counts[4] = {5000, 40, 1, 1200};
+    std::ofstream manifest("test_output_jobs.txt");
+    manifest << "# inputs, the second one with its own output path\n";
+    for (int i = 0; i < 4; ++i) {
+        size_t end = 0;
+        for (size_t n = 0; n < line_counts[i] && end != std::string::npos; ++n) {
+            end = full.find('\n', end);
+            if (end != std::string::npos) end++;
+        }
+        std::string input = "test_output_job" + std::to_string(i) + ".csv";
+        std::ofstream(input) << full.substr(0, end);
+        manifest << input << (i == 1 ? "   test_output_job1.out.csv" : "") << "\n";
+    }
+    manifest.close();
+
+    FileJobOptions options;
+    options.workers = 2;
+    std::vector<FileJob> jobs;
+    std::string error;
+    assert(collect_file_jobs("@test_output_jobs.txt", options, jobs, error));
+    assert(jobs.size() == 4 && jobs[0].output == "test_output_job0.mbp.csv" && jobs[1].output == "test_output_job1.out.csv");
+    FileJobStats stats;
+    assert(run_file_jobs<LadderBook>(jobs, options, &stats));
+    assert(stats.files == 4 && stats.failed == 0);
+    uint64_t records = 0;
+    for (const FileJob& job : jobs) {
+        assert(job.ok && job.worker >= 0 && job.worker < 2);
+        records += job.records;
+
+        MappedFile input;
+        assert(input.open(job.input.c_str()));
+        assert(read_file(job.output.c_str()) == reconstruct_csv<LadderBook>(input));
+    }
+    assert(stats.records == records && records == 5000 + 40 + 1200 - 3);
+
+    // a glob over the same directory again leaves the *.mbp.csv outputs out
+    assert(collect_file_jobs("test_output_job*.csv", options, jobs, error));
+    assert(jobs.size() == 5);
+
+    // two inputs with one stem would overwrite each other's output
+    std::ofstream("test_output_jobs.txt") << "test_output_job0.csv\nx/test_output_job0.csv test_output_job0.mbp.csv\n";
+    assert(!collect_file_jobs("@test_output_jobs.txt", options, jobs, error));
+    assert(!collect_file_jobs("test_output_no_such_*.csv", options, jobs, error));
+
+    for (int i = 0; i < 4; ++i) {
+        std::string stem = "test_output_job" + std::to_string(i);
+        std::remove((stem + ".csv").c_str());
+        std::remove((stem + ".mbp.csv").c_str());
+    }
+    std::remove("test_output_job1.out.csv");
+    std::remove("test_output_jobs.txt");
+    std::remove("test_output.txt");
+}
+
+// the differential file must expand back into exactly the csv the plain
+// writer produces, whatever the refresh interval
+void test_delta_format() {
+    MappedFile input;
+    assert(input.open("mbo.csv"));
+    std::string csv = reconstruct_csv<LadderBook>(input);
+
+    for (uint32_t refresh_rows : {1u, 5u, DEFAULT_REFRESH_ROWS}) {
+        DeltaStats stats;
+        {
+            OutputBuffer out;
+            assert(out.open("test_output.bin"));
+            MbpDeltaWriter writer(out, refresh_rows);
+            writer.write_header();
+            Reconstructor<LadderBook, MbpDeltaWriter> reconstructor(writer);
+            feed_all(input, reconstructor);
+            assert(writer.finish());
+            stats = writer.stats();
+        }
+        MappedFile delta;
+        assert(delta.open("test_output.bin"));
+        assert(is_delta_file(delta.data(), delta.size()) && delta.size() == stats.bytes);
+        assert(stats.refreshes == (stats.rows + refresh_rows - 1) / refresh_rows);
+        if (refresh_rows == DEFAULT_REFRESH_ROWS) {
+            assert(delta.size() * 5 < csv.size());
+        }
+
+        MbpDeltaReader reader;
+        assert(reader.open(delta.data(), delta.size()));
+        std::string decoded = mbp_header_line();
+        Mbp10BinaryRecord row;
+        std::string_view symbol;
+        uint64_t rows = 0;
+        while (reader.next(row, symbol)) {
+            char buf[MBP_ROW_TEXT_MAX + 64];
+            decoded.append(buf, render_mbp_csv_row(buf, row, symbol));
+            rows++;
+        }
+        assert(!reader.failed() && rows == stats.rows);
+        assert(decoded == csv);
+
+        // cut mid-row: the rows before the cut decode, then the reader reports the damage
+        assert(reader.open(delta.data(), delta.size() - 3));
+        while (reader.next(row, symbol)) {
+        }
+        assert(reader.failed());
+    }
+    std::remove("test_output.bin");
+}
+
+void test_verify() {
+    auto write_file = [](const char* path, const std::string& text) {
+        std::ofstream out(path, std::ios::binary);
+        out << text;
+    };
+
+    // tiny buffer: refills, a line longer than the buffer, \r\n and no final newline
+    write_file("test_output.csv", "a,b\r\n0123456789abcdef,x\n\nlast");
+    {
+        LineStream lines(8);
+        assert(lines.open("test_output.csv"));
+        std::string_view line;
+        assert(lines.next(line) && line == "a,b");
+        assert(lines.next(line) && line == "0123456789abcdef,x");
+        assert(lines.next(line) && line.empty());
+        assert(lines.next(line) && line == "last");
+        assert(!lines.next(line) && !lines.failed());
+    }
+
+    std::string header = ",ts_recv,action,depth,price\n";
+    write_file("test_reference.csv", header + "0,t0,A,0,5.5\n1,t1,A,12,4.0\n2,t2,C,1,5.4\n");
+    VerifyOptions options;
+    VerifyResult result;
+    std::string error;
+    assert(!verify_mbp_csv("missing.csv", "test_reference.csv", options, result, error) && !error.empty());
+
+    write_file("test_output.csv", header + "0,t0,A,0,5.5\n1,t1,A,12,4.0\n2,t2,C,1,5.4\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(!result.diverged && result.rows == 3 && result.skipped == 0);
+
+    // first differing column of the first differing row
+    write_file("test_output.csv", header + "0,t0,A,0,5.5\n1,t1,A,12,4.1\n2,t2,A,1,5.3\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(result.diverged && result.rows == 1);
+    assert(result.first.line == 3 && result.first.reference_line == 3);
+    assert(result.first.column == 4 && result.first.column_name == "price");
+    assert(result.first.expected == "4.0" && result.first.actual == "4.1");
+    assert(describe_divergence(result.first).find("row 1 ") == 0);
+
+    // output ends early
+    write_file("test_output.csv", header + "0,t0,A,0,5.5\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(result.diverged && result.first.column == -1 && result.first.line == 3);
+    assert(result.first.actual == "<end of file>" && result.first.expected == "1,t1,A,12,4.0");
+
+    // skip_deep drops the depth 12 reference row and ignores the shifted row index
+    write_file("test_output.csv", header + "0,t0,A,0,5.5\n1,t2,C,1,5.4\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(result.diverged && result.first.column == 1);
+    options.skip_deep = true;
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(!result.diverged && result.rows == 2 && result.skipped == 1);
+
+    // max_rows gates only the prefix, ignore_columns lets a named column differ
+    options.skip_deep = false;
+    write_file("test_output.csv", header + "0,t0,A,0,5.5\n1,t1,A,12,4.0\n2,t2,A,1,5.4\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(result.diverged && result.first.column == 2);
+    options.max_rows = 2;
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(!result.diverged && result.rows == 2);
+    options.max_rows = 0;
+    options.ignore_columns = {"action"};
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(!result.diverged && result.rows == 3);
+    options.ignore_columns = {"px"};
+    assert(!verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    options.ignore_columns.clear();
+    options.skip_deep = true;
+
+    // a changed header is reported before any row
+    write_file("test_output.csv", ",ts_recv,action,depth,px\n0,t0,A,0,5.5\n");
+    assert(verify_mbp_csv("test_output.csv", "test_reference.csv", options, result, error));
+    assert(result.diverged && result.first.line == 1 && result.first.column == 4);
+    std::remove("test_output.csv");
+    std::remove("test_reference.csv");
+}
+
 void test_edge_cases() {
     OrderBook book;
     MBPFormatter formatter;
@@ -179,11 +1809,20 @@ void test_edge_cases() {
     book.add(999999.99, 1000000, 'B');
     book.add(0.00001, 1, 'A');
     
-    std::vector<std::string> previous_snapshot = formatter.generate_top_10_snapshot(book);
+    MBPFormatter::Snapshot previous_snapshot = formatter.generate_top_10_snapshot(book);
     assert(!formatter.check_snapshot_changed(previous_snapshot, book));
     
     book.add(12.5, 100, 'B');
     assert(formatter.check_snapshot_changed(previous_snapshot, book));
+
+    // an empty input maps to an empty range
+    { std::ofstream empty("test_output.txt"); }
+    MappedFile input;
+    assert(input.open("test_output.txt") && input.is_open() && input.size() == 0);
+    MboReader reader(input);
+    MboRecord record;
+    assert(!reader.skip_header() && !reader.next(record));
+    std::remove("test_output.txt");
 }
 
 void test_deep_book() {
@@ -234,6 +1873,88 @@ int main() {
         test_mbo_parsing();
         std::cout << "mbo_parsing" << std::endl;
         
+        test_mbo_record_parsing();
+        std::cout << "mbo_record_parsing" << std::endl;
+        
+        test_ladder_book_basic();
+        std::cout << "ladder_book_basic" << std::endl;
+        
+        test_ladder_matches_map_book();
+        std::cout << "ladder_matches_map" << std::endl;
+        
+        test_incremental_top_levels();
+        std::cout << "incremental_top" << std::endl;
+        
+        test_flat_hash_table();
+        std::cout << "flat_hash_table" << std::endl;
+        
+        test_l3_book();
+        std::cout << "l3_book" << std::endl;
+        
+        test_l3_matches_ladder_book();
+        std::cout << "l3_matches_ladder" << std::endl;
+        
+        test_number_formatting();
+        std::cout << "number_formatting" << std::endl;
+        
+        test_csv_writer_matches_formatter();
+        test_sub_micro_prices();
+        std::cout << "csv_writer" << std::endl;
+        
+        test_multi_instrument_engine();
+        test_split_output_fd_limit();
+        std::cout << "multi_instrument_engine" << std::endl;
+        
+        test_binary_format();
+        std::cout << "binary_format" << std::endl;
+        
+        test_stream_pipe();
+        std::cout << "stream_pipe" << std::endl;
+        
+        test_latency_histogram();
+        std::cout << "latency_histogram" << std::endl;
+        
+        test_pipeline();
+        std::cout << "pipeline" << std::endl;
+        
+        test_batch_reconstruction();
+        std::cout << "batch_reconstruction" << std::endl;
+        
+        test_snapshot_resume();
+        std::cout << "snapshot_resume" << std::endl;
+        
+        test_allocation_steady_state();
+        std::cout << "allocation_steady_state" << std::endl;
+        
+        test_simd_kernels();
+        std::cout << "simd_kernels (" << simd_level_name(supported_simd_level()) << ")" << std::endl;
+        
+        test_book_depth_variants();
+        std::cout << "book_depth_variants" << std::endl;
+        
+        test_conflated_output();
+        std::cout << "conflated_output" << std::endl;
+        
+        test_order_flow_analytics();
+        std::cout << "order_flow_analytics" << std::endl;
+        
+        test_columnar_format();
+        std::cout << "columnar_format" << std::endl;
+        
+        test_instrumentation();
+        std::cout << "instrumentation" << std::endl;
+        
+        test_time_index();
+        std::cout << "time_index" << std::endl;
+        
+        test_file_jobs();
+        std::cout << "file_jobs" << std::endl;
+        
+        test_delta_format();
+        std::cout << "delta_format" << std::endl;
+        test_verify();
+        std::cout << "verify" << std::endl;
+        
         test_edge_cases();
         std::cout << "edge_cases" << std::endl;
         
@@ -0,0 +1,188 @@
+#include "time_index.h"
+#include "reconstructor.h"
+#include <algorithm>
+#include <cstring>
+
+bool TimeIndexWriter::open(const TimeIndexOptions& options, uint16_t book_kind) {
+    if (!out_.open(options.path.c_str())) {
+        return false;
+    }
+    std::memcpy(header_.magic, TIME_INDEX_MAGIC, sizeof(header_.magic));
+    header_.version = TIME_INDEX_VERSION;
+    header_.book = book_kind;
+    checkpoint_every_ = std::max<uint64_t>(options.checkpoint_every, 1);
+    entries_.clear();
+    // placeholder, rewritten by finish()
+    out_.append(std::string_view(reinterpret_cast<const char*>(&header_), sizeof(header_)));
+    offset_ = sizeof(header_);
+    return true;
+}
+
+template <typename Book>
+void TimeIndexWriter::add(const Book& book, int64_t ts_event, const StreamPosition& position) {
+    TimeIndexEntry entry = {};
+    entry.ts_event = ts_event;
+    entry.position = position;
+    if (entries_.size() % checkpoint_every_ == 0) {
+        scratch_.clear();
+        book.save_snapshot(scratch_);
+        // keep checkpoints 8-byte aligned so the entries array is too
+        scratch_.resize((scratch_.size() + 7) & ~static_cast<size_t>(7), '\0');
+        entry.checkpoint_offset = offset_;
+        entry.checkpoint_bytes = static_cast<uint32_t>(scratch_.size());
+        entry.checkpoint_entry = static_cast<uint32_t>(entries_.size());
+        out_.append(scratch_);
+        offset_ += scratch_.size();
+    } else {
+        const TimeIndexEntry& last = entries_.back();
+        entry.checkpoint_offset = last.checkpoint_offset;
+        entry.checkpoint_bytes = last.checkpoint_bytes;
+        entry.checkpoint_entry = last.checkpoint_entry;
+    }
+    entries_.push_back(entry);
+}
+
+bool TimeIndexWriter::finish() {
+    header_.entry_count = entries_.size();
+    header_.entries_offset = offset_;
+    out_.append(std::string_view(reinterpret_cast<const char*>(entries_.data()),
+                                 entries_.size() * sizeof(TimeIndexEntry)));
+    bool ok = out_.write_at(0, &header_, sizeof(header_));
+    return out_.close() && ok;
+}
+
+bool TimeIndex::open(const char* path) {
+    if (!file_.open(path) || file_.size() < sizeof(TimeIndexHeader)) {
+        return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, TIME_INDEX_MAGIC, sizeof(header_.magic)) != 0 ||
+        header_.version != TIME_INDEX_VERSION || header_.entry_count == 0 || header_.entries_offset % 8 != 0 ||
+        header_.entries_offset > file_.size() ||
+        (file_.size() - header_.entries_offset) / sizeof(TimeIndexEntry) < header_.entry_count) {
+        return false;
+    }
+    entries_ = reinterpret_cast<const TimeIndexEntry*>(file_.data() + header_.entries_offset);
+    for (size_t i = 0; i < size(); ++i) {
+        const TimeIndexEntry& entry = entries_[i];
+        if (entry.checkpoint_entry > i || entry.checkpoint_offset > header_.entries_offset ||
+            entry.checkpoint_bytes > header_.entries_offset - entry.checkpoint_offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t TimeIndex::floor(int64_t ts) const {
+    const TimeIndexEntry* end = entries_ + size();
+    const TimeIndexEntry* it = std::upper_bound(entries_, end, ts, [](int64_t t, const TimeIndexEntry& entry) {
+        return t < entry.ts_event;
+    });
+    return (it == entries_) ? 0 : static_cast<size_t>(it - entries_) - 1;
+}
+
+size_t TimeIndex::before(int64_t ts) const {
+    const TimeIndexEntry* end = entries_ + size();
+    const TimeIndexEntry* it = std::lower_bound(entries_, end, ts, [](const TimeIndexEntry& entry, int64_t t) {
+        return entry.ts_event < t;
+    });
+    return (it == entries_) ? 0 : static_cast<size_t>(it - entries_) - 1;
+}
+
+template <typename Book>
+bool TimeIndex::load_checkpoint(size_t i, Book& book, StreamPosition& position) const {
+    if (i >= size() || header_.book != snapshot_kind<Book>()) {
+        return false;
+    }
+    const TimeIndexEntry& checkpoint = entries_[entries_[i].checkpoint_entry];
+    if (!book.load_snapshot(file_.data() + checkpoint.checkpoint_offset, checkpoint.checkpoint_bytes)) {
+        return false;
+    }
+    position = checkpoint.position;
+    return true;
+}
+
+template <typename Book>
+bool book_at(const TimeIndex& index, const MappedFile& mbo, int64_t ts, Book& book, StreamPosition* position) {
+    StreamPosition at;
+    Book checkpoint;
+    if (!index.load_checkpoint(index.floor(ts), checkpoint, at) || at.input_offset > mbo.size()) {
+        return false;
+    }
+    NullSink sink;
+    Reconstructor<Book, NullSink> reconstructor(sink);
+    reconstructor.book = std::move(checkpoint);
+    reconstructor.resume(at.cached_tfc_rows, at.row_index);
+    MboReader reader(mbo.data() + at.input_offset, mbo.data() + mbo.size());
+    const char* line = reader.position();
+    MboRecord record;
+    while (reader.next(record) && record.ts_event <= ts) {
+        reconstructor.process(record);
+        note_applied(at, record);
+        line = reader.position();
+    }
+    book = std::move(reconstructor.book);
+    if (position != nullptr) {
+        at.cached_tfc_rows = reconstructor.cached_tfc_rows();
+        at.row_index = reconstructor.row_index();
+        at.input_offset = static_cast<uint64_t>(line - mbo.data());
+        at.output_offset = 0;   // not tracked by the replay
+        *position = at;
+    }
+    return true;
+}
+
+static bool parse_digits(std::string_view s, int64_t& value) {
+    if (s.empty()) {
+        return false;
+    }
+    value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+bool parse_query_time(std::string_view text, int64_t day_of, int64_t& ts) {
+    if (text.size() >= 19 && text[4] == '-' && text[10] == 'T') {
+        ts = parse_timestamp(text);
+        return true;
+    }
+    if (text.find(':') == std::string_view::npos) {
+        return parse_digits(text, ts);
+    }
+    // HH:MM[:SS[.fraction]]
+    int64_t hours = 0, minutes = 0, seconds = 0, nanos = 0;
+    if (text.size() < 5 || text[2] != ':' || !parse_digits(text.substr(0, 2), hours) ||
+        !parse_digits(text.substr(3, 2), minutes)) {
+        return false;
+    }
+    if (text.size() > 5) {
+        if (text.size() < 8 || text[5] != ':' || !parse_digits(text.substr(6, 2), seconds)) {
+            return false;
+        }
+        if (text.size() > 8) {
+            std::string_view fraction = text.substr(9);
+            if (text[8] != '.' || fraction.size() > 9 || !parse_digits(fraction, nanos)) {
+                return false;
+            }
+            for (size_t i = fraction.size(); i < 9; ++i) nanos *= 10;
+        }
+    }
+    const int64_t day_ns = 86400LL * 1000000000LL;
+    int64_t day = day_of - ((day_of % day_ns) + day_ns) % day_ns;
+    ts = day + ((hours * 60 + minutes) * 60 + seconds) * 1000000000LL + nanos;
+    return true;
+}
+
+#define INSTANTIATE_TIME_INDEX(Book)                                                                  \
+    template void TimeIndexWriter::add<Book>(const Book&, int64_t, const StreamPosition&);           \
+    template bool TimeIndex::load_checkpoint<Book>(size_t, Book&, StreamPosition&) const;            \
+    template bool book_at<Book>(const TimeIndex&, const MappedFile&, int64_t, Book&, StreamPosition*);
+
+INSTANTIATE_TIME_INDEX(OrderBook)
+INSTANTIATE_TIME_INDEX(LadderBook)
+INSTANTIATE_TIME_INDEX(L3Book)
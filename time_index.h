@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mbo_reader.h"
+#include "mbp_writer.h"
+#include "snapshot.h"
+
+// Sparse time index over one run: every index_every input records an entry
+// maps the latest ts_event applied so far to the stream position (input and
+// output offsets, reconstructor counters), and every checkpoint_every entries
+// the entry also carries a full book checkpoint (the book's save_snapshot
+// bytes). Entry 0 is the start of the input with an empty book.
+//
+// File layout: TimeIndexHeader, the checkpoints back to back, then
+// entry_count TimeIndexEntry at entries_offset. Written by TimeIndexWriter
+// during a csv run, read by TimeIndex.
+static constexpr char TIME_INDEX_MAGIC[4] = {'O', 'F', 'A', 'I'};
+static constexpr uint16_t TIME_INDEX_VERSION = 1;
+
+struct TimeIndexHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t book;              // SnapshotBook of the checkpoints
+    uint64_t entry_count;
+    uint64_t entries_offset;
+    uint64_t reserved;
+};
+static_assert(sizeof(TimeIndexHeader) == 32, "TimeIndexHeader layout");
+
+struct TimeIndexEntry {
+    int64_t ts_event;           // largest ts_event applied so far, INT64_MIN for entry 0
+    uint64_t checkpoint_offset; // the latest checkpoint at or before this entry
+    uint32_t checkpoint_bytes;
+    uint32_t checkpoint_entry;  // entry the checkpoint was taken at
+    StreamPosition position;
+};
+static_assert(sizeof(TimeIndexEntry) == 64, "TimeIndexEntry layout");
+
+struct TimeIndexOptions {
+    std::string path;               // empty = no index
+    uint64_t index_every = 1000;    // input records per entry
+    uint64_t checkpoint_every = 16; // entries per book checkpoint
+};
+
+class TimeIndexWriter {
+private:
+    OutputBuffer out_;
+    TimeIndexHeader header_ = {};
+    std::vector<TimeIndexEntry> entries_;
+    uint64_t checkpoint_every_ = 1;
+    uint64_t offset_ = 0;
+    std::string scratch_;
+
+public:
+    // book_kind is snapshot_kind<Book>() of the checkpoints
+    bool open(const TimeIndexOptions& options, uint16_t book_kind);
+    // one entry for the state after the records counted in position
+    template <typename Book>
+    void add(const Book& book, int64_t ts_event, const StreamPosition& position);
+    // writes the entries and the final header
+    bool finish();
+};
+
+// Read side: the whole index mapped, entries binary searched by ts_event.
+class TimeIndex {
+private:
+    MappedFile file_;
+    TimeIndexHeader header_ = {};
+    const TimeIndexEntry* entries_ = nullptr;
+
+public:
+    bool open(const char* path);
+
+    uint16_t book_kind() const { return header_.book; }
+    size_t size() const { return static_cast<size_t>(header_.entry_count); }
+    const TimeIndexEntry& entry(size_t i) const { return entries_[i]; }
+    // last entry with ts_event <= ts (entry 0 when none)
+    size_t floor(int64_t ts) const;
+    // last entry with ts_event < ts (entry 0 when none)
+    size_t before(int64_t ts) const;
+    template <typename Book>
+    bool load_checkpoint(size_t i, Book& book, StreamPosition& position) const;
+};
+
+// The book after every record of mbo (the csv the index was built from), in
+// file order, up to the first one with ts_event > ts: the nearest checkpoint
+// plus a forward replay of at most index_every * checkpoint_every records.
+template <typename Book>
+bool book_at(const TimeIndex& index, const MappedFile& mbo, int64_t ts, Book& book, StreamPosition* position = nullptr);
+
+// Calls f(line) for every row of mbp (the csv the index was built with)
+// whose ts_event is in [from, to], starting from the indexed output offset
+// and stopping at the first row past to.
+template <typename F>
+bool rows_between(const TimeIndex& index, const MappedFile& mbp, int64_t from, int64_t to, F&& f) {
+    uint64_t offset = index.entry(index.before(from)).position.output_offset;
+    if (offset > mbp.size()) {
+        return false;
+    }
+    const char* cur = mbp.data() + offset;
+    const char* end = mbp.data() + mbp.size();
+    while (cur < end) {
+        const char* eol = find_newline(cur, end);
+        std::string_view line(cur, static_cast<size_t>(eol - cur));
+        cur = (eol < end) ? eol + 1 : end;
+        // ts_event is the third column, after the row index and ts_recv
+        const char* line_end = line.data() + line.size();
+        const char* second = find_delimiter(line.data(), line_end);
+        if (second < line_end) second = find_delimiter(second + 1, line_end);
+        if (second == line_end) {
+            continue;
+        }
+        const char* third = find_delimiter(second + 1, line_end);
+        int64_t ts = parse_timestamp(std::string_view(second + 1, static_cast<size_t>(third - second - 1)));
+        if (ts > to) {
+            break;
+        }
+        if (ts >= from) {
+            f(line);
+        }
+    }
+    return true;
+}
+
+// "2025-07-17T10:31:07.123Z", ns since epoch, or a time of day
+// ("10:31:07.123", UTC) on the day of day_of (ns since epoch)
+bool parse_query_time(std::string_view text, int64_t day_of, int64_t& ts);
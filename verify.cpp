@@ -0,0 +1,314 @@
+#include "verify.h"
+#include "order_book.h"
+#include "ladder_book.h"
+#include "l3_book.h"
+#include "reconstructor.h"
+#include "mbo_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+
+// field `column` of a csv line, empty if the line is shorter
+std::string_view field(std::string_view line, int column) {
+    size_t begin = 0;
+    for (int i = 0; i < column; ++i) {
+        begin = line.find(',', begin);
+        if (begin == std::string_view::npos) {
+            return std::string_view();
+        }
+        begin++;
+    }
+    size_t end = line.find(',', begin);
+    return line.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+}
+
+std::vector<std::string_view> split(std::string_view line) {
+    std::vector<std::string_view> fields;
+    size_t begin = 0;
+    while (true) {
+        size_t end = line.find(',', begin);
+        if (end == std::string_view::npos) {
+            fields.push_back(line.substr(begin));
+            return fields;
+        }
+        fields.push_back(line.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
+// everything after the row index column
+std::string_view without_index(std::string_view line) {
+    size_t comma = line.find(',');
+    return comma == std::string_view::npos ? std::string_view() : line.substr(comma);
+}
+
+// first column where the rows differ, from first_column on and not ignored; -1 if none
+int first_difference(std::string_view actual, std::string_view expected, int first_column,
+                     const std::vector<bool>& ignored, std::string& actual_text, std::string& expected_text) {
+    std::vector<std::string_view> a = split(actual);
+    std::vector<std::string_view> e = split(expected);
+    size_t columns = std::max(a.size(), e.size());
+    for (size_t c = static_cast<size_t>(first_column); c < columns; ++c) {
+        bool have_a = c < a.size();
+        bool have_e = c < e.size();
+        if ((have_a && have_e && a[c] == e[c]) || (c < ignored.size() && ignored[c])) {
+            continue;
+        }
+        actual_text = have_a ? std::string(a[c]) : "<missing>";
+        expected_text = have_e ? std::string(e[c]) : "<missing>";
+        return static_cast<int>(c);
+    }
+    return -1;
+}
+
+void print_book(const OrderBook& book) { MBPFormatter().print_book(book); }
+
+// one ladder side in the MBPFormatter::print_book layout, numbered from the touch
+void print_side(const char* title, const LadderSide& side) {
+    std::vector<std::pair<int64_t, PriceLevel>> levels;
+    side.for_each_level(INT_MAX, [&](int64_t price, const PriceLevel& level) { levels.emplace_back(price, level); });
+    std::cout << title << " (" << levels.size() << " levels):" << std::endl;
+    if (levels.empty()) {
+        std::cout << "  (empty)" << std::endl;
+    }
+    // asks worst first so both sides meet at the touch
+    for (size_t i = 0; i < levels.size(); ++i) {
+        size_t rank = side.is_bid() ? i : levels.size() - 1 - i;
+        size_t edge = static_cast<size_t>(side.is_bid() ? MAX_BOOK_DEPTH : MAX_BOOK_DEPTH - 1);
+        if (i > 0 && rank == edge) {
+            std::cout << "  ******** End of Top " << MAX_BOOK_DEPTH << " ********" << std::endl;
+        }
+        std::cout << "  [" << rank << "]\t"
+                  << "Price: " << price_to_double(levels[rank].first)
+                  << "\t| Size: " << levels[rank].second.size
+                  << "\t| Count: " << levels[rank].second.count << std::endl;
+    }
+}
+
+void print_book(const LadderBook& book) {
+    print_side("ASKS", book.asks);
+    std::cout << "------------------------------------" << std::endl;
+    print_side("BIDS", book.bids);
+    std::cout << "====================================" << std::endl;
+}
+
+void print_book(const L3Book& book) { print_book(book.levels); }
+
+// replays input through Book until the row with index target is written
+template <typename Book>
+bool replay_to_row(const MappedFile& input, uint64_t target) {
+    MboReader reader(input);
+    reader.skip_header();
+    NullSink null;
+    CountingSink<NullSink> sink(null);
+    Reconstructor<Book, CountingSink<NullSink>> reconstructor(sink);
+    uint64_t mbo_line = 1;
+    const char* line_start = reader.position();
+    MboRecord record;
+    while (sink.rows <= target) {
+        line_start = reader.position();
+        if (!reader.next(record)) {
+            std::cout << "Input ended before row " << target << ", book at end of input:" << std::endl;
+            print_book(reconstructor.book);
+            return false;
+        }
+        mbo_line++;
+        reconstructor.process(record);
+    }
+    const char* line_end = find_newline(line_start, input.data() + input.size());
+    std::cout << "Book after mbo line " << mbo_line << ": " << std::string_view(line_start, line_end - line_start)
+              << std::endl;
+    print_book(reconstructor.book);
+    return true;
+}
+
+} // namespace
+
+LineStream::~LineStream() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool LineStream::open(const char* path) {
+    fd_ = ::open(path, O_RDONLY);
+    if (fd_ < 0) {
+        return false;
+    }
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+bool LineStream::next(std::string_view& line) {
+    while (true) {
+        const char* base = buffer_.data();
+        const void* newline = std::memchr(base + begin_, '\n', end_ - begin_);
+        if (newline != nullptr || (eof_ && begin_ < end_)) {
+            size_t stop = newline ? static_cast<size_t>(static_cast<const char*>(newline) - base) : end_;
+            size_t length = stop - begin_;
+            if (length > 0 && base[stop - 1] == '\r') {
+                length--;
+            }
+            line = std::string_view(base + begin_, length);
+            begin_ = newline ? stop + 1 : end_;
+            return true;
+        }
+        if (eof_ || fd_ < 0) {
+            return false;
+        }
+        // keep the partial line, grow only if it fills the whole buffer
+        if (begin_ > 0) {
+            std::memmove(buffer_.data(), base + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        ssize_t n = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed_ = true;
+            eof_ = true;
+            return false;
+        }
+        if (n == 0) {
+            eof_ = true;
+        }
+        end_ += static_cast<size_t>(n);
+    }
+}
+
+bool verify_mbp_csv(const std::string& output, const std::string& reference, const VerifyOptions& options,
+                    VerifyResult& result, std::string& error) {
+    result = VerifyResult();
+    LineStream out, ref;
+    if (!out.open(output.c_str())) {
+        error = "cannot read " + output;
+        return false;
+    }
+    if (!ref.open(reference.c_str())) {
+        error = "cannot read " + reference;
+        return false;
+    }
+
+    Divergence& d = result.first;
+    std::vector<std::string> names;
+    std::vector<bool> ignored;
+    int depth_column = -1;
+    std::string_view actual, expected;
+    bool have_actual = out.next(actual);
+    bool have_expected = ref.next(expected);
+    d.line = have_actual ? 1 : 0;
+    d.reference_line = have_expected ? 1 : 0;
+    if (have_expected) {
+        for (std::string_view name : split(expected)) {
+            if (name == "depth") {
+                depth_column = static_cast<int>(names.size());
+            }
+            names.emplace_back(name);
+        }
+    }
+    for (const std::string& name : options.ignore_columns) {
+        auto it = std::find(names.begin(), names.end(), name);
+        if (it == names.end()) {
+            error = "no column " + name + " in " + reference;
+            return false;
+        }
+        ignored.resize(names.size());
+        ignored[it - names.begin()] = true;
+    }
+    const std::vector<bool> none;
+
+    int first_column = options.skip_deep ? 1 : 0;
+    bool header = true;
+    while (true) {
+        if (have_actual && have_expected) {
+            bool same = (header || !options.skip_deep) ? actual == expected
+                                                     : without_index(actual) == without_index(expected);
+            int column = same ? -1 : first_difference(actual, expected, header ? 0 : first_column,
+                                                      header ? none : ignored, d.actual, d.expected);
+            if (column >= 0) {
+                d.column = column;
+                d.column_name = static_cast<size_t>(column) < names.size() ? names[column] : "";
+                result.diverged = true;
+                break;
+            }
+            result.rows += header ? 0 : 1;
+            if (!header && result.rows == options.max_rows) {
+                break;
+            }
+        } else if (have_actual || have_expected) {
+            // one file ended early
+            d.column = -1;
+            d.column_name.clear();
+            d.actual = have_actual ? std::string(actual) : "<end of file>";
+            d.expected = have_expected ? std::string(expected) : "<end of file>";
+            result.diverged = true;
+            break;
+        } else {
+            break;
+        }
+        header = false;
+
+        // line numbers move past the end too, to name the missing row
+        have_actual = out.next(actual);
+        d.line++;
+        while (true) {
+            have_expected = ref.next(expected);
+            d.reference_line++;
+            if (!have_expected || !options.skip_deep || depth_column < 0 ||
+                parse_int(field(expected, depth_column)) < MAX_BOOK_DEPTH) {
+                break;
+            }
+            result.skipped++;
+        }
+    }
+    if (out.failed() || ref.failed()) {
+        error = "read error in " + (out.failed() ? output : reference);
+        return false;
+    }
+    return true;
+}
+
+std::string describe_divergence(const Divergence& d) {
+    std::string text;
+    if (d.line > 1) {
+        text = "row " + std::to_string(d.line - 2) + " ";
+    } else if (d.line == 1) {
+        text = "header ";
+    }
+    text += "(line " + std::to_string(d.line) + ", reference line " + std::to_string(d.reference_line) + ")";
+    if (d.column >= 0) {
+        text += ", column " + std::to_string(d.column);
+        if (!d.column_name.empty()) {
+            text += " " + d.column_name;
+        }
+    }
+    text += ": expected '" + d.expected + "', got '" + d.actual + "'";
+    return text;
+}
+
+bool print_divergence_book(const std::string& mbo_path, const Divergence& divergence,
+                           const std::string& book_type) {
+    if (divergence.line < 2) {
+        return false;       // no data row to stop at
+    }
+    MappedFile input;
+    if (!input.open(mbo_path.c_str())) {
+        return false;
+    }
+    uint64_t target = divergence.line - 2;
+    if (book_type == "map") {
+        return replay_to_row<OrderBook>(input, target);
+    }
+    return (book_type == "l3") ? replay_to_row<L3Book>(input, target) : replay_to_row<LadderBook>(input, target);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streaming diff of a reconstructed mbp csv against a reference one (mbp.csv).
+// Both files are read through fixed-size buffers a line at a time, so memory
+// stays flat whatever the file sizes; equal rows cost one memcmp and only a
+// differing row is split into columns to find the first divergent field.
+
+// Reads a file line by line through one buffer that is refilled with read(2).
+// The buffer only grows if a single line does not fit.
+class LineStream {
+private:
+    int fd_ = -1;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    bool eof_ = false;
+    bool failed_ = false;
+
+public:
+    explicit LineStream(size_t buffer_size = 1 << 16) : buffer_(buffer_size) {}
+    ~LineStream();
+    LineStream(const LineStream&) = delete;
+    LineStream& operator=(const LineStream&) = delete;
+
+    bool open(const char* path);
+    // the next line without its '\n' (or "\r\n"); valid until the next call
+    bool next(std::string_view& line);
+    bool failed() const { return failed_; }
+};
+
+struct VerifyOptions {
+    // Drop reference rows with depth >= 10, which this reconstructor does not
+    // publish, and ignore the row index column, which then no longer lines up.
+    bool skip_deep = false;
+    // stop after this many equal data rows (0 = the whole file), to gate on the
+    // prefix before a known divergence
+    uint64_t max_rows = 0;
+    // reference header names whose values may differ, e.g. a count one book
+    // derives differently
+    std::vector<std::string> ignore_columns;
+};
+
+struct Divergence {
+    uint64_t line = 0;              // 1-based line in the output file (1 = header)
+    uint64_t reference_line = 0;    // same in the reference
+    int column = -1;                // -1 when one file ended early
+    std::string column_name;
+    std::string expected;           // reference text
+    std::string actual;             // output text
+};
+
+struct VerifyResult {
+    uint64_t rows = 0;              // data rows compared equal
+    uint64_t skipped = 0;           // reference rows dropped by skip_deep
+    bool diverged = false;
+    Divergence first;
+};
+
+// Compares output against reference until the first divergent row. False
+// (with a message in error) only if a file cannot be read or an ignored column
+// is not in the reference header; a divergence is reported through result.
+bool verify_mbp_csv(const std::string& output, const std::string& reference, const VerifyOptions& options,
+                    VerifyResult& result, std::string& error);
+
+// "row R (line L, reference line M), column C ask_ct_00: expected '1', got '0'"
+std::string describe_divergence(const Divergence& divergence);
+
+// Replays mbo_path through book_type ("map", "ladder" or "l3") up to the
+// record that wrote the divergent row, then prints that record and the book's
+// levels in the MBPFormatter::print_book layout.
+bool print_divergence_book(const std::string& mbo_path, const Divergence& divergence,
+                           const std::string& book_type);